@@ -11,6 +11,7 @@ typedef u64 pit_value;
 typedef i64 pit_symbol; /* a symbol at runtime is an index into the runtime's symbol table */
 typedef i64 pit_ref; /* a reference is an index into the runtime's arena */
 PIT_DECLARE_VEC(pit_value)
+PIT_DECLARE_VEC(pit_ref)
 
 struct pit_runtime;
 
@@ -22,6 +23,11 @@ typedef struct {
     bool is_macro, is_special_form, is_keyword;
 } pit_symtab_entry;
 PIT_DECLARE_VEC(pit_symtab_entry)
+/* a slot in the hash index over symbol names: the name's hash, and one more than the symbol, or zero if the slot is empty */
+typedef struct {
+    u32 hash;
+    i32 symbol;
+} pit_symtab_slot;
 
 /* annotation attached to (some) heavy values detailing things like line numbers */
 typedef struct {
@@ -31,21 +37,40 @@ typedef struct {
     pit_ref ref;
     pit_annotation annotation;
 } pit_annotated_ref;
+PIT_DECLARE_VEC(pit_annotation)
 PIT_DECLARE_VEC(pit_annotated_ref)
 void pit_annotation_set(struct pit_runtime *rt, pit_ref ref, pit_annotation annotation);
 pit_annotated_ref *pit_annotation_get(struct pit_runtime *rt, pit_ref ref);
 
+/* remembered result of applying a macro to the arguments in a particular application (see macroexpand.h) */
+typedef struct {
+    pit_ref ref; /* the macro application */
+    pit_value expansion;
+    u64 epoch; /* macro_epoch at the time of expansion */
+} pit_expansion;
+PIT_DECLARE_VEC(pit_expansion)
+void pit_expansion_set(struct pit_runtime *rt, pit_ref ref, pit_value expansion);
+pit_expansion *pit_expansion_get(struct pit_runtime *rt, pit_ref ref);
+
 /* entries on a stack used when traversing trees of values */
 typedef struct {
     enum {
         PIT_TRAVERSAL_ENTRY_VALUE,
         PIT_TRAVERSAL_ENTRY_DUMP_STRING,
         PIT_TRAVERSAL_ENTRY_APPLICATION,
+        PIT_TRAVERSAL_ENTRY_COMPILE,
+        PIT_TRAVERSAL_ENTRY_COMPILE_TAIL,
+        PIT_TRAVERSAL_ENTRY_EMIT,
+        PIT_TRAVERSAL_ENTRY_PATCH,
+        PIT_TRAVERSAL_ENTRY_SCOPE,
     } sort;
     union {
         pit_value value;
         char *dump_string;
         struct { i64 arity; pit_annotated_ref *annotation; } application; 
+        struct { u32 word; i64 patch; } emit; /* instruction word, and the index of a PATCH entry to tell where it went (or -1) */
+        i64 patch; /* position of a jump instruction whose target should be the current position */
+        pit_value scope; /* (slots-in-use . alist from local variable names to slots) to switch the compiler to */
     } in;
 } pit_traversal_entry;
 PIT_DECLARE_VEC(pit_traversal_entry)
@@ -53,6 +78,115 @@ void pit_traversal_push_value(struct pit_runtime *rt, pit_vec(pit_traversal_entr
 void pit_traversal_push_dump_string(struct pit_runtime *rt, pit_vec(pit_traversal_entry) *s, char *m);
 void pit_traversal_push_application(struct pit_runtime *rt, pit_vec(pit_traversal_entry) *s, i64 arity, pit_annotated_ref *annotation);
 
+/* activation records for bytecode functions (see vm.h) */
+typedef struct {
+    pit_value func; /* closure being executed */
+    i64 pc; /* index of the next instruction to execute */
+    i64 base; /* index in result_stack of the function; its slots follow, then its temporaries */
+    i64 calls; /* depth of the runtime's call stack to return to */
+} pit_frame;
+PIT_DECLARE_VEC(pit_frame)
+/* what the machine code for a frame runs with, saved when it calls a closure, so that the callee can return to it directly (see jit.h).
+   this is valid while func is the frame's closure and epoch matches the runtime's epoch */
+typedef struct {
+    pit_value func;
+    u64 epoch;
+    pit_value *consts;
+    struct pit_inline_cache *caches;
+    pit_value *env;
+    struct pit_jit_code *native;
+    u32 *code;
+} pit_jit_frame;
+/* a proto that has machine code, which is freed once the proto is collected */
+typedef struct {
+    pit_ref proto;
+    struct pit_jit_code *native;
+} pit_jit_entry;
+PIT_DECLARE_VEC(pit_jit_entry)
+PIT_DECLARE_VEC(u32)
+
+/* what the profiler has measured (see profile.h): either every call to a function, or the calls from one call site */
+typedef struct {
+    pit_value function; /* the proto of a closure, or a native function */
+    i64 line, column; /* location of the call site, or -1 for the function's totals */
+    i64 calls;
+    i64 active; /* calls in progress, so that the time in recursive calls is only counted once */
+    u64 inclusive, exclusive; /* time, in units of the host's clock */
+    i64 allocs; /* heavy values allocated by the function itself */
+} pit_profile_entry;
+PIT_DECLARE_VEC(pit_profile_entry)
+/* a call in progress while profiling */
+typedef struct {
+    i64 entry, site; /* indices in the profile; site is -1 if the call site is unknown */
+    i64 frames; /* length of the frame stack during the call */
+    bool native; /* calls to closures have their own frame, calls to native functions don't */
+    u64 start, children; /* time when the call started, and time spent in its callees */
+    i64 allocs, children_allocs; /* length of the heap when the call started, and heavy values allocated by callees */
+} pit_profile_call;
+PIT_DECLARE_VEC(pit_profile_call)
+
+/* built-in functions that bytecode can perform inline on integer arguments (see PIT_OP_INTRINSIC in vm.h).
+   each takes exactly two arguments */
+typedef enum {
+    PIT_INTRINSIC_ADD=0,
+    PIT_INTRINSIC_SUB,
+    PIT_INTRINSIC_MUL,
+    PIT_INTRINSIC_LT,
+    PIT_INTRINSIC_GT,
+    PIT_INTRINSIC_LE,
+    PIT_INTRINSIC_GE,
+    PIT_INTRINSIC_EQ,
+    PIT_INTRINSIC_BITWISE_AND,
+    PIT_INTRINSIC_BITWISE_OR,
+    PIT_INTRINSIC_BITWISE_XOR,
+    PIT_INTRINSIC_BITWISE_LSHIFT,
+    PIT_INTRINSIC_BITWISE_RSHIFT,
+    PIT_INTRINSIC__SENTINEL
+} pit_intrinsic;
+
+/* built-in functions that the VM performs itself instead of calling, because they call (or switch away from) Lisp code.
+   doing that in the VM's loop rather than recursing in C means that whatever they run can be suspended */
+typedef enum {
+    PIT_CONTROL_FUNCALL=0, /* funcall */
+    PIT_CONTROL_APPLY, /* apply */
+    PIT_CONTROL_RESUME, /* coroutine/resume! */
+    PIT_CONTROL_YIELD, /* yield! */
+    PIT_CONTROL__SENTINEL
+} pit_control;
+
+/* a coroutine that is running: its first frame is at this index in frames */
+typedef struct {
+    pit_value coroutine;
+    i64 frames;
+} pit_coroutine_activation;
+PIT_DECLARE_VEC(pit_coroutine_activation)
+
+/* symbols that the runtime itself looks for, interned once when it's created */
+typedef enum {
+    PIT_SYMBOL_QUOTE=0, /* quote */
+    PIT_SYMBOL_LAMBDA, /* lambda */
+    PIT_SYMBOL_PROGN, /* progn */
+    PIT_SYMBOL_DEFER, /* defer */
+    PIT_SYMBOL_IF, /* if */
+    PIT_SYMBOL_COND, /* cond */
+    PIT_SYMBOL_OR, /* or */
+    PIT_SYMBOL_LET, /* let */
+    PIT_SYMBOL_SET, /* set! */
+    PIT_SYMBOL_FSET, /* fset! */
+    PIT_SYMBOL_DEFUN, /* defun! */
+    PIT_SYMBOL_REST, /* & */
+    PIT_SYMBOL__SENTINEL
+} pit_well_known_symbol;
+
+/* what an incremental collection is doing (see pit_gc_step) */
+typedef enum {
+    PIT_GC_IDLE=0, /* there isn't one in progress */
+    PIT_GC_SCAN, /* scanning the values it copied, and copying what they refer to */
+    PIT_GC_CARRY_EXPANSIONS, /* carrying remembered expansions over to the macro applications it copied */
+    PIT_GC_DROP_ANNOTATIONS, /* dropping the entries in annotations for fromspace */
+    PIT_GC_DROP_EXPANSIONS, /* and the same for expansions */
+} pit_gc_phase;
+
 typedef struct pit_runtime {
     /* interpreter state */
     pit_arena *heap; /* all heavy values, bytestrings, and arrays. */
@@ -60,16 +194,82 @@ typedef struct pit_runtime {
     /* this allows us to iterate over only heavy values at the front (useful in Cheney's algorithm for GC */
     pit_arena *backbuffer; /* additional allocation, the same size as the heap (used by GC) */
     pit_vec(pit_annotated_ref) *annotations;
-    pit_vec(pit_annotated_ref) *backtrace; /* we reuse this vector for both backtraces and the GC */
+    /* for each heavy value, one more than the index of its entry in annotations, or zero if it has none */
+    i32 *annotation_index;
+    i64 annotation_index_len;
+    pit_vec(pit_annotated_ref) *backbuffer_annotations; /* annotations for copied values (used by GC) */
+    pit_vec(pit_expansion) *expansions;
+    /* for each heavy value, one more than the index of its entry in expansions, or zero if it has none */
+    i32 *expansion_index;
+    pit_vec(pit_expansion) *backbuffer_expansions; /* expansions for copied values (used by GC) */
+    i32 *backbuffer_annotation_index, *backbuffer_expansion_index; /* the indices for the backbuffer's values (used by GC) */
+    /* generations (see gc.h) */
+    i64 gc_old; /* heavy values at refs below this are old, and the rest are young */
+    i64 gc_old_back; /* bytestrings and arrays above this offset in the heap belong to old values */
+    i64 gc_old_annotations, gc_old_expansions; /* entries before these in annotations and expansions are for old values */
+    pit_vec(pit_ref) *remembered; /* old values that might refer to young values, and frozen values that might refer to the rest */
+    i64 gc_nursery; /* bytes of young values to allow before collecting them */
+    i64 gc_major; /* bytes of old values to allow before collecting everything */
+    bool gc_pending; /* set by allocation once a collection is due, for the next safe point to perform */
+    i64 gc_inhibit; /* safe points don't collect while this is positive */
+    u64 gc_count; /* number of collections so far: pointers into the heap must be looked up again when this changes */
+    i64 gc_reclaimed; /* heavy values that collections have freed so far */
+    i64 gc_budget; /* values for each safe point to scan during an incremental collection, or 0 for major collections to happen at once */
+    pit_gc_phase gc_phase;
+    i64 gc_scan; /* the next value in the heap that the incremental collection might have to scan */
+    i64 gc_cursor, gc_kept; /* the next entry of annotations or expansions to look at, and where the next one it keeps goes */
+    i64 gc_flip_annotations, gc_flip_expansions; /* their lengths when it began: entries before these can be for fromspace */
+    i64 gc_flip_jit; /* and the length of jit_code */
+    i64 gc_flipped, gc_copied; /* bytes after the frozen point when it began, and how many of those it has copied so far */
+    i64 gc_stepped; /* bytes allocated since it began, as of its last step */
+    bool gc_carried; /* whether the current pass over expansions has carried any over */
+    pit_vec(pit_value) *handles; /* values held by C code across safe points (see pit_handle_new) */
     pit_vec(pit_symtab_entry) *symtab; /* all symbols */
+    pit_symtab_slot *symtab_index; /* open addressing hash table from names to symbols (see pit_symtab_intern) */
+    i64 symtab_index_len; /* a power of two */
     /* temporary/"scratch" memory */
     pit_vec(pit_value) *saved_bindings; /* stack used to save old values of bindings to be restored ("shallow binding") */
     pit_vec(pit_value) *expr_stack; /* stack of subexpressions to evaluate during evaluation */
     pit_vec(pit_value) *result_stack; /* stack of intermediate values during evaluation */
     pit_vec(pit_traversal_entry) *traversal; /* intermediate stack used during tree traversal */
+    pit_vec(pit_frame) *frames; /* stack of active bytecode function calls */
+    pit_vec(pit_annotation) *calls; /* source location of every active function call, for backtraces. unknown locations are negative */
+    pit_vec(pit_coroutine_activation) *coroutines; /* running coroutines, each resumed by the one before it */
+    i64 calls_max; /* maximum depth of calls: calling deeper than this is an error. defaults to the capacity of calls */
+    /* resumable evaluation (see pit_eval_start in eval.h) */
+    i64 fuel; /* steps left before the resumable evaluation suspends */
+    i64 eval_forms; /* the length of expr_stack when the resumable evaluation started, or -1 if there isn't one */
+    i64 eval_frames, eval_stack; /* the lengths of frames and result_stack below the function it's suspended in, or -1 */
+    pit_value eval_value; /* the value of the last form it finished */
+    pit_vec(u32) *code; /* bytecode being emitted by the compiler */
+    pit_vec(pit_value) *constants; /* constants being collected by the compiler */
+    pit_value symbols[PIT_SYMBOL__SENTINEL]; /* well-known symbols, so that checking for them is a single comparison */
     /* bookkeeping */
     /* "frozen" values offsets: values before these offsets are immutable, and we can reset here later */
     i64 frozen_values, frozen_symtab;
+    i64 frozen_back, frozen_annotations, frozen_expansions; /* heap->back and the lengths of annotations and expansions there */
+    /* the native function each intrinsic stands in for. calls are only performed inline while the callee is that function */
+    pit_value (*intrinsics[PIT_INTRINSIC__SENTINEL])(struct pit_runtime *rt, i64 argc, pit_value *argv, void *data);
+    /* the native function each control stands in for. the VM performs these itself while they're bound */
+    pit_value (*controls[PIT_CONTROL__SENTINEL])(struct pit_runtime *rt, i64 argc, pit_value *argv, void *data);
+    /* executable memory for the JIT (see jit.h), which only the host can provide. the JIT is off while these are NULL */
+    void *(*jit_alloc)(struct pit_runtime *rt, i64 size); /* return writable memory for size bytes of machine code */
+    /* make size bytes from jit_alloc executable. the first code_size bytes are machine code, to be named for profilers */
+    bool (*jit_publish)(struct pit_runtime *rt, void *mem, i64 size, i64 code_size, char *name);
+    void (*jit_free)(struct pit_runtime *rt, void *mem, i64 size); /* release memory from jit_alloc */
+    pit_vec(pit_jit_entry) *jit_code; /* every proto with machine code */
+    pit_jit_frame *jit_frames; /* for each of the first jit_frames_len frames, its state when it last called a closure from machine code */
+    i64 jit_frames_len;
+    i64 jit_threshold; /* number of calls after which a function is compiled to machine code */
+    /* profiler state (see profile.h) */
+    bool profiling;
+    pit_vec(pit_profile_entry) *profile;
+    i32 *profile_index; /* hash table from function and call site to one more than the index of its entry in profile */
+    i64 profile_index_len; /* a power of two */
+    pit_vec(pit_profile_call) *profile_calls;
+    u64 (*clock)(struct pit_runtime *rt); /* the current time, from the host. without it, the profiler only counts */
+    u64 epoch; /* changes whenever a function binding might have changed, invalidating call-site caches */
+    u64 macro_epoch; /* changes whenever a macro might have changed, invalidating remembered expansions */
     pit_value error; /* error value - if this is non-nil, an error has occured! only tracks the first error */
     i64 source_line, source_column; /* for error reporting only; line and column of token start */
     i64 error_line, error_column; /* line and column of token start at time of error */
@@ -82,9 +282,12 @@ bool pit_runtime_print_error(pit_runtime *rt); /* return true if an error has oc
 
 #define pit_debug_trace(rt, v) pit_debug_trace_(rt, "Trace [" __FILE__ ":" PIT_STR(__LINE__) "] %s\n", v)
 void pit_debug_trace_(pit_runtime *rt, char *format, pit_value v);
-pit_value pit_error_get(pit_runtime *rt);
+pit_value pit_error_get(pit_runtime *rt); /* take the current error, handling it */
 void pit_error(pit_runtime *rt, char *format, ...);
 
+/* record a call at the given source location on the call stack */
+bool pit_calls_push(pit_runtime *rt, i64 line, i64 column);
+
 /* repl / file loading */
 pit_value pit_load_file(pit_runtime *rt, char *path);
 void pit_repl(pit_runtime *rt);
@@ -94,6 +297,9 @@ void pit_repl(pit_runtime *rt);
 #include <lcq/pit/runtime/dump.h>
 #include <lcq/pit/runtime/macroexpand.h>
 #include <lcq/pit/runtime/eval.h>
+#include <lcq/pit/runtime/compile.h>
+#include <lcq/pit/runtime/vm.h>
+#include <lcq/pit/runtime/profile.h>
 #include <lcq/pit/runtime/gc.h>
 
 #endif
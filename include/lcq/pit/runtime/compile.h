@@ -0,0 +1,11 @@
+#ifndef LCOLONQ_PIT_RUNTIME_COMPILE_H
+#define LCOLONQ_PIT_RUNTIME_COMPILE_H
+
+#include <lcq/pit/runtime.h>
+
+/* compile a macroexpanded expression into a proto that evaluates it and returns the result.
+   params are the names of the function's parameters (which occupy its first slots),
+   and captured are the names of its closure environment entries, in order */
+pit_value pit_compile(pit_runtime *rt, pit_value params, pit_value captured, pit_value e);
+
+#endif
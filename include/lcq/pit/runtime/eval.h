@@ -3,6 +3,20 @@
 
 #include <lcq/pit/runtime.h>
 
+/* evaluate e by compiling it and running the result */
 pit_value pit_eval(pit_runtime *rt, pit_value e);
+/* resumable evaluation, for hosts that can only give a script so much time at once (e.g. once per frame).
+   the evaluation proceeds in steps: a step is a top-level form, or a call from bytecode to a closure.
+   when the budget of steps runs out, it suspends with everything it needs on the runtime's stacks,
+   and picks up from there on the next pit_eval_resume. calls made by native functions (other than funcall and apply),
+   macro expansion, and forms that are interpreted rather than compiled aren't steps, and always run to completion.
+   only one resumable evaluation can be in progress at a time, but pit_eval can be used while it's suspended */
+void pit_eval_start(pit_runtime *rt, pit_value e); /* begin evaluating e, without running anything yet */
+/* run the evaluation for up to budget steps. returns true once it has finished, storing its value in result
+   (or nil, if it failed with an error); returns false if it's suspended */
+bool pit_eval_resume(pit_runtime *rt, i64 budget, pit_value *result);
+void pit_eval_abandon(pit_runtime *rt); /* discard the evaluation in progress, if there is one */
+/* evaluate e by walking it directly. this is only needed for special forms that the compiler can't handle */
+pit_value pit_interpret(pit_runtime *rt, pit_value e);
 
 #endif
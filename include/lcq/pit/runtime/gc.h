@@ -3,6 +3,50 @@
 
 #include <lcq/pit/runtime.h>
 
-void pit_gc(pit_runtime *rt);
+/* the heap has two generations. values that have survived a collection are old: they sit at the front of the heap,
+   below rt->gc_old, with their bytestrings and arrays at the very back. everything allocated since is young.
+   a minor collection copies only the young values that are still reachable, and they become old.
+   roots for that are the usual ones, plus the remembered set: old values that were changed to refer to young values,
+   which the write barrier records. a major collection copies everything after the frozen point (see pit_runtime_freeze),
+   and happens when the old generation has grown enough since the last one.
+   frozen values are never copied. the few that can still change (arrays and coroutines) stay in the remembered set
+   for good once they refer to anything after the frozen point, so that both kinds of collection trace them */
+
+/* collections also happen during evaluation. once allocation finds that one is due, it sets rt->gc_pending,
+   and the VM collects at its next safe point: entering a closure, when everything it's using is on the runtime's stacks.
+   values and their bytestrings and arrays move, so C code that runs Lisp code (or calls anything that might,
+   like pit_eval or pit_value_apply) must keep the values it still needs afterwards in handles,
+   and look up any pit_value_heavy pointers again. code that can't do that raises rt->gc_inhibit while it runs */
+
+/* a major collection copies everything that's still reachable, so it pauses for as long as that takes.
+   with rt->gc_budget set, major collections are incremental instead. the heap and the backbuffer swap straight away,
+   and only the roots are copied then. the copies are gray: they still refer to values in fromspace (the backbuffer).
+   each safe point after that scans gc_budget gray values, once allocation has gone on for about as many,
+   and the host can do more when it has time to spare with pit_gc_step. the mutator never sees fromspace,
+   because pit_value_ref_deref scans a gray value before returning it, and values allocated meanwhile aren't gray.
+   pauses are then bounded by the budget and the roots, unless allocation outruns the collection:
+   if what's left of fromspace might not fit in the heap, the next safe point finishes it */
+
+void pit_gc(pit_runtime *rt); /* major collection */
+void pit_gc_minor(pit_runtime *rt); /* minor collection */
+void pit_gc_collect(pit_runtime *rt); /* whichever collection is due, if any: call this whenever it's safe to collect */
+bool pit_gc_due(pit_runtime *rt); /* whether the young generation is big enough to collect, or the heap is running out */
+void pit_gc_safepoint(pit_runtime *rt); /* collect if allocation asked for it and nothing inhibits it */
+/* do budget values' worth of an incremental collection, beginning one if a major collection is due.
+   returns whether there's one still in progress. call this when it's safe to collect */
+bool pit_gc_step(pit_runtime *rt, i64 budget);
+/* the heavy value at ref r is gray: scan it before anything reads it */
+void pit_gc_read_barrier(pit_runtime *rt, pit_ref r);
+
+/* v is about to be stored in the heavy value at ref r. this must be called whenever a value that might be old is changed */
+void pit_gc_write_barrier(pit_runtime *rt, pit_ref r, pit_value v);
+/* treat every value after the frozen point as young again, for example because they were discarded */
+void pit_gc_demote(pit_runtime *rt);
+/* treat every value as old without collecting, for example because they're about to be frozen */
+void pit_gc_promote(pit_runtime *rt);
+
+/* a handle for v: a place that collections keep up to date, for as long as rt->handles->next stays above it.
+   handles are released by resetting rt->handles->next, like the other stacks. NULL (with an error) if there are too many */
+pit_value *pit_handle_new(pit_runtime *rt, pit_value v);
 
 #endif
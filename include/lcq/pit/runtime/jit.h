@@ -0,0 +1,71 @@
+#ifndef LCOLONQ_PIT_RUNTIME_JIT_H
+#define LCOLONQ_PIT_RUNTIME_JIT_H
+
+#include <lcq/pit/runtime.h>
+#include <lcq/pit/runtime/value.h>
+
+/* an optional second tier for the VM on x86-64.
+   once a proto has been entered jit_threshold times, its bytecode is translated instruction by instruction
+   into machine code in memory from the host's jit_alloc. the machine code works on the same frames and
+   evaluation stack as the interpreter, so either can pick up where the other left off:
+   the interpreter runs the machine code whenever it reaches an instruction that was translated,
+   and the machine code hands back to the interpreter for instructions that weren't (EVAL)
+   or when a guard fails (an intrinsic whose arguments aren't integers).
+   calls and returns switch frames without leaving machine code. a call site remembers the closure it called
+   in its inline cache, and a frame that calls a closure leaves its state in rt->jit_frames for the callee to return to,
+   so that the common case doesn't look anything up; the rest goes through pit_vm_jit_call and pit_vm_jit_return.
+   machine code belongs to its proto, and is freed (with the host's jit_free) when the proto is collected */
+
+#define PIT_JIT_THRESHOLD 64
+
+/* state shared between the interpreter and machine code. fields are read and written by generated code */
+typedef struct {
+    pit_runtime *rt;
+    pit_value *sp; /* the next free entry on the evaluation stack */
+    pit_value *slots; /* the current frame's local variable slots */
+    pit_value *consts;
+    pit_inline_cache *caches;
+    pit_value *env; /* the current closure's captured cells */
+    struct pit_jit_code *native; /* the current frame's machine code */
+    u32 *code; /* and its bytecode */
+    pit_value *stack, *stack_end; /* the evaluation stack */
+    i64 frames_reset; /* the interpreter's run ends when the frame at this index returns, so that return is left to it */
+    bool suspendable; /* calls to closures take a step of rt->fuel (see pit_eval_start) */
+    bool suspended; /* set when the fuel ran out, with pc at the start of the frame the interpreter should suspend */
+    i64 pc; /* on return, the instruction the interpreter should continue at */
+} pit_jit_state;
+
+/* machine code for a proto. this follows the code itself in memory from jit_alloc */
+typedef struct pit_jit_code {
+    i64 len; /* length of the bytecode */
+    i64 size; /* bytes from jit_alloc */
+    /* run the code starting at target, which is one of the addresses in entries */
+    void (*enter)(pit_jit_state *st, u8 *target);
+    u8 *code;
+    u32 entries[]; /* for each instruction, the offset of its machine code from code, or zero if it has none */
+} pit_jit_code;
+
+/* translate the bytecode of proto p, belonging to the closure f, and remember the result in p.
+   returns false (without an error) if the JIT is unavailable, or p contains something it can't translate */
+bool pit_jit_compile(pit_runtime *rt, pit_value f, pit_value_heavy *p);
+
+/* run machine code for the instruction at st->pc until it hands back to the interpreter */
+void pit_jit_run(pit_runtime *rt, pit_jit_code *native, pit_jit_state *st);
+
+/* the VM's side of CALL/TAIL_CALL and RETURN at pc, for when the machine code can't do them alone (see vm.c).
+   return the machine code to continue at, in whichever frame is then innermost, with st updated to match;
+   or NULL to hand back to the interpreter at st->pc */
+u8 *pit_vm_jit_call(pit_jit_state *st, i64 pc);
+u8 *pit_vm_jit_return(pit_jit_state *st, i64 pc);
+
+/* free machine code with the host's jit_free */
+void pit_jit_free(pit_runtime *rt, pit_jit_code *native);
+/* free the machine code of every proto at a ref from onwards, which are gone (see pit_runtime_reset) */
+void pit_jit_drop(pit_runtime *rt, pit_ref from);
+
+/* install hooks that allocate executable memory with mmap, if the environment variable PIT_JIT is 1.
+   with PIT_JIT_PERFMAP also 1, the generated code is listed in /tmp/perf-PID.map for perf.
+   this is part of the native library, and does nothing where the JIT isn't supported */
+void pit_jit_install_native(pit_runtime *rt);
+
+#endif
@@ -3,6 +3,11 @@
 
 #include <lcq/pit/runtime.h>
 
+/* expand all macros in top, and simplify the result */
 pit_value pit_macroexpand(pit_runtime *rt, pit_value top);
+/* apply the macro at the head of form to its arguments, once.
+   this is the only place macros are applied: the result is remembered for that cons,
+   so evaluating the same code again doesn't expand it again unless a macro has been redefined since */
+pit_value pit_macroexpand_form(pit_runtime *rt, pit_value form);
 
 #endif
@@ -0,0 +1,24 @@
+#ifndef LCOLONQ_PIT_RUNTIME_PROFILE_H
+#define LCOLONQ_PIT_RUNTIME_PROFILE_H
+
+#include <lcq/pit/runtime.h>
+
+/* the profiler counts calls, time and allocations for each function (each proto, for closures)
+   and separately for each call site. it's driven by hooks where closures are entered and return,
+   and where native functions are called. all of them do nothing unless rt->profiling is set */
+
+void pit_profile_start(pit_runtime *rt); /* forget everything measured so far, and start measuring */
+void pit_profile_stop(pit_runtime *rt); /* finish the calls in progress, and stop measuring */
+void pit_profile_clear(pit_runtime *rt); /* forget everything measured so far */
+
+/* sort is one of :calls, :inclusive, :exclusive or :allocs (nil means :inclusive).
+   returns a plist for each function, or each call site if sites is non-nil, in descending order of sort */
+pit_value pit_profile_report(pit_runtime *rt, pit_value sort, bool sites);
+
+/* hooks */
+void pit_profile_enter(pit_runtime *rt, pit_value f, bool native); /* f (a closure or native function) is being called */
+void pit_profile_exit(pit_runtime *rt, bool native); /* the innermost call (if it's being measured) has returned */
+void pit_profile_unwind(pit_runtime *rt, i64 frames); /* frames above this length were discarded because of an error */
+void pit_profile_moved(pit_runtime *rt); /* functions were moved by the garbage collector */
+
+#endif
@@ -23,5 +23,6 @@ void pit_symtab_symbol_mark_special_form(pit_runtime *rt, pit_value sym);
 void pit_symtab_sfset(pit_runtime *rt, pit_value sym, pit_value v);
 void pit_symtab_bind(pit_runtime *rt, pit_value sym, pit_value v);
 pit_value pit_symtab_unbind(pit_runtime *rt, pit_value sym);
+void pit_symtab_unbind_to(pit_runtime *rt, i64 mark); /* undo all bindings made since saved_bindings was at mark */
 
 #endif
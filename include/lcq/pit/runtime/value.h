@@ -20,6 +20,8 @@ u64 pit_value_data(pit_value v);
 
 /* "heavy" values, the targets of refs */
 typedef pit_value (*pit_nativefunc)(struct pit_runtime *rt, pit_value args, void *data);
+/* native functions can also take their arguments directly from the evaluation stack, avoiding consing an argument list */
+typedef pit_value (*pit_nativefunc_argv)(struct pit_runtime *rt, i64 argc, pit_value *argv, void *data);
 typedef struct {
     enum pit_value_heavy_sort {
         PIT_VALUE_HEAVY_SORT_CELL=0, /* value cell - basically, a "location" referred to by a variable binding */
@@ -29,16 +31,22 @@ typedef struct {
         PIT_VALUE_HEAVY_SORT_FUNC, /* Lisp closure */
         PIT_VALUE_HEAVY_SORT_NATIVEFUNC, /* native function */
         PIT_VALUE_HEAVY_SORT_NATIVEDATA, /* native data (C pointer) */
+        PIT_VALUE_HEAVY_SORT_PROTO, /* compiled function body: bytecode and constants */
+        PIT_VALUE_HEAVY_SORT_COROUTINE, /* coroutine - a closure that can suspend itself */
         PIT_VALUE_HEAVY_SORT_FORWARDING_POINTER /* forwarding pointer to to-space (during GC) */
     } hsort;
+    bool remembered; /* an old value that's in the remembered set (see gc.h) */
+    bool gray; /* copied by a collection that hasn't yet copied the values this refers to (see gc.h) */
     union {
         pit_value cell;
         struct { pit_value car, cdr; } cons;
         struct { pit_value *data; i64 len; } array;
         struct { u8 *data; i64 len; } bytes;
-        struct { pit_value env; pit_value args; pit_value arg_rest_nm; pit_value body; } func;
-        struct { pit_nativefunc f; void *data; } nativefunc;
+        struct { pit_value env; pit_value args; pit_value arg_rest_nm; pit_value proto; } func; /* env is an array of cells (see pit_value_func_new) */
+        struct { pit_nativefunc f; pit_nativefunc_argv fargv; void *data; } nativefunc; /* exactly one of f and fargv is set */
         struct { pit_value tag; void *data; } nativedata;
+        struct { u32 *code; pit_value consts; i32 len; i32 nslots; i64 ncaches; } proto; /* the caches are stored just before the code */
+        struct { pit_value func; pit_value saved; i32 state; i32 nvalues; i32 nframes; i32 ncalls; } coroutine; /* saved is an array, or nil */
         i64 forwarding_pointer;
     } in;
 } pit_value_heavy;
@@ -55,5 +63,7 @@ bool pit_value_equal(pit_runtime *rt, pit_value a, pit_value b);
 #include <lcq/pit/runtime/value/array.h>
 #include <lcq/pit/runtime/value/func.h>
 #include <lcq/pit/runtime/value/nativedata.h>
+#include <lcq/pit/runtime/value/proto.h>
+#include <lcq/pit/runtime/value/coroutine.h>
 
 #endif
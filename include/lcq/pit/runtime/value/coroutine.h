@@ -0,0 +1,24 @@
+#ifndef LCOLONQ_PIT_RUNTIME_VALUE_COROUTINE_H
+#define LCOLONQ_PIT_RUNTIME_VALUE_COROUTINE_H
+
+#include <lcq/pit/runtime.h>
+#include <lcq/pit/runtime/value.h>
+
+/* heavy value - coroutine.
+   a coroutine runs a closure on the runtime's own stacks when it's resumed. when it yields, its part of the stacks
+   (the evaluation stack from its first frame up, its frames, and its part of the call stack) is moved into the array saved,
+   and moved back when it's resumed again; the VM does both (see PIT_CONTROL_RESUME and PIT_CONTROL_YIELD).
+   saved holds nvalues values, then four per frame (function, pc, and base and calls relative to the first frame),
+   then two per call (line and column). it's reused by later yields when it's large enough */
+typedef enum {
+    PIT_COROUTINE_FRESH=0, /* its function hasn't been called yet */
+    PIT_COROUTINE_SUSPENDED, /* it has yielded */
+    PIT_COROUTINE_RUNNING, /* it has been resumed, and hasn't yielded or returned since */
+    PIT_COROUTINE_DEAD /* its function has returned, or failed with an error */
+} pit_coroutine_state;
+
+bool pit_value_is_coroutine(pit_runtime *rt, pit_value a);
+pit_value pit_value_coroutine_new(pit_runtime *rt, pit_value f); /* f must be a Lisp closure */
+pit_coroutine_state pit_value_coroutine_state(pit_runtime *rt, pit_value co);
+
+#endif
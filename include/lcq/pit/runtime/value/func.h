@@ -7,9 +7,24 @@
 /* heavy value - func / nativefunc */
 bool pit_value_is_func(pit_runtime *rt, pit_value a);
 bool pit_value_is_nativefunc(pit_runtime *rt, pit_value a);
+/* free variables of an expression: symbols evaluated as variables, but not bound in initial_bound or by an inner lambda.
+   only variables in enclosing (the lexical variables in scope around the expression) are included; the rest are globals */
+pit_value pit_value_func_free_vars(pit_runtime *rt, pit_value initial_bound, pit_value body, pit_value enclosing);
+/* closure with the given (expanded) body expression over the variables named in the list captured.
+   env is an array holding the cell of each captured variable, in the same order (or nil if there are none) */
+pit_value pit_value_func_new(pit_runtime *rt, pit_value args, pit_value captured, pit_value env, pit_value body);
+/* a copy of the closure template over a different env.
+   the template's body is already compiled, so this is all it takes to make a new closure from the same lambda */
+pit_value pit_value_func_instantiate(pit_runtime *rt, pit_value template, pit_value env);
 pit_value pit_value_func_lambda(pit_runtime *rt, pit_value args, pit_value body);
 pit_value pit_value_nativefunc_new_with_data(pit_runtime *rt, pit_nativefunc f, void *data);
 pit_value pit_value_nativefunc_new(pit_runtime *rt, pit_nativefunc f);
+pit_value pit_value_nativefunc_argv_new_with_data(pit_runtime *rt, pit_nativefunc_argv f, void *data);
+pit_value pit_value_nativefunc_argv_new(pit_runtime *rt, pit_nativefunc_argv f);
 pit_value pit_value_apply(pit_runtime *rt, pit_value f, pit_value args);
+pit_value pit_value_apply_argv(pit_runtime *rt, pit_value f, i64 argc, pit_value *argv);
+
+/* argument i of an argv native function; like taking the car past the end of an argument list, missing arguments are nil */
+#define PIT_ARG(argc, argv, i) ((i) < (argc) ? (argv)[(i)] : PIT_NIL)
 
 #endif
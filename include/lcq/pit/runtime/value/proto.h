@@ -0,0 +1,38 @@
+#ifndef LCOLONQ_PIT_RUNTIME_VALUE_PROTO_H
+#define LCOLONQ_PIT_RUNTIME_VALUE_PROTO_H
+
+#include <lcq/pit/runtime.h>
+#include <lcq/pit/runtime/value.h>
+
+/* call sites to global functions remember what they called last.
+   the entry is valid while epoch matches the runtime's epoch, which changes whenever any function might have moved or changed */
+typedef struct pit_inline_cache {
+    u64 epoch;
+    pit_value f;
+    pit_value_heavy *h;
+    /* when f is a closure with machine code, calls from machine code can go straight to it (see jit.h).
+       the rest is what it runs with, valid while jit_epoch matches the runtime's epoch */
+    u64 jit_epoch;
+    struct pit_jit_code *native;
+    u8 *entry; /* the machine code for its first instruction */
+    u32 *code;
+    pit_value *consts;
+    struct pit_inline_cache *caches;
+    pit_value *env;
+    i64 nslots;
+} pit_inline_cache;
+#define pit_value_proto_caches(h) ((pit_inline_cache *) (void *) (h)->in.proto.code - (h)->in.proto.ncaches)
+
+/* how many times a proto has been entered, and its machine code once that passes a threshold (see jit.h).
+   this is stored just before the caches */
+typedef struct {
+    i64 calls;
+    struct pit_jit_code *native;
+} pit_proto_jit;
+#define pit_value_proto_jit(h) ((pit_proto_jit *) (void *) pit_value_proto_caches(h) - 1)
+
+/* heavy value - proto (compiled function body) */
+bool pit_value_is_proto(pit_runtime *rt, pit_value a);
+pit_value pit_value_proto_new(pit_runtime *rt, i64 nslots, u32 *code, i64 len, pit_value *consts, i64 consts_len, i64 ncaches);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef LCOLONQ_PIT_RUNTIME_VM_H
+#define LCOLONQ_PIT_RUNTIME_VM_H
+
+#include <lcq/pit/runtime.h>
+
+/* bytecode instructions are 32-bit words: an 8-bit opcode in the low bits and a 24-bit operand above it.
+   instructions operate on a stack of values (the runtime's result_stack).
+   each call's frame on that stack holds the function, then one slot per parameter or let-bound variable
+   (containing a cell if a closure might capture the variable, and its value otherwise), then temporaries */
+typedef enum {
+    PIT_OP_CONST=0, /* push constant [operand] */
+    PIT_OP_VAR, /* push the value of the global variable named by the symbol in constant [operand] */
+    PIT_OP_FUNC, /* push the function bound to the symbol in constant [operand]. the next word is the index of its inline cache */
+    PIT_OP_SLOT, /* push local variable slot [operand], which holds a value directly */
+    PIT_OP_LOCAL, /* push the value of the cell in local variable slot [operand] */
+    PIT_OP_ENV, /* push the value of closure environment entry [operand] */
+    PIT_OP_SET_SLOT, /* set local variable slot [operand] to the top of the stack (without popping it) */
+    PIT_OP_SET_LOCAL, /* set the cell in local variable slot [operand] to the top of the stack (without popping it) */
+    PIT_OP_SET_ENV, /* set closure environment entry [operand] to the top of the stack (without popping it) */
+    PIT_OP_BIND_SLOT, /* pop the top of the stack into local variable slot [operand] */
+    PIT_OP_BIND, /* pop the top of the stack into a fresh cell in local variable slot [operand] */
+    PIT_OP_BOX, /* replace the value in local variable slot [operand] with a fresh cell containing it */
+    PIT_OP_CELL_LOCAL, /* push the cell in local variable slot [operand] */
+    PIT_OP_CELL_ENV, /* push the cell of closure environment entry [operand] */
+    PIT_OP_POP, /* discard the top of the stack */
+    PIT_OP_JUMP, /* continue at instruction [operand] */
+    PIT_OP_JUMP_NIL, /* pop the top of the stack, and continue at instruction [operand] if it was nil */
+    PIT_OP_JUMP_NOT_NIL_OR_POP, /* continue at [operand] if the top of the stack is not nil, otherwise pop it */
+    PIT_OP_CALL, /* apply the function below the top [operand] values to them.
+                    the next word is a call site, and the one after that is one more than the index of the inline cache
+                    that the function was looked up through, or zero if it wasn't */
+    PIT_OP_TAIL_CALL, /* like CALL, but the caller's frame is replaced by the callee's if the callee is a closure */
+    PIT_OP_RETURN, /* return the top of the stack to the caller */
+    PIT_OP_CLOSURE, /* pop one cell per captured variable and push a closure over them.
+                       constant [operand] is a closure with no environment, to instantiate with those cells.
+                       the next word is the number of captured variables */
+    PIT_OP_EVAL, /* push the result of evaluating constant [operand] with pit_interpret */
+    PIT_OP_INTRINSIC, /* replace the top two values with the result of calling the function bound to a symbol on them.
+                         [operand] is the pit_intrinsic that function was when the call was compiled.
+                         the next three words are the symbol's constant index, an inline cache, and a call site.
+                         if the function is still that built-in and the arguments are integers, no call is made */
+    PIT_OP__SENTINEL
+} pit_opcode;
+#define PIT_OP(op, x) ((u32) (op) | ((u32) (x) << 8))
+#define PIT_OP_CODE(w) ((pit_opcode) ((w) & 0xff))
+#define PIT_OP_OPERAND(w) ((i64) ((w) >> 8))
+#define PIT_OP_OPERAND_MAX 0xffffff
+
+/* call sites record the source location of the call: line in the high 20 bits, column in the low 12.
+   zero means that the location is unknown */
+#define PIT_SITE(line, column) \
+    ((u32) ((line) > 0xfffff ? 0xfffff : (line)) << 12 | (u32) ((column) > 0xfff ? 0xfff : (column)))
+#define PIT_SITE_LINE(s) ((i64) ((s) >> 12))
+#define PIT_SITE_COLUMN(s) ((i64) ((s) & 0xfff))
+
+/* is f the native function that intrinsic op stands in for? */
+bool pit_vm_is_intrinsic(pit_runtime *rt, pit_value f, pit_intrinsic op);
+
+/* call the closure f (which must be a FUNC) with the list args */
+pit_value pit_vm_apply(pit_runtime *rt, pit_value f, pit_value args);
+/* the same, with the argc arguments given in argv; argv may point into the evaluation stack below its top */
+pit_value pit_vm_apply_argv(pit_runtime *rt, pit_value f, i64 argc, pit_value *argv);
+
+/* call the closure f with no arguments, taking a step of rt->fuel for each call it makes to a closure.
+   if the fuel runs out, sets *suspended and returns with the calls in progress left on the frame stack */
+pit_value pit_vm_start(pit_runtime *rt, pit_value f, bool *suspended);
+/* continue a call suspended by pit_vm_start, which was made with the frame and evaluation stacks at these lengths */
+pit_value pit_vm_resume(pit_runtime *rt, i64 frames_reset, i64 stack_reset, bool *suspended);
+
+/* perform (coroutine/resume! co [v]) with the argc arguments in argv, for calls that don't come from bytecode.
+   returns what the coroutine yields or returns */
+pit_value pit_vm_coroutine_resume(pit_runtime *rt, i64 argc, pit_value *argv);
+/* the running coroutines that were resumed at or above this depth of the frame stack are abandoned (after an error) */
+void pit_vm_coroutines_unwind(pit_runtime *rt, i64 frames);
+
+#endif
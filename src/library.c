@@ -27,7 +27,7 @@ static pit_value impl_sf_cond(pit_runtime *rt, pit_value args, void *data) {
         pit_value clause = pit_value_cons_car(rt, args);
         pit_value cond = pit_value_cons_car(rt, clause);
         if (pit_eval(rt, cond) != PIT_NIL) {
-            if (pit_vec_push(pit_value)(rt->expr_stack, pit_value_cons(rt, pit_symtab_intern_cstr(rt, "progn"), pit_value_cons_cdr(rt, clause))) < 0)
+            if (pit_vec_push(pit_value)(rt->expr_stack, pit_value_cons(rt, rt->symbols[PIT_SYMBOL_PROGN], pit_value_cons_cdr(rt, clause))) < 0)
                 pit_error(rt, "in special form \"cond\": evaluation stack overflow");
             return PIT_NIL;
         }
@@ -73,17 +73,17 @@ static pit_value impl_m_defun(pit_runtime *rt, pit_value args, void *data) {
     pit_value as = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
     pit_value body = pit_value_cons_cdr(rt, pit_value_cons_cdr(rt, args));
     return pit_value_list(rt, 3,
-        pit_symtab_intern_cstr(rt, "fset!"),
-        pit_value_list(rt, 2, pit_symtab_intern_cstr(rt, "quote"), nm),
-        pit_value_cons(rt, pit_symtab_intern_cstr(rt, "lambda"), pit_value_cons(rt, as, body))
+        rt->symbols[PIT_SYMBOL_FSET],
+        pit_value_list(rt, 2, rt->symbols[PIT_SYMBOL_QUOTE], nm),
+        pit_value_cons(rt, rt->symbols[PIT_SYMBOL_LAMBDA], pit_value_cons(rt, as, body))
     );
 }
 static pit_value impl_m_defmacro(pit_runtime *rt, pit_value args, void *data) {
     (void) data;
     pit_value nm = pit_value_cons_car(rt, args);
     return pit_value_list(rt, 3,
-        pit_symtab_intern_cstr(rt, "progn"),
-        pit_value_cons(rt, pit_symtab_intern_cstr(rt, "defun!"), args),
+        rt->symbols[PIT_SYMBOL_PROGN],
+        pit_value_cons(rt, rt->symbols[PIT_SYMBOL_DEFUN], args),
         pit_value_list(rt, 2, pit_symtab_intern_cstr(rt, "set-symbol-macro!"), nm)
     );
 }
@@ -121,9 +121,9 @@ static pit_value impl_m_defstruct(pit_runtime *rt, pit_value args, void *data) {
     }
     pit_libc_string_snprintf(buf, sizeof(buf), "%s/new", nm_str);
     df = pit_value_list(rt, 4,
-        pit_symtab_intern_cstr(rt, "defun!"),
+        rt->symbols[PIT_SYMBOL_DEFUN],
         pit_symtab_intern_cstr(rt, buf),
-        pit_value_list(rt, 2, pit_symtab_intern_cstr(rt, "&"), pit_symtab_intern_cstr(rt, "kwargs")),
+        pit_value_list(rt, 2, rt->symbols[PIT_SYMBOL_REST], pit_symtab_intern_cstr(rt, "kwargs")),
         pit_value_list_reverse(rt, aargs)
     );
     ret = pit_value_cons(rt, df, ret);
@@ -140,7 +140,7 @@ static pit_value impl_m_defstruct(pit_runtime *rt, pit_value args, void *data) {
         /* getter */
         pit_libc_string_snprintf(buf, sizeof(buf), "%s/get-%s", nm_str, field_str);
         df = pit_value_list(rt, 4,
-            pit_symtab_intern_cstr(rt, "defun!"),
+            rt->symbols[PIT_SYMBOL_DEFUN],
             pit_symtab_intern_cstr(rt, buf),
             pit_value_list(rt, 1, pit_symtab_intern_cstr(rt, "v")),
             pit_value_list(rt, 3,
@@ -153,7 +153,7 @@ static pit_value impl_m_defstruct(pit_runtime *rt, pit_value args, void *data) {
         /* setter */
         pit_libc_string_snprintf(buf, sizeof(buf), "%s/set-%s!", nm_str, field_str);
         df = pit_value_list(rt, 4,
-            pit_symtab_intern_cstr(rt, "defun!"),
+            rt->symbols[PIT_SYMBOL_DEFUN],
             pit_symtab_intern_cstr(rt, buf),
             pit_value_list(rt, 2, pit_symtab_intern_cstr(rt, "v"), pit_symtab_intern_cstr(rt, "x")),
             pit_value_list(rt, 4,
@@ -172,7 +172,7 @@ static pit_value impl_m_defstruct(pit_runtime *rt, pit_value args, void *data) {
     // (defun foo/get-x (f) ...)
     // (defun foo/set-x! (f v) ...)
     // pit_trace(rt, ret);
-    return pit_value_cons(rt, pit_symtab_intern_cstr(rt, "progn"), ret);
+    return pit_value_cons(rt, rt->symbols[PIT_SYMBOL_PROGN], ret);
 }
 static pit_value impl_m_let(pit_runtime *rt, pit_value args, void *data) {
     (void) data;
@@ -189,7 +189,7 @@ static pit_value impl_m_let(pit_runtime *rt, pit_value args, void *data) {
         largs = pit_value_cons(rt, expr, largs);
         binds = pit_value_cons_cdr(rt, binds);
     }
-    lambda = pit_value_cons(rt, pit_symtab_intern_cstr(rt, "lambda"), pit_value_cons(rt, lparams, bodyforms));
+    lambda = pit_value_cons(rt, rt->symbols[PIT_SYMBOL_LAMBDA], pit_value_cons(rt, lparams, bodyforms));
     application = pit_value_cons(rt, lambda, largs);
     return application;
 }
@@ -202,7 +202,7 @@ static pit_value impl_m_and(pit_runtime *rt, pit_value args, void *data) {
         args = pit_value_cons_cdr(rt, args);
     }
     while (args != PIT_NIL) {
-        ret = pit_value_list(rt, 3, pit_symtab_intern_cstr(rt, "if"), pit_value_cons_car(rt, args), ret, PIT_NIL);
+        ret = pit_value_list(rt, 3, rt->symbols[PIT_SYMBOL_IF], pit_value_cons_car(rt, args), ret, PIT_NIL);
         args = pit_value_cons_cdr(rt, args);
     }
     return ret;
@@ -212,8 +212,8 @@ static pit_value impl_m_setq(pit_runtime *rt, pit_value args, void *data) {
     pit_value sym = pit_value_cons_car(rt, args);
     pit_value v = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
     return pit_value_list(rt, 3,
-        pit_symtab_intern_cstr(rt, "set!"),
-        pit_value_list(rt, 2, pit_symtab_intern_cstr(rt, "quote"), sym),
+        rt->symbols[PIT_SYMBOL_SET],
+        pit_value_list(rt, 2, rt->symbols[PIT_SYMBOL_QUOTE], sym),
         v
     );
 }
@@ -232,7 +232,7 @@ static pit_value impl_m_case(pit_runtime *rt, pit_value args, void *data) {
             pit_value_list(rt, 2,
                 pit_value_list(rt, 3, pit_symtab_intern_cstr(rt, "equal?"),
                     xvar,
-                    pit_value_list(rt, 2, pit_symtab_intern_cstr(rt, "quote"), pit_value_cons_car(rt, c))
+                    pit_value_list(rt, 2, rt->symbols[PIT_SYMBOL_QUOTE], pit_value_cons_car(rt, c))
                 ),
                 pit_value_cons_car(rt, pit_value_cons_cdr(rt, c))
             ),
@@ -241,157 +241,223 @@ static pit_value impl_m_case(pit_runtime *rt, pit_value args, void *data) {
         cases = pit_value_cons_cdr(rt, cases);
     }
     return pit_value_list(rt, 3,
-        pit_symtab_intern_cstr(rt, "let"),
+        rt->symbols[PIT_SYMBOL_LET],
         pit_value_list(rt, 1, pit_value_list(rt, 2, xvar, x)),
-        pit_value_cons(rt, pit_symtab_intern_cstr(rt, "cond"), pit_value_list_reverse(rt, clauses))
+        pit_value_cons(rt, rt->symbols[PIT_SYMBOL_COND], pit_value_list_reverse(rt, clauses))
     );
 }
-static pit_value impl_set(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_set(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value sym = pit_value_cons_car(rt, args);
-    pit_value v = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
+    pit_value sym = PIT_ARG(argc, argv, 0);
+    pit_value v = PIT_ARG(argc, argv, 1);
     pit_symtab_set(rt, sym, v);
     return v;
 }
-static pit_value impl_fset(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_fset(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value sym = pit_value_cons_car(rt, args);
-    pit_value v = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
+    pit_value sym = PIT_ARG(argc, argv, 0);
+    pit_value v = PIT_ARG(argc, argv, 1);
     pit_symtab_fset(rt, sym, v);
     return v;
 }
-static pit_value impl_symbol_mark_macro(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_symbol_mark_macro(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value sym = pit_value_cons_car(rt, args);
+    pit_value sym = PIT_ARG(argc, argv, 0);
     pit_symtab_symbol_mark_macro(rt, sym);
     return PIT_NIL;
 }
-static pit_value impl_funcall(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_funcall(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value f = pit_value_cons_car(rt, args);
-    return pit_value_apply(rt, f, pit_value_cons_cdr(rt, args));
+    if (argc < 1) { pit_error(rt, "funcall requires a function"); return PIT_NIL; }
+    return pit_value_apply_argv(rt, argv[0], argc - 1, argv + 1);
 }
-static pit_value impl_apply(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_apply(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value f = pit_value_cons_car(rt, args);
-    pit_value xs = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
+    pit_value f = PIT_ARG(argc, argv, 0);
+    pit_value xs = PIT_ARG(argc, argv, 1);
     return pit_value_apply(rt, f, xs);
 }
-static pit_value impl_error(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_coroutine_p(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) data;
+    return pit_value_bool_new(rt, pit_value_is_coroutine(rt, PIT_ARG(argc, argv, 0)));
+}
+static pit_value impl_coroutine_new(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) data;
+    pit_value f = PIT_ARG(argc, argv, 0);
+    if (pit_value_is_symbol(rt, f)) f = pit_symtab_fget(rt, f);
+    return pit_value_coroutine_new(rt, f);
+}
+static pit_value impl_coroutine_resume(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) data;
+    /* calls from bytecode are performed by the VM; this is only reached from native code */
+    return pit_vm_coroutine_resume(rt, argc, argv);
+}
+static pit_value impl_yield(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) argc; (void) argv; (void) data;
+    /* likewise, yielding from native code would leave it on the C stack, which can't be saved */
+    pit_error(rt, "yield! must be called directly from Lisp code");
+    return PIT_NIL;
+}
+static pit_value impl_coroutine_status(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) data;
+    switch (pit_value_coroutine_state(rt, PIT_ARG(argc, argv, 0))) {
+    case PIT_COROUTINE_FRESH: return pit_symtab_intern_cstr(rt, ":fresh");
+    case PIT_COROUTINE_SUSPENDED: return pit_symtab_intern_cstr(rt, ":suspended");
+    case PIT_COROUTINE_RUNNING: return pit_symtab_intern_cstr(rt, ":running");
+    case PIT_COROUTINE_DEAD: return pit_symtab_intern_cstr(rt, ":dead");
+    }
+    return PIT_NIL;
+}
+static pit_value impl_error(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
     rt->error = PIT_T;
-    rt->error = pit_value_cons_car(rt, args);
+    rt->error = PIT_ARG(argc, argv, 0);
     rt->error_line = rt->source_line;
     rt->error_column = rt->source_column;
     return PIT_NIL;
 }
-static pit_value impl_eval(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_eval(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) data;
+    return pit_eval(rt, PIT_ARG(argc, argv, 0));
+}
+static pit_value impl_profile_start(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) argc; (void) argv; (void) data;
+    pit_profile_start(rt);
+    return PIT_T;
+}
+static pit_value impl_profile_stop(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) argc; (void) argv; (void) data;
+    pit_profile_stop(rt);
+    return PIT_T;
+}
+static pit_value impl_profile_report(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    return pit_eval(rt, pit_value_cons_car(rt, args));
+    pit_value sort = PIT_ARG(argc, argv, 0);
+    pit_value sites = PIT_ARG(argc, argv, 1);
+    return pit_profile_report(rt, sort, sites != PIT_NIL);
 }
-static pit_value impl_eq_p(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_gc_budget(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value x = pit_value_cons_car(rt, args);
-    pit_value y = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
+    i64 old = rt->gc_budget;
+    i64 budget = pit_value_as_integer(rt, PIT_ARG(argc, argv, 0));
+    if (budget < 0) { pit_error(rt, "garbage collection budget must not be negative"); return PIT_NIL; }
+    rt->gc_budget = budget;
+    return pit_value_integer_new(rt, old);
+}
+static pit_value impl_gc_collecting_p(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) argc; (void) argv; (void) data;
+    return pit_value_bool_new(rt, rt->gc_phase != PIT_GC_IDLE);
+}
+static pit_value impl_gc_collect(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) argc; (void) argv; (void) data;
+    if (rt->gc_inhibit > 0) return PIT_NIL; /* e.g. under a special form that's holding on to values */
+    pit_gc(rt);
+    return PIT_T;
+}
+static pit_value impl_eq_p(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) data;
+    pit_value x = PIT_ARG(argc, argv, 0);
+    pit_value y = PIT_ARG(argc, argv, 1);
     return pit_value_bool_new(rt, pit_value_eq(x, y));
 }
-static pit_value impl_equal_p(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_equal_p(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value x = pit_value_cons_car(rt, args);
-    pit_value y = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
+    pit_value x = PIT_ARG(argc, argv, 0);
+    pit_value y = PIT_ARG(argc, argv, 1);
     return pit_value_bool_new(rt, pit_value_equal(rt, x, y));
 }
-static pit_value impl_integer_p(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_integer_p(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    return pit_value_bool_new(rt, pit_value_is_integer(rt, pit_value_cons_car(rt, args)));
+    return pit_value_bool_new(rt, pit_value_is_integer(rt, PIT_ARG(argc, argv, 0)));
 }
-static pit_value impl_double_p(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_double_p(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    return pit_value_bool_new(rt, pit_value_is_double(rt, pit_value_cons_car(rt, args)));
+    return pit_value_bool_new(rt, pit_value_is_double(rt, PIT_ARG(argc, argv, 0)));
 }
-static pit_value impl_symbol_p(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_symbol_p(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    return pit_value_bool_new(rt, pit_value_is_symbol(rt, pit_value_cons_car(rt, args)));
+    return pit_value_bool_new(rt, pit_value_is_symbol(rt, PIT_ARG(argc, argv, 0)));
 }
-static pit_value impl_cons_p(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_cons_p(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    return pit_value_bool_new(rt, pit_value_is_cons(rt, pit_value_cons_car(rt, args)));
+    return pit_value_bool_new(rt, pit_value_is_cons(rt, PIT_ARG(argc, argv, 0)));
 }
-static pit_value impl_array_p(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_array_p(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    return pit_value_bool_new(rt, pit_value_is_array(rt, pit_value_cons_car(rt, args)));
+    return pit_value_bool_new(rt, pit_value_is_array(rt, PIT_ARG(argc, argv, 0)));
 }
-static pit_value impl_bytes_p(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_bytes_p(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    return pit_value_bool_new(rt, pit_value_is_bytes(rt, pit_value_cons_car(rt, args)));
+    return pit_value_bool_new(rt, pit_value_is_bytes(rt, PIT_ARG(argc, argv, 0)));
 }
-static pit_value impl_function_p(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_function_p(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value a = pit_value_cons_car(rt, args);
+    pit_value a = PIT_ARG(argc, argv, 0);
     bool b = (pit_value_is_symbol(rt, a) && pit_symtab_fget(rt, a) != PIT_NIL)
         || pit_value_is_func(rt, a)
         || pit_value_is_nativefunc(rt, a);
     return pit_value_bool_new(rt, b);
 }
-static pit_value impl_cons(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_cons(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    return pit_value_cons(rt, pit_value_cons_car(rt, args), pit_value_cons_car(rt, pit_value_cons_cdr(rt, args)));
+    return pit_value_cons(rt, PIT_ARG(argc, argv, 0), PIT_ARG(argc, argv, 1));
 }
-static pit_value impl_car(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_car(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    return pit_value_cons_car(rt, pit_value_cons_car(rt, args));
+    return pit_value_cons_car(rt, PIT_ARG(argc, argv, 0));
 }
-static pit_value impl_cdr(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_cdr(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    return pit_value_cons_cdr(rt, pit_value_cons_car(rt, args));
+    return pit_value_cons_cdr(rt, PIT_ARG(argc, argv, 0));
 }
-static pit_value impl_setcar(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_setcar(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value v = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
-    pit_value_cons_setcar(rt, pit_value_cons_car(rt, args), v);
+    pit_value v = PIT_ARG(argc, argv, 1);
+    pit_value_cons_setcar(rt, PIT_ARG(argc, argv, 0), v);
     return v;
 }
-static pit_value impl_setcdr(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_setcdr(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value v = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
-    pit_value_cons_setcdr(rt, pit_value_cons_car(rt, args), v);
+    pit_value v = PIT_ARG(argc, argv, 1);
+    pit_value_cons_setcdr(rt, PIT_ARG(argc, argv, 0), v);
     return v;
 }
-static pit_value impl_list(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_list(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    (void) rt;
-    return args;
+    pit_value ret = PIT_NIL;
+    for (i64 i = argc - 1; i >= 0; --i) ret = pit_value_cons(rt, argv[i], ret);
+    return ret;
 }
-static pit_value impl_list_nth(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_list_nth(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    i64 n = pit_value_as_integer(rt, pit_value_cons_car(rt, args));
-    pit_value xs = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
+    i64 n = pit_value_as_integer(rt, PIT_ARG(argc, argv, 0));
+    pit_value xs = PIT_ARG(argc, argv, 1);
     while (xs != PIT_NIL && n-- > 0) {
         xs = pit_value_cons_cdr(rt, xs);
     }
     return pit_value_cons_car(rt, xs);
 }
-static pit_value impl_list_iota(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_list_iota(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    i64 n = pit_value_as_integer(rt, pit_value_cons_car(rt, args));
+    i64 n = pit_value_as_integer(rt, PIT_ARG(argc, argv, 0));
     pit_value ret = PIT_NIL;
     while (n > 0) {
         ret = pit_value_cons(rt, pit_value_integer_new(rt, --n), ret);
     }
     return ret;
 }
-static pit_value impl_list_len(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_list_len(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value arr = pit_value_cons_car(rt, args);
+    pit_value arr = PIT_ARG(argc, argv, 0);
     return pit_value_integer_new(rt, pit_value_list_len(rt, arr));
 }
-static pit_value impl_list_reverse(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_list_reverse(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    return pit_value_list_reverse(rt, pit_value_cons_car(rt, args));
+    return pit_value_list_reverse(rt, PIT_ARG(argc, argv, 0));
 }
-static pit_value impl_list_uniq(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_list_uniq(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value xs = pit_value_cons_car(rt, args);
+    pit_value xs = PIT_ARG(argc, argv, 0);
     pit_value ret = PIT_NIL;
     while (xs != PIT_NIL) {
         pit_value x = pit_value_cons_car(rt, xs);
@@ -402,29 +468,41 @@ static pit_value impl_list_uniq(pit_runtime *rt, pit_value args, void *data) {
     }
     return pit_value_list_reverse(rt, ret);
 }
-static pit_value impl_list_append(pit_runtime *rt, pit_value args, void *data) {
-    (void) data;
-    args = pit_value_list_reverse(rt, args);
-    pit_value ret = pit_value_cons_car(rt, args);
-    pit_value ls = pit_value_cons_cdr(rt, args);
-    while (ls != PIT_NIL) {
-        pit_value xs = pit_value_list_reverse(rt, pit_value_cons_car(rt, ls));
+/* append the lists in lists, sharing the last */
+static pit_value list_append(pit_runtime *rt, i64 len, pit_value *lists) {
+    pit_value ret = len > 0 ? lists[len - 1] : PIT_NIL;
+    for (i64 i = len - 2; i >= 0; --i) {
+        pit_value xs = pit_value_list_reverse(rt, lists[i]);
         while (xs != PIT_NIL) {
             ret = pit_value_cons(rt, pit_value_cons_car(rt, xs), ret);
             xs = pit_value_cons_cdr(rt, xs);
         }
-        ls = pit_value_cons_cdr(rt, ls);
     }
     return ret;
 }
-static pit_value impl_list_concat(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_list_append(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    return impl_list_append(rt, pit_value_cons_car(rt, args), NULL);
+    return list_append(rt, argc, argv);
 }
-static pit_value impl_list_take(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_list_concat(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    i64 num = pit_value_as_integer(rt, pit_value_cons_car(rt, args));
-    pit_value arr = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
+    pit_value ls = pit_value_list_reverse(rt, PIT_ARG(argc, argv, 0));
+    pit_value ret = PIT_NIL;
+    if (ls != PIT_NIL) {
+        ret = pit_value_cons_car(rt, ls);
+        ls = pit_value_cons_cdr(rt, ls);
+    }
+    while (ls != PIT_NIL) {
+        pit_value xs = pit_value_cons_car(rt, ls);
+        ret = list_append(rt, 2, (pit_value[]) { xs, ret });
+        ls = pit_value_cons_cdr(rt, ls);
+    }
+    return ret;
+}
+static pit_value impl_list_take(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) data;
+    i64 num = pit_value_as_integer(rt, PIT_ARG(argc, argv, 0));
+    pit_value arr = PIT_ARG(argc, argv, 1);
     pit_value ret = PIT_NIL;
     while (num > 0 && arr != PIT_NIL) {
         ret = pit_value_cons(rt, pit_value_cons_car(rt, arr), ret);
@@ -433,107 +511,153 @@ static pit_value impl_list_take(pit_runtime *rt, pit_value args, void *data) {
     }
     return pit_value_list_reverse(rt, ret);
 }
-static pit_value impl_list_drop(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_list_drop(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    i64 num = pit_value_as_integer(rt, pit_value_cons_car(rt, args));
-    pit_value arr = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
+    i64 num = pit_value_as_integer(rt, PIT_ARG(argc, argv, 0));
+    pit_value arr = PIT_ARG(argc, argv, 1);
     while (num > 0 && arr != PIT_NIL) {
         arr = pit_value_cons_cdr(rt, arr);
         num -= 1;
     }
     return arr;
 }
-static pit_value impl_list_map(pit_runtime *rt, pit_value args, void *data) {
-    (void) data;
-    pit_value func = pit_value_cons_car(rt, args);
-    pit_value xs = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
-    pit_value ret = PIT_NIL;
-    while (xs != PIT_NIL) {
-        pit_value y = pit_value_apply(rt, func, pit_value_cons(rt, pit_value_cons_car(rt, xs), PIT_NIL));
-        ret = pit_value_cons(rt, y, ret);
-        xs = pit_value_cons_cdr(rt, xs);
+/* the functions that call back into Lisp keep what they need afterwards in handles (see pit_handle_new) */
+static pit_value impl_list_map(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) data;
+    i64 handles_reset = rt->handles->next;
+    pit_value *func = pit_handle_new(rt, PIT_ARG(argc, argv, 0));
+    pit_value *xs = pit_handle_new(rt, PIT_ARG(argc, argv, 1));
+    pit_value *ret = pit_handle_new(rt, PIT_NIL);
+    pit_value res = PIT_NIL;
+    if (rt->error != PIT_NIL) goto end;
+    while (*xs != PIT_NIL && rt->error == PIT_NIL) {
+        pit_value x = pit_value_cons_car(rt, *xs);
+        pit_value y = pit_value_apply_argv(rt, *func, 1, &x);
+        *ret = pit_value_cons(rt, y, *ret);
+        *xs = pit_value_cons_cdr(rt, *xs);
     }
-    return pit_value_list_reverse(rt, ret);
-}
-static pit_value impl_list_foldl(pit_runtime *rt, pit_value args, void *data) {
-    (void) data;
-    pit_value func = pit_value_cons_car(rt, args);
-    pit_value acc = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
-    pit_value xs = pit_value_cons_car(rt, pit_value_cons_cdr(rt, pit_value_cons_cdr(rt, args)));
-    while (xs != PIT_NIL) {
-        acc = pit_value_apply(rt, func, pit_value_list(rt, 2, pit_value_cons_car(rt, xs), acc));
-        xs = pit_value_cons_cdr(rt, xs);
+    res = pit_value_list_reverse(rt, *ret);
+end:
+    rt->handles->next = handles_reset;
+    return res;
+}
+static pit_value impl_list_foldl(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) data;
+    i64 handles_reset = rt->handles->next;
+    pit_value *func = pit_handle_new(rt, PIT_ARG(argc, argv, 0));
+    pit_value *acc = pit_handle_new(rt, PIT_ARG(argc, argv, 1));
+    pit_value *xs = pit_handle_new(rt, PIT_ARG(argc, argv, 2));
+    pit_value res = PIT_NIL;
+    if (rt->error != PIT_NIL) goto end;
+    while (*xs != PIT_NIL && rt->error == PIT_NIL) {
+        pit_value fargs[2];
+        fargs[0] = pit_value_cons_car(rt, *xs);
+        fargs[1] = *acc;
+        *acc = pit_value_apply_argv(rt, *func, 2, fargs);
+        *xs = pit_value_cons_cdr(rt, *xs);
     }
-    return acc;
-}
-static pit_value impl_list_filter(pit_runtime *rt, pit_value args, void *data) {
-    (void) data;
-    pit_value func = pit_value_cons_car(rt, args);
-    pit_value xs = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
-    pit_value ret = PIT_NIL;
-    while (xs != PIT_NIL) {
-        pit_value x = pit_value_cons_car(rt, xs);
-        pit_value y = pit_value_apply(rt, func, pit_value_cons(rt, x, PIT_NIL));
+    res = *acc;
+end:
+    rt->handles->next = handles_reset;
+    return res;
+}
+static pit_value impl_list_filter(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) data;
+    i64 handles_reset = rt->handles->next;
+    pit_value *func = pit_handle_new(rt, PIT_ARG(argc, argv, 0));
+    pit_value *xs = pit_handle_new(rt, PIT_ARG(argc, argv, 1));
+    pit_value *ret = pit_handle_new(rt, PIT_NIL);
+    pit_value res = PIT_NIL;
+    if (rt->error != PIT_NIL) goto end;
+    while (*xs != PIT_NIL && rt->error == PIT_NIL) {
+        pit_value x = pit_value_cons_car(rt, *xs);
+        pit_value y = pit_value_apply_argv(rt, *func, 1, &x);
         if (y != PIT_NIL) {
-            ret = pit_value_cons(rt, x, ret);
+            *ret = pit_value_cons(rt, pit_value_cons_car(rt, *xs), *ret);
         }
-        xs = pit_value_cons_cdr(rt, xs);
+        *xs = pit_value_cons_cdr(rt, *xs);
     }
-    return pit_value_list_reverse(rt, ret);
-}
-static pit_value impl_list_find(pit_runtime *rt, pit_value args, void *data) {
-    (void) data;
-    pit_value func = pit_value_cons_car(rt, args);
-    pit_value xs = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
-    while (xs != PIT_NIL) {
-        pit_value x = pit_value_cons_car(rt, xs);
-        pit_value y = pit_value_apply(rt, func, pit_value_cons(rt, x, PIT_NIL));
+    res = pit_value_list_reverse(rt, *ret);
+end:
+    rt->handles->next = handles_reset;
+    return res;
+}
+static pit_value impl_list_find(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) data;
+    i64 handles_reset = rt->handles->next;
+    pit_value *func = pit_handle_new(rt, PIT_ARG(argc, argv, 0));
+    pit_value *xs = pit_handle_new(rt, PIT_ARG(argc, argv, 1));
+    pit_value res = PIT_NIL;
+    if (rt->error != PIT_NIL) goto end;
+    while (*xs != PIT_NIL && rt->error == PIT_NIL) {
+        pit_value x = pit_value_cons_car(rt, *xs);
+        pit_value y = pit_value_apply_argv(rt, *func, 1, &x);
         if (y != PIT_NIL) {
-            return x;
+            res = pit_value_cons_car(rt, *xs);
+            break;
         }
-        xs = pit_value_cons_cdr(rt, xs);
+        *xs = pit_value_cons_cdr(rt, *xs);
     }
-    return PIT_NIL;
+end:
+    rt->handles->next = handles_reset;
+    return res;
 }
-static pit_value impl_list_contains_p(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_list_contains_p(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value needle = pit_value_cons_car(rt, args);
-    pit_value haystack = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
+    pit_value needle = PIT_ARG(argc, argv, 0);
+    pit_value haystack = PIT_ARG(argc, argv, 1);
     while (haystack != PIT_NIL) {
         if (pit_value_equal(rt, needle, pit_value_cons_car(rt, haystack))) return PIT_T;
         haystack = pit_value_cons_cdr(rt, haystack);
     }
     return PIT_NIL;
 }
-static pit_value impl_list_all_p(pit_runtime *rt, pit_value args, void *data) {
-    (void) data;
-    pit_value f = pit_value_cons_car(rt, args);
-    pit_value xs = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
-    while (xs != PIT_NIL) {
-        pit_value x = pit_value_cons_car(rt, xs);
-        if (pit_value_apply(rt, f, pit_value_cons(rt, x, PIT_NIL)) == PIT_NIL) {
-            return PIT_NIL;
+static pit_value impl_list_all_p(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) data;
+    i64 handles_reset = rt->handles->next;
+    pit_value *f = pit_handle_new(rt, PIT_ARG(argc, argv, 0));
+    pit_value *xs = pit_handle_new(rt, PIT_ARG(argc, argv, 1));
+    pit_value res = PIT_NIL;
+    if (rt->error != PIT_NIL) goto end;
+    res = PIT_T;
+    while (*xs != PIT_NIL && rt->error == PIT_NIL) {
+        pit_value x = pit_value_cons_car(rt, *xs);
+        if (pit_value_apply_argv(rt, *f, 1, &x) == PIT_NIL) {
+            res = PIT_NIL;
+            break;
         }
-        xs = pit_value_cons_cdr(rt, xs);
+        *xs = pit_value_cons_cdr(rt, *xs);
     }
-    return PIT_T;
-}
-static pit_value impl_list_zip_with(pit_runtime *rt, pit_value args, void *data) {
-    (void) data;
-    pit_value f = pit_value_cons_car(rt, args);
-    pit_value xs = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
-    pit_value ys = pit_value_cons_car(rt, pit_value_cons_cdr(rt, pit_value_cons_cdr(rt, args)));
-    pit_value ret = PIT_NIL;
-    while (xs != PIT_NIL && ys != PIT_NIL) {
-        pit_value z = pit_value_apply(rt, f, pit_value_list(rt, 2, pit_value_cons_car(rt, xs), pit_value_cons_car(rt, ys)));
-        ret = pit_value_cons(rt, z, ret);
-        xs = pit_value_cons_cdr(rt, xs); ys = pit_value_cons_cdr(rt, ys);
+end:
+    rt->handles->next = handles_reset;
+    return res;
+}
+static pit_value impl_list_zip_with(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) data;
+    i64 handles_reset = rt->handles->next;
+    pit_value *f = pit_handle_new(rt, PIT_ARG(argc, argv, 0));
+    pit_value *xs = pit_handle_new(rt, PIT_ARG(argc, argv, 1));
+    pit_value *ys = pit_handle_new(rt, PIT_ARG(argc, argv, 2));
+    pit_value *ret = pit_handle_new(rt, PIT_NIL);
+    pit_value res = PIT_NIL;
+    if (rt->error != PIT_NIL) goto end;
+    while (*xs != PIT_NIL && *ys != PIT_NIL && rt->error == PIT_NIL) {
+        pit_value fargs[2];
+        pit_value z;
+        fargs[0] = pit_value_cons_car(rt, *xs);
+        fargs[1] = pit_value_cons_car(rt, *ys);
+        z = pit_value_apply_argv(rt, *f, 2, fargs);
+        *ret = pit_value_cons(rt, z, *ret);
+        *xs = pit_value_cons_cdr(rt, *xs); *ys = pit_value_cons_cdr(rt, *ys);
     }
-    return pit_value_list_reverse(rt, ret);
+    res = pit_value_list_reverse(rt, *ret);
+end:
+    rt->handles->next = handles_reset;
+    return res;
 }
-static pit_value impl_bytes_len(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_bytes_len(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value v = pit_value_cons_car(rt, args);
+    pit_value v = PIT_ARG(argc, argv, 0);
     if (pit_value_sort(v) != PIT_VALUE_SORT_REF) {
         pit_error(rt, "value is not a ref");
         return PIT_NIL;
@@ -543,11 +667,11 @@ static pit_value impl_bytes_len(pit_runtime *rt, pit_value args, void *data) {
     if (h->hsort != PIT_VALUE_HEAVY_SORT_BYTES) { pit_error(rt, "ref is not bytes"); return PIT_NIL; }
     return pit_value_integer_new(rt, h->in.bytes.len);
 }
-static pit_value impl_bytes_range(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_bytes_range(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    i64 start = pit_value_as_integer(rt, pit_value_cons_car(rt, args));
-    i64 end = pit_value_as_integer(rt, pit_value_cons_car(rt, pit_value_cons_cdr(rt, args)));
-    pit_value v = pit_value_cons_car(rt, pit_value_cons_cdr(rt, pit_value_cons_cdr(rt, args)));
+    i64 start = pit_value_as_integer(rt, PIT_ARG(argc, argv, 0));
+    i64 end = pit_value_as_integer(rt, PIT_ARG(argc, argv, 1));
+    pit_value v = PIT_ARG(argc, argv, 2);
     if (pit_value_sort(v) != PIT_VALUE_SORT_REF) {
         pit_error(rt, "value is not a ref");
         return PIT_NIL;
@@ -565,20 +689,15 @@ static pit_value impl_bytes_range(pit_runtime *rt, pit_value args, void *data) {
     }
     return pit_value_bytes_new(rt, h->in.bytes.data + start, end - start);
 }
-static pit_value impl_array(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_array(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    i64 len = pit_value_list_len(rt, args);
-    pit_value ret = pit_value_array_new(rt, len);
-    i64 idx = 0;
-    while (args != PIT_NIL) {
-        pit_value_array_set(rt, ret, idx++, pit_value_cons_car(rt, args));
-        args = pit_value_cons_cdr(rt, args);
-    }
+    pit_value ret = pit_value_array_new(rt, argc);
+    for (i64 i = 0; i < argc; ++i) pit_value_array_set(rt, ret, i, argv[i]);
     return ret;
 }
-static pit_value impl_array_to_list(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_array_to_list(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value arr = pit_value_cons_car(rt, args);
+    pit_value arr = PIT_ARG(argc, argv, 0);
     i64 ilen = pit_value_array_len(rt, arr);
     pit_value ret = PIT_NIL;
     i64 i = 0;
@@ -587,10 +706,10 @@ static pit_value impl_array_to_list(pit_runtime *rt, pit_value args, void *data)
     }
     return pit_value_list_reverse(rt, ret);
 }
-static pit_value impl_array_from_list(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_array_from_list(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
     i64 i = 0;
-    pit_value xs = pit_value_cons_car(rt, args);
+    pit_value xs = PIT_ARG(argc, argv, 0);
     i64 ilen = pit_value_list_len(rt, xs);
     pit_value ret = pit_value_array_new(rt, ilen);
     pit_value_heavy *h = pit_value_ref_deref(rt, pit_value_as_ref(rt, ret));
@@ -602,11 +721,11 @@ static pit_value impl_array_from_list(pit_runtime *rt, pit_value args, void *dat
     }
     return ret;
 }
-static pit_value impl_array_repeat(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_array_repeat(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
     i64 i = 0;
-    pit_value v = pit_value_cons_car(rt, args);
-    pit_value len = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
+    pit_value v = PIT_ARG(argc, argv, 0);
+    pit_value len = PIT_ARG(argc, argv, 1);
     i64 ilen = pit_value_as_integer(rt, len);
     pit_value ret = pit_value_array_new(rt, ilen);
     pit_value_heavy *h = pit_value_ref_deref(rt, pit_value_as_ref(rt, ret));
@@ -616,171 +735,171 @@ static pit_value impl_array_repeat(pit_runtime *rt, pit_value args, void *data)
     }
     return ret;
 }
-static pit_value impl_array_len(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_array_len(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value arr = pit_value_cons_car(rt, args);
+    pit_value arr = PIT_ARG(argc, argv, 0);
     return pit_value_integer_new(rt, pit_value_array_len(rt, arr));
 }
-static pit_value impl_array_get(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_array_get(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value idx = pit_value_cons_car(rt, args);
-    pit_value arr = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
+    pit_value idx = PIT_ARG(argc, argv, 0);
+    pit_value arr = PIT_ARG(argc, argv, 1);
     return pit_value_array_get(rt, arr, pit_value_as_integer(rt, idx));
 }
-static pit_value impl_array_set(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_array_set(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value idx = pit_value_cons_car(rt, args);
-    pit_value v = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
-    pit_value arr = pit_value_cons_car(rt, pit_value_cons_cdr(rt, pit_value_cons_cdr(rt, args)));
+    pit_value idx = PIT_ARG(argc, argv, 0);
+    pit_value v = PIT_ARG(argc, argv, 1);
+    pit_value arr = PIT_ARG(argc, argv, 2);
     return pit_value_array_set(rt, arr, pit_value_as_integer(rt, idx), v);
 }
-static pit_value impl_array_map(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_array_map(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value func = pit_value_cons_car(rt, args);
-    pit_value arr = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
-    i64 len = pit_value_array_len(rt, arr);
-    pit_value ret = pit_value_array_new(rt, len);
+    i64 handles_reset = rt->handles->next;
+    pit_value *func = pit_handle_new(rt, PIT_ARG(argc, argv, 0));
+    pit_value *arr = pit_handle_new(rt, PIT_ARG(argc, argv, 1));
+    pit_value *ret = pit_handle_new(rt, PIT_NIL);
+    pit_value res = PIT_NIL;
+    i64 len = 0;
     i64 i = 0;
-    for (i = 0; i < len; ++i) {
-        pit_value y = pit_value_apply(rt, func, pit_value_cons(rt, pit_value_array_get(rt, arr, i), PIT_NIL));
-        pit_value_array_set(rt, ret, i, y);
+    if (rt->error != PIT_NIL) goto end;
+    len = pit_value_array_len(rt, *arr);
+    *ret = pit_value_array_new(rt, len);
+    for (i = 0; i < len && rt->error == PIT_NIL; ++i) {
+        pit_value x = pit_value_array_get(rt, *arr, i);
+        pit_value y = pit_value_apply_argv(rt, *func, 1, &x);
+        pit_value_array_set(rt, *ret, i, y);
     }
-    return ret;
-}
-static pit_value impl_array_map_mut(pit_runtime *rt, pit_value args, void *data) {
-    (void) data;
-    pit_value func = pit_value_cons_car(rt, args);
-    pit_value arr = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
-    i64 len = pit_value_array_len(rt, arr);
+    res = *ret;
+end:
+    rt->handles->next = handles_reset;
+    return res;
+}
+static pit_value impl_array_map_mut(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) data;
+    i64 handles_reset = rt->handles->next;
+    pit_value *func = pit_handle_new(rt, PIT_ARG(argc, argv, 0));
+    pit_value *arr = pit_handle_new(rt, PIT_ARG(argc, argv, 1));
+    pit_value res = PIT_NIL;
+    i64 len = 0;
     i64 i = 0;
-    for (i = 0; i < len; ++i) {
-        pit_value y = pit_value_apply(rt, func, pit_value_cons(rt, pit_value_array_get(rt, arr, i), PIT_NIL));
-        pit_value_array_set(rt, arr, i, y);
+    if (rt->error != PIT_NIL) goto end;
+    len = pit_value_array_len(rt, *arr);
+    for (i = 0; i < len && rt->error == PIT_NIL; ++i) {
+        pit_value x = pit_value_array_get(rt, *arr, i);
+        pit_value y = pit_value_apply_argv(rt, *func, 1, &x);
+        pit_value_array_set(rt, *arr, i, y);
     }
-    return arr;
+    res = *arr;
+end:
+    rt->handles->next = handles_reset;
+    return res;
 }
-static pit_value impl_abs(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_abs(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    i64 x = pit_value_as_integer(rt, pit_value_cons_car(rt, args));
+    i64 x = pit_value_as_integer(rt, PIT_ARG(argc, argv, 0));
     if (x < 0) return pit_value_integer_new(rt, -x);
     return pit_value_integer_new(rt, x);
 }
-static pit_value impl_add(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_add(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
     i64 total = 0;
-    while (args != PIT_NIL) {
-        total += pit_value_as_integer(rt, pit_value_cons_car(rt, args));
-        args = pit_value_cons_cdr(rt, args);
-    }
+    for (i64 i = 0; i < argc; ++i) total += pit_value_as_integer(rt, argv[i]);
     return pit_value_integer_new(rt, total);
 }
-static pit_value impl_sub(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_sub(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
     i64 total = 0;
-    while (args != PIT_NIL) {
-        total -= pit_value_as_integer(rt, pit_value_cons_car(rt, args));
-        args = pit_value_cons_cdr(rt, args);
-    }
+    if (argc == 1) return pit_value_integer_new(rt, -pit_value_as_integer(rt, argv[0]));
+    if (argc > 1) total = pit_value_as_integer(rt, argv[0]);
+    for (i64 i = 1; i < argc; ++i) total -= pit_value_as_integer(rt, argv[i]);
     return pit_value_integer_new(rt, total);
 }
-static pit_value impl_mul(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_mul(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
     i64 total = 1;
-    while (args != PIT_NIL) {
-        total *= pit_value_as_integer(rt, pit_value_cons_car(rt, args));
-        args = pit_value_cons_cdr(rt, args);
-    }
+    for (i64 i = 0; i < argc; ++i) total *= pit_value_as_integer(rt, argv[i]);
     return pit_value_integer_new(rt, total);
 }
-static pit_value impl_div(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_div(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    i64 total = pit_value_as_integer(rt, pit_value_cons_car(rt, args));
-    args = pit_value_cons_cdr(rt, args);
-    while (args != PIT_NIL) {
-        i64 denom = pit_value_as_integer(rt, pit_value_cons_car(rt, args));
+    i64 total = pit_value_as_integer(rt, PIT_ARG(argc, argv, 0));
+    for (i64 i = 1; i < argc; ++i) {
+        i64 denom = pit_value_as_integer(rt, argv[i]);
         if (denom == 0) {
             pit_error(rt, "divide by zero");
             return PIT_NIL;
         }
         total /= denom;
-        args = pit_value_cons_cdr(rt, args);
     }
     return pit_value_integer_new(rt, total);
 }
-static pit_value impl_not(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_not(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
+    (void) rt;
     (void) data;
-    if (pit_value_cons_car(rt, args) == PIT_NIL) {
+    if (PIT_ARG(argc, argv, 0) == PIT_NIL) {
         return PIT_T;
     } else {
         return PIT_NIL;
     }
 }
-static pit_value impl_lt(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_lt(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    i64 x = pit_value_as_integer(rt, pit_value_cons_car(rt, args));
-    i64 y = pit_value_as_integer(rt, pit_value_cons_car(rt, pit_value_cons_cdr(rt, args)));
+    i64 x = pit_value_as_integer(rt, PIT_ARG(argc, argv, 0));
+    i64 y = pit_value_as_integer(rt, PIT_ARG(argc, argv, 1));
     return pit_value_bool_new(rt, x < y);
 }
-static pit_value impl_gt(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_gt(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    i64 x = pit_value_as_integer(rt, pit_value_cons_car(rt, args));
-    i64 y = pit_value_as_integer(rt, pit_value_cons_car(rt, pit_value_cons_cdr(rt, args)));
+    i64 x = pit_value_as_integer(rt, PIT_ARG(argc, argv, 0));
+    i64 y = pit_value_as_integer(rt, PIT_ARG(argc, argv, 1));
     return pit_value_bool_new(rt, x > y);
 }
-static pit_value impl_le(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_le(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    i64 x = pit_value_as_integer(rt, pit_value_cons_car(rt, args));
-    i64 y = pit_value_as_integer(rt, pit_value_cons_car(rt, pit_value_cons_cdr(rt, args)));
+    i64 x = pit_value_as_integer(rt, PIT_ARG(argc, argv, 0));
+    i64 y = pit_value_as_integer(rt, PIT_ARG(argc, argv, 1));
     return pit_value_bool_new(rt, x <= y);
 }
-static pit_value impl_ge(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_ge(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    i64 x = pit_value_as_integer(rt, pit_value_cons_car(rt, args));
-    i64 y = pit_value_as_integer(rt, pit_value_cons_car(rt, pit_value_cons_cdr(rt, args)));
+    i64 x = pit_value_as_integer(rt, PIT_ARG(argc, argv, 0));
+    i64 y = pit_value_as_integer(rt, PIT_ARG(argc, argv, 1));
     return pit_value_bool_new(rt, x >= y);
 }
-static pit_value impl_bitwise_and(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_bitwise_and(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
     i64 total = -1;
-    while (args != PIT_NIL) {
-        total &= pit_value_as_integer(rt, pit_value_cons_car(rt, args));
-        args = pit_value_cons_cdr(rt, args);
-    }
+    for (i64 i = 0; i < argc; ++i) total &= pit_value_as_integer(rt, argv[i]);
     return pit_value_integer_new(rt, total);
 }
-static pit_value impl_bitwise_or(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_bitwise_or(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
     i64 total = 0;
-    while (args != PIT_NIL) {
-        total |= pit_value_as_integer(rt, pit_value_cons_car(rt, args));
-        args = pit_value_cons_cdr(rt, args);
-    }
+    for (i64 i = 0; i < argc; ++i) total |= pit_value_as_integer(rt, argv[i]);
     return pit_value_integer_new(rt, total);
 }
-static pit_value impl_bitwise_xor(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_bitwise_xor(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
     i64 total = 0;
-    while (args != PIT_NIL) {
-        total ^= pit_value_as_integer(rt, pit_value_cons_car(rt, args));
-        args = pit_value_cons_cdr(rt, args);
-    }
+    for (i64 i = 0; i < argc; ++i) total ^= pit_value_as_integer(rt, argv[i]);
     return pit_value_integer_new(rt, total);
 }
-static pit_value impl_bitwise_not(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_bitwise_not(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    i64 x = pit_value_as_integer(rt, pit_value_cons_car(rt, args));
+    i64 x = pit_value_as_integer(rt, PIT_ARG(argc, argv, 0));
     return pit_value_integer_new(rt, ~x);
 }
-static pit_value impl_bitwise_lshift(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_bitwise_lshift(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    i64 val = pit_value_as_integer(rt, pit_value_cons_car(rt, args));
-    i64 shift = pit_value_as_integer(rt, pit_value_cons_car(rt, pit_value_cons_cdr(rt, args)));
+    i64 val = pit_value_as_integer(rt, PIT_ARG(argc, argv, 0));
+    i64 shift = pit_value_as_integer(rt, PIT_ARG(argc, argv, 1));
     return pit_value_integer_new(rt, val << shift);
 }
-static pit_value impl_bitwise_rshift(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_bitwise_rshift(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    i64 val = pit_value_as_integer(rt, pit_value_cons_car(rt, args));
-    i64 shift = pit_value_as_integer(rt, pit_value_cons_car(rt, pit_value_cons_cdr(rt, args)));
+    i64 val = pit_value_as_integer(rt, PIT_ARG(argc, argv, 0));
+    i64 shift = pit_value_as_integer(rt, PIT_ARG(argc, argv, 1));
     if (shift >= 64) val = 0;
     else val >>= shift;
     return pit_value_integer_new(rt, val);
@@ -802,99 +921,130 @@ void pit_install_library_essential(pit_runtime *rt) {
     pit_symtab_mset(rt, pit_symtab_intern_cstr(rt, "setq!"), pit_value_nativefunc_new(rt, impl_m_setq));
     pit_symtab_mset(rt, pit_symtab_intern_cstr(rt, "case"), pit_value_nativefunc_new(rt, impl_m_case));
     /* error */
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "error!"), pit_value_nativefunc_new(rt, impl_error));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "error!"), pit_value_nativefunc_argv_new(rt, impl_error));
     /* eval */
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "eval!"), pit_value_nativefunc_new(rt, impl_eval));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "eval!"), pit_value_nativefunc_argv_new(rt, impl_eval));
+    /* profiling */
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "profile/start!"), pit_value_nativefunc_argv_new(rt, impl_profile_start));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "profile/stop!"), pit_value_nativefunc_argv_new(rt, impl_profile_stop));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "profile/report"), pit_value_nativefunc_argv_new(rt, impl_profile_report));
+    /* garbage collection */
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "gc/budget!"), pit_value_nativefunc_argv_new(rt, impl_gc_budget));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "gc/collecting?"), pit_value_nativefunc_argv_new(rt, impl_gc_collecting_p));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "gc/collect!"), pit_value_nativefunc_argv_new(rt, impl_gc_collect));
     /* predicates */
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "eq?"), pit_value_nativefunc_new(rt, impl_eq_p));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "equal?"), pit_value_nativefunc_new(rt, impl_equal_p));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "integer?"), pit_value_nativefunc_new(rt, impl_integer_p));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "double?"), pit_value_nativefunc_new(rt, impl_double_p));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "symbol?"), pit_value_nativefunc_new(rt, impl_symbol_p));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "cons?"), pit_value_nativefunc_new(rt, impl_cons_p));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array?"), pit_value_nativefunc_new(rt, impl_array_p));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bytes?"), pit_value_nativefunc_new(rt, impl_bytes_p));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "function?"), pit_value_nativefunc_new(rt, impl_function_p));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "eq?"), pit_value_nativefunc_argv_new(rt, impl_eq_p));
+    rt->intrinsics[PIT_INTRINSIC_EQ] = impl_eq_p;
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "equal?"), pit_value_nativefunc_argv_new(rt, impl_equal_p));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "integer?"), pit_value_nativefunc_argv_new(rt, impl_integer_p));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "double?"), pit_value_nativefunc_argv_new(rt, impl_double_p));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "symbol?"), pit_value_nativefunc_argv_new(rt, impl_symbol_p));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "cons?"), pit_value_nativefunc_argv_new(rt, impl_cons_p));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array?"), pit_value_nativefunc_argv_new(rt, impl_array_p));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bytes?"), pit_value_nativefunc_argv_new(rt, impl_bytes_p));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "function?"), pit_value_nativefunc_argv_new(rt, impl_function_p));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "coroutine?"), pit_value_nativefunc_argv_new(rt, impl_coroutine_p));
     /* symbols */
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "set!"), pit_value_nativefunc_new(rt, impl_set));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "fset!"), pit_value_nativefunc_new(rt, impl_fset));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "symbol-is-macro!"), pit_value_nativefunc_new(rt, impl_symbol_mark_macro));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "funcall"), pit_value_nativefunc_new(rt, impl_funcall));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "apply"), pit_value_nativefunc_new(rt, impl_apply));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "set!"), pit_value_nativefunc_argv_new(rt, impl_set));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "fset!"), pit_value_nativefunc_argv_new(rt, impl_fset));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "symbol-is-macro!"), pit_value_nativefunc_argv_new(rt, impl_symbol_mark_macro));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "funcall"), pit_value_nativefunc_argv_new(rt, impl_funcall));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "apply"), pit_value_nativefunc_argv_new(rt, impl_apply));
+    rt->controls[PIT_CONTROL_FUNCALL] = impl_funcall;
+    rt->controls[PIT_CONTROL_APPLY] = impl_apply;
+    /* coroutines */
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "coroutine/new"), pit_value_nativefunc_argv_new(rt, impl_coroutine_new));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "coroutine/resume!"), pit_value_nativefunc_argv_new(rt, impl_coroutine_resume));
+    rt->controls[PIT_CONTROL_RESUME] = impl_coroutine_resume;
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "yield!"), pit_value_nativefunc_argv_new(rt, impl_yield));
+    rt->controls[PIT_CONTROL_YIELD] = impl_yield;
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "coroutine/status"), pit_value_nativefunc_argv_new(rt, impl_coroutine_status));
     /* cons cells */
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "cons"), pit_value_nativefunc_new(rt, impl_cons));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "car"), pit_value_nativefunc_new(rt, impl_car));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "cdr"), pit_value_nativefunc_new(rt, impl_cdr));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "setcar!"), pit_value_nativefunc_new(rt, impl_setcar));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "setcdr!"), pit_value_nativefunc_new(rt, impl_setcdr));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "cons"), pit_value_nativefunc_argv_new(rt, impl_cons));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "car"), pit_value_nativefunc_argv_new(rt, impl_car));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "cdr"), pit_value_nativefunc_argv_new(rt, impl_cdr));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "setcar!"), pit_value_nativefunc_argv_new(rt, impl_setcar));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "setcdr!"), pit_value_nativefunc_argv_new(rt, impl_setcdr));
     /* cons lists*/
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list"), pit_value_nativefunc_new(rt, impl_list));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/nth"), pit_value_nativefunc_new(rt, impl_list_nth));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/iota"), pit_value_nativefunc_new(rt, impl_list_iota));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/len"), pit_value_nativefunc_new(rt, impl_list_len));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/reverse"), pit_value_nativefunc_new(rt, impl_list_reverse));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/uniq"), pit_value_nativefunc_new(rt, impl_list_uniq));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/append"), pit_value_nativefunc_new(rt, impl_list_append));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/concat"), pit_value_nativefunc_new(rt, impl_list_concat));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/take"), pit_value_nativefunc_new(rt, impl_list_take));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/drop"), pit_value_nativefunc_new(rt, impl_list_drop));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/map"), pit_value_nativefunc_new(rt, impl_list_map));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/foldl"), pit_value_nativefunc_new(rt, impl_list_foldl));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/filter"), pit_value_nativefunc_new(rt, impl_list_filter));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/find"), pit_value_nativefunc_new(rt, impl_list_find));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/contains?"), pit_value_nativefunc_new(rt, impl_list_contains_p));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/all?"), pit_value_nativefunc_new(rt, impl_list_all_p));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/zip-with"), pit_value_nativefunc_new(rt, impl_list_zip_with));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list"), pit_value_nativefunc_argv_new(rt, impl_list));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/nth"), pit_value_nativefunc_argv_new(rt, impl_list_nth));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/iota"), pit_value_nativefunc_argv_new(rt, impl_list_iota));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/len"), pit_value_nativefunc_argv_new(rt, impl_list_len));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/reverse"), pit_value_nativefunc_argv_new(rt, impl_list_reverse));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/uniq"), pit_value_nativefunc_argv_new(rt, impl_list_uniq));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/append"), pit_value_nativefunc_argv_new(rt, impl_list_append));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/concat"), pit_value_nativefunc_argv_new(rt, impl_list_concat));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/take"), pit_value_nativefunc_argv_new(rt, impl_list_take));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/drop"), pit_value_nativefunc_argv_new(rt, impl_list_drop));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/map"), pit_value_nativefunc_argv_new(rt, impl_list_map));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/foldl"), pit_value_nativefunc_argv_new(rt, impl_list_foldl));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/filter"), pit_value_nativefunc_argv_new(rt, impl_list_filter));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/find"), pit_value_nativefunc_argv_new(rt, impl_list_find));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/contains?"), pit_value_nativefunc_argv_new(rt, impl_list_contains_p));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/all?"), pit_value_nativefunc_argv_new(rt, impl_list_all_p));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "list/zip-with"), pit_value_nativefunc_argv_new(rt, impl_list_zip_with));
     /* bytestrings */ 
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bytes/len"), pit_value_nativefunc_new(rt, impl_bytes_len));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bytes/range"), pit_value_nativefunc_new(rt, impl_bytes_range));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bytes/len"), pit_value_nativefunc_argv_new(rt, impl_bytes_len));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bytes/range"), pit_value_nativefunc_argv_new(rt, impl_bytes_range));
     /* array */
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array"), pit_value_nativefunc_new(rt, impl_array));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array/to-list"), pit_value_nativefunc_new(rt, impl_array_to_list));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array/from-list"), pit_value_nativefunc_new(rt, impl_array_from_list));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array/repeat"), pit_value_nativefunc_new(rt, impl_array_repeat));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array/len"), pit_value_nativefunc_new(rt, impl_array_len));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array/get"), pit_value_nativefunc_new(rt, impl_array_get));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array/set!"), pit_value_nativefunc_new(rt, impl_array_set));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array/map"), pit_value_nativefunc_new(rt, impl_array_map));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array/map!"), pit_value_nativefunc_new(rt, impl_array_map_mut));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array"), pit_value_nativefunc_argv_new(rt, impl_array));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array/to-list"), pit_value_nativefunc_argv_new(rt, impl_array_to_list));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array/from-list"), pit_value_nativefunc_argv_new(rt, impl_array_from_list));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array/repeat"), pit_value_nativefunc_argv_new(rt, impl_array_repeat));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array/len"), pit_value_nativefunc_argv_new(rt, impl_array_len));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array/get"), pit_value_nativefunc_argv_new(rt, impl_array_get));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array/set!"), pit_value_nativefunc_argv_new(rt, impl_array_set));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array/map"), pit_value_nativefunc_argv_new(rt, impl_array_map));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "array/map!"), pit_value_nativefunc_argv_new(rt, impl_array_map_mut));
     /* arithmetic */
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "abs"), pit_value_nativefunc_new(rt, impl_abs));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "+"), pit_value_nativefunc_new(rt, impl_add));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "-"), pit_value_nativefunc_new(rt, impl_sub));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "*"), pit_value_nativefunc_new(rt, impl_mul));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "/"), pit_value_nativefunc_new(rt, impl_div));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "abs"), pit_value_nativefunc_argv_new(rt, impl_abs));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "+"), pit_value_nativefunc_argv_new(rt, impl_add));
+    rt->intrinsics[PIT_INTRINSIC_ADD] = impl_add;
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "-"), pit_value_nativefunc_argv_new(rt, impl_sub));
+    rt->intrinsics[PIT_INTRINSIC_SUB] = impl_sub;
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "*"), pit_value_nativefunc_argv_new(rt, impl_mul));
+    rt->intrinsics[PIT_INTRINSIC_MUL] = impl_mul;
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "/"), pit_value_nativefunc_argv_new(rt, impl_div));
     /* booleans */
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "not"), pit_value_nativefunc_new(rt, impl_not));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "not"), pit_value_nativefunc_argv_new(rt, impl_not));
     /* comparisons */
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "<"), pit_value_nativefunc_new(rt, impl_lt));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, ">"), pit_value_nativefunc_new(rt, impl_gt));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "<="), pit_value_nativefunc_new(rt, impl_le));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, ">="), pit_value_nativefunc_new(rt, impl_ge));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "<"), pit_value_nativefunc_argv_new(rt, impl_lt));
+    rt->intrinsics[PIT_INTRINSIC_LT] = impl_lt;
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, ">"), pit_value_nativefunc_argv_new(rt, impl_gt));
+    rt->intrinsics[PIT_INTRINSIC_GT] = impl_gt;
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "<="), pit_value_nativefunc_argv_new(rt, impl_le));
+    rt->intrinsics[PIT_INTRINSIC_LE] = impl_le;
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, ">="), pit_value_nativefunc_argv_new(rt, impl_ge));
+    rt->intrinsics[PIT_INTRINSIC_GE] = impl_ge;
     /* bitwise arithmetic */
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bitwise/and"), pit_value_nativefunc_new(rt, impl_bitwise_and));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bitwise/or"), pit_value_nativefunc_new(rt, impl_bitwise_or));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bitwise/xor"), pit_value_nativefunc_new(rt, impl_bitwise_xor));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bitwise/not"), pit_value_nativefunc_new(rt, impl_bitwise_not));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bitwise/lshift"), pit_value_nativefunc_new(rt, impl_bitwise_lshift));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bitwise/rshift"), pit_value_nativefunc_new(rt, impl_bitwise_rshift));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bitwise/and"), pit_value_nativefunc_argv_new(rt, impl_bitwise_and));
+    rt->intrinsics[PIT_INTRINSIC_BITWISE_AND] = impl_bitwise_and;
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bitwise/or"), pit_value_nativefunc_argv_new(rt, impl_bitwise_or));
+    rt->intrinsics[PIT_INTRINSIC_BITWISE_OR] = impl_bitwise_or;
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bitwise/xor"), pit_value_nativefunc_argv_new(rt, impl_bitwise_xor));
+    rt->intrinsics[PIT_INTRINSIC_BITWISE_XOR] = impl_bitwise_xor;
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bitwise/not"), pit_value_nativefunc_argv_new(rt, impl_bitwise_not));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bitwise/lshift"), pit_value_nativefunc_argv_new(rt, impl_bitwise_lshift));
+    rt->intrinsics[PIT_INTRINSIC_BITWISE_LSHIFT] = impl_bitwise_lshift;
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bitwise/rshift"), pit_value_nativefunc_argv_new(rt, impl_bitwise_rshift));
+    rt->intrinsics[PIT_INTRINSIC_BITWISE_RSHIFT] = impl_bitwise_rshift;
 }
 
-static pit_value impl_plist_get(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_plist_get(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value k = pit_value_cons_car(rt, args);
-    pit_value vs = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
+    pit_value k = PIT_ARG(argc, argv, 0);
+    pit_value vs = PIT_ARG(argc, argv, 1);
     return pit_value_list_plist_get(rt, k, vs);
 }
 void pit_install_library_plist(pit_runtime *rt) {
     /* property lists / keyword arguments */
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "plist/get"), pit_value_nativefunc_new(rt, impl_plist_get));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "plist/get"), pit_value_nativefunc_argv_new(rt, impl_plist_get));
 }
 
-static pit_value impl_alist_get(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_alist_get(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value k = pit_value_cons_car(rt, args);
-    pit_value vs = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
+    pit_value k = PIT_ARG(argc, argv, 0);
+    pit_value vs = PIT_ARG(argc, argv, 1);
     while (vs != PIT_NIL) {
         pit_value v = pit_value_cons_car(rt, vs);
         if (pit_value_equal(rt, k, pit_value_cons_car(rt, v))) {
@@ -906,5 +1056,5 @@ static pit_value impl_alist_get(pit_runtime *rt, pit_value args, void *data) {
 }
 void pit_install_library_alist(pit_runtime *rt) {
     /* association lists */
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "alist/get"), pit_value_nativefunc_new(rt, impl_alist_get));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "alist/get"), pit_value_nativefunc_argv_new(rt, impl_alist_get));
 }
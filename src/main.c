@@ -6,6 +6,7 @@
 #include <lcq/pit/parser.h>
 #include <lcq/pit/runtime.h>
 #include <lcq/pit/library.h>
+#include <lcq/pit/runtime/jit.h>
 
 PIT_DECLARE_DEQUE(double)
 
@@ -13,11 +14,14 @@ int main(int argc, char **argv) {
     i64 sz = 256 * 1024 * 1024;
     u8 *buf = malloc((size_t) sz);
     pit_runtime *rt = pit_runtime_new(buf, sz);
+    char *budget = getenv("PIT_GC_BUDGET");
     pit_install_library_essential(rt);
     pit_install_library_io(rt);
     pit_install_library_plist(rt);
     pit_install_library_alist(rt);
     pit_install_library_bytestring(rt);
+    pit_jit_install_native(rt);
+    if (budget != NULL && atol(budget) > 0) rt->gc_budget = atol(budget); /* collect the old generation incrementally (see gc.h) */
     if (argc < 2) {
         pit_repl(rt);
     } else {
@@ -1,11 +1,18 @@
+#define _DEFAULT_SOURCE /* for mmap, getpid and clock_gettime */
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+#if defined(__linux__) && defined(__x86_64__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include <lcq/pit/lexer.h>
 #include <lcq/pit/parser.h>
 #include <lcq/pit/runtime.h>
 #include <lcq/pit/library.h>
+#include <lcq/pit/runtime/jit.h>
 
 i64 pit_lex_file(pit_lexer *ret, char *path) {
     FILE *f = fopen(path, "r");
@@ -23,16 +30,27 @@ i64 pit_lex_file(pit_lexer *ret, char *path) {
     return 0;
 }
 
+/* number of calls to print at each end of a long backtrace */
+#define BACKTRACE_SHOWN 16
 bool pit_runtime_print_error(pit_runtime *rt) {
     if (!pit_value_eq(rt->error, PIT_NIL)) {
         char buf[1024] = {0};
-        for (i64 i = 0; i < rt->backtrace->next; ++i) {
-            pit_annotated_ref *a = pit_vec_get(pit_annotated_ref)(rt->backtrace, i);
+        i64 depth = rt->calls->next;
+        for (i64 i = 0; i < depth; ++i) {
+            pit_annotation *a = pit_vec_get(pit_annotation)(rt->calls, i);
             if (a == NULL) continue;
-            fprintf(stderr, "on line %ld, column %ld\n", a->annotation.line, a->annotation.column);
+            if (depth > 2 * BACKTRACE_SHOWN && i == BACKTRACE_SHOWN) {
+                fprintf(stderr, "... %ld more calls ...\n", depth - 2 * BACKTRACE_SHOWN);
+                i = depth - BACKTRACE_SHOWN - 1;
+            } else if (a->line < 0) {
+                fprintf(stderr, "in call at unknown location\n");
+            } else {
+                fprintf(stderr, "on line %ld, column %ld\n", a->line, a->column);
+            }
         }
         i64 end = pit_dump(rt, buf, sizeof(buf) - 1, rt->error, false); buf[end] = 0;
         fprintf(stderr, "error at line %ld, column %ld: %s\n", rt->error_line, rt->error_column, buf);
+        rt->calls->next = 0;
         return true;
     }
     return false;
@@ -55,7 +73,7 @@ pit_value pit_value_bytes_new_file(pit_runtime *rt, char *path) {
     fseek(f, 0, SEEK_END);
     i64 len = ftell(f);
     fseek(f, 0, SEEK_SET);
-    u8 *dest = pit_arena_alloc_array(rt->heap, len);
+    u8 *dest = pit_arena_alloc_back(rt->heap, len);
     if (!dest) { pit_error(rt, "failed to allocate bytes"); fclose(f); return PIT_NIL; }
     if ((size_t) len != fread(dest, sizeof(char), (size_t) len, f)) {
         fclose(f);
@@ -88,21 +106,27 @@ pit_value pit_load_file(pit_runtime *rt, char *path) {
     pit_parser parse;
     bool eof = false;
     pit_value p = PIT_NIL;
-    pit_value ret = PIT_NIL;
+    i64 handles_reset = rt->handles->next;
+    pit_value *ret;
+    pit_value res = PIT_NIL;
     if (pit_lex_file(&lex, path) < 0) {
         pit_error(rt, "failed to lex file: %s", path);
         return PIT_NIL;
     }
+    if ((ret = pit_handle_new(rt, PIT_NIL)) == NULL) return PIT_NIL; /* the value of the last form outlives collections */
     pit_parser_from_lexer(&parse, &lex);
     while (p = pit_parse(rt, &parse, &eof), !eof) {
-        check_invariants(rt); if (pit_runtime_print_error(rt)) return PIT_NIL;
-        ret = pit_eval(rt, p);
-        check_invariants(rt); if (pit_runtime_print_error(rt)) return PIT_NIL;
-        pit_gc(rt);
-        check_invariants(rt); if (pit_runtime_print_error(rt)) return PIT_NIL;
+        check_invariants(rt); if (pit_runtime_print_error(rt)) goto end;
+        *ret = pit_eval(rt, p);
+        check_invariants(rt); if (pit_runtime_print_error(rt)) goto end;
+        pit_gc_collect(rt);
+        check_invariants(rt); if (pit_runtime_print_error(rt)) goto end;
     }
-    check_invariants(rt); if (pit_runtime_print_error(rt)) return PIT_NIL;
-    return ret;
+    check_invariants(rt); if (pit_runtime_print_error(rt)) goto end;
+    res = *ret;
+end:
+    rt->handles->next = handles_reset;
+    return res;
 }
 
 void pit_repl(pit_runtime *rt) {
@@ -151,7 +175,7 @@ void pit_repl(pit_runtime *rt) {
         } else {
             char dumpbuf[1024] = {0};
             pit_dump(rt, dumpbuf, sizeof(dumpbuf) - 1, res, true);
-            pit_gc(rt);
+            pit_gc_collect(rt);
             printf("%s\n> ", dumpbuf);
         }
         len = 0;
@@ -164,56 +188,63 @@ void pit_repl(pit_runtime *rt) {
     free(buf);
 }
 
-static pit_value impl_diagnostics(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_diagnostics(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    (void) args;
+    (void) argc; (void) argv;
     fprintf(stderr, "value allocs: %ld\n", rt->heap->next);
     return PIT_NIL;
 }
-static pit_value impl_print(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_print(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value x = pit_value_cons_car(rt, args);
+    pit_value x = PIT_ARG(argc, argv, 0);
     char buf[1024] = {0};
     pit_dump(rt, buf, sizeof(buf), x, true);
     buf[1023] = 0;
     puts(buf);
     return x;
 }
-static pit_value impl_princ(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_princ(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value x = pit_value_cons_car(rt, args);
+    pit_value x = PIT_ARG(argc, argv, 0);
     char buf[1024] = {0};
     pit_dump(rt, buf, sizeof(buf), x, false);
     buf[1023] = 0;
     puts(buf);
     return x;
 }
-static pit_value impl_load(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_load(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value path = pit_value_cons_car(rt, args);
+    pit_value path = PIT_ARG(argc, argv, 0);
     char pathbuf[1024] = {0};
     i64 len = pit_value_bytes_copy(rt, path, (u8 *) pathbuf, sizeof(pathbuf) - 1);
     if (len < 0) { pit_error(rt, "path was not a string"); return PIT_NIL; }
     pathbuf[len] = 0;
     return pit_load_file(rt, pathbuf);
 }
+static u64 monotonic_clock(pit_runtime *rt) {
+    struct timespec ts;
+    (void) rt;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64) ts.tv_sec * 1000000000 + (u64) ts.tv_nsec;
+}
 void pit_install_library_io(pit_runtime *rt) {
     /* diagnostics */
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "diagnostics!"), pit_value_nativefunc_new(rt, impl_diagnostics));
+    rt->clock = monotonic_clock; /* the profiler measures in nanoseconds */
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "diagnostics!"), pit_value_nativefunc_argv_new(rt, impl_diagnostics));
     /* stream IO */
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "print!"), pit_value_nativefunc_new(rt, impl_print));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "princ!"), pit_value_nativefunc_new(rt, impl_princ));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "print!"), pit_value_nativefunc_argv_new(rt, impl_print));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "princ!"), pit_value_nativefunc_argv_new(rt, impl_princ));
     /* disk IO */
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "load!"), pit_value_nativefunc_new(rt, impl_load));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "load!"), pit_value_nativefunc_argv_new(rt, impl_load));
 }
 
 struct bytestring {
     i64 len, cap;
     u8 *data;
 };
-static pit_value impl_bs_new(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_bs_new(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    (void) args;
+    (void) argc; (void) argv;
     i64 cap = 256;
     struct bytestring *bs = malloc(sizeof(struct bytestring));
     bs->len = 0;
@@ -221,9 +252,9 @@ static pit_value impl_bs_new(pit_runtime *rt, pit_value args, void *data) {
     bs->data = calloc((size_t) cap, 1);
     return pit_value_nativedata_new(rt, pit_symtab_intern_cstr(rt, "bs"), (void *) bs);
 }
-static pit_value impl_bs_delete(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_bs_delete(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value v = pit_value_cons_car(rt, args);
+    pit_value v = PIT_ARG(argc, argv, 0);
     pit_value_heavy *h = pit_value_ref_deref(rt, pit_value_as_ref(rt, v));
     if (!h) { pit_error(rt, "bad ref"); return PIT_NIL; }
     if (h->hsort != PIT_VALUE_HEAVY_SORT_NATIVEDATA) {
@@ -245,10 +276,10 @@ static pit_value impl_bs_delete(pit_runtime *rt, pit_value args, void *data) {
     h->in.nativedata.data = NULL;
     return PIT_T;
 }
-static pit_value impl_bs_grow(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_bs_grow(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value vsz = pit_value_cons_car(rt, args);
-    pit_value v = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
+    pit_value vsz = PIT_ARG(argc, argv, 0);
+    pit_value v = PIT_ARG(argc, argv, 1);
     struct bytestring *bs = pit_value_nativedata_get(rt, pit_symtab_intern_cstr(rt, "bs"), v);
     if (!bs) return PIT_NIL;
     i64 sz = pit_value_as_integer(rt, vsz);
@@ -261,14 +292,14 @@ static pit_value impl_bs_grow(pit_runtime *rt, pit_value args, void *data) {
     }
     return v;
 }
-static pit_value impl_bs_spit(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_bs_spit(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value path = pit_value_cons_car(rt, args);
+    pit_value path = PIT_ARG(argc, argv, 0);
     char pathbuf[1024] = {0};
     i64 len = pit_value_bytes_copy(rt, path, (u8 *) pathbuf, sizeof(pathbuf) - 1);
     if (len < 0) { pit_error(rt, "path was not a string"); return PIT_NIL; }
     pathbuf[len] = 0;
-    pit_value v = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
+    pit_value v = PIT_ARG(argc, argv, 1);
     struct bytestring *bs = pit_value_nativedata_get(rt, pit_symtab_intern_cstr(rt, "bs"), v);
     if (!bs) return PIT_NIL;
     FILE *f = fopen(pathbuf, "w+");
@@ -281,11 +312,11 @@ static pit_value impl_bs_spit(pit_runtime *rt, pit_value args, void *data) {
     }
     return v;
 }
-static pit_value impl_bs_write8(pit_runtime *rt, pit_value args, void *data) {
+static pit_value impl_bs_write8(pit_runtime *rt, i64 argc, pit_value *argv, void *data) {
     (void) data;
-    pit_value v = pit_value_cons_car(rt, args);
-    pit_value vidx = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
-    pit_value vx = pit_value_cons_car(rt, pit_value_cons_cdr(rt, pit_value_cons_cdr(rt, args)));
+    pit_value v = PIT_ARG(argc, argv, 0);
+    pit_value vidx = PIT_ARG(argc, argv, 1);
+    pit_value vx = PIT_ARG(argc, argv, 2);
     struct bytestring *bs = pit_value_nativedata_get(rt, pit_symtab_intern_cstr(rt, "bs"), v);
     if (!bs) return PIT_NIL;
     i64 idx = pit_value_as_integer(rt, vidx);
@@ -299,9 +330,51 @@ static pit_value impl_bs_write8(pit_runtime *rt, pit_value args, void *data) {
 }
 void pit_install_library_bytestring(pit_runtime *rt) {
     /* bytestrings */
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bs/new!"), pit_value_nativefunc_new(rt, impl_bs_new));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bs/delete!"), pit_value_nativefunc_new(rt, impl_bs_delete));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bs/grow!"), pit_value_nativefunc_new(rt, impl_bs_grow));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bs/spit!"), pit_value_nativefunc_new(rt, impl_bs_spit));
-    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bs/write8!"), pit_value_nativefunc_new(rt, impl_bs_write8));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bs/new!"), pit_value_nativefunc_argv_new(rt, impl_bs_new));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bs/delete!"), pit_value_nativefunc_argv_new(rt, impl_bs_delete));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bs/grow!"), pit_value_nativefunc_argv_new(rt, impl_bs_grow));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bs/spit!"), pit_value_nativefunc_argv_new(rt, impl_bs_spit));
+    pit_symtab_fset(rt, pit_symtab_intern_cstr(rt, "bs/write8!"), pit_value_nativefunc_argv_new(rt, impl_bs_write8));
+}
+
+#if defined(__linux__) && defined(__x86_64__)
+static bool perf_map_enabled = false;
+static FILE *perf_map = NULL; /* symbols for machine code, in the format perf looks for in /tmp/perf-PID.map */
+static void *jit_alloc(pit_runtime *rt, i64 size) {
+    void *ret = mmap(NULL, (size_t) size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    (void) rt;
+    return ret == MAP_FAILED ? NULL : ret;
+}
+static bool jit_publish(pit_runtime *rt, void *mem, i64 size, i64 code_size, char *name) {
+    (void) rt;
+    if (mprotect(mem, (size_t) size, PROT_READ | PROT_EXEC) != 0) return false;
+    if (perf_map_enabled && perf_map == NULL) { /* opened with the first code, so that runs without any don't leave a map behind */
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/perf-%ld.map", (long) getpid());
+        perf_map = fopen(path, "w");
+        perf_map_enabled = perf_map != NULL;
+    }
+    if (perf_map != NULL) {
+        fprintf(perf_map, "%lx %lx %s\n", (unsigned long) mem, (unsigned long) code_size, name);
+        fflush(perf_map);
+    }
+    return true;
+}
+static void jit_free(pit_runtime *rt, void *mem, i64 size) {
+    (void) rt;
+    munmap(mem, (size_t) size);
+}
+#endif
+void pit_jit_install_native(pit_runtime *rt) {
+#if defined(__linux__) && defined(__x86_64__)
+    char *enabled = getenv("PIT_JIT");
+    char *perf = getenv("PIT_JIT_PERFMAP");
+    if (enabled == NULL || strcmp(enabled, "1") != 0) return;
+    perf_map_enabled = perf != NULL && strcmp(perf, "1") == 0;
+    rt->jit_alloc = jit_alloc;
+    rt->jit_publish = jit_publish;
+    rt->jit_free = jit_free;
+#else
+    (void) rt;
+#endif
 }
@@ -122,7 +122,7 @@ pit_value pit_parse(pit_runtime *rt, pit_parser *st, bool *eof) {
         return ret;
     }
     case PIT_LEX_TOKEN_QUOTE:
-        return pit_value_list(rt, 2, pit_symtab_intern_cstr(rt, "quote"), pit_parse(rt, st, eof));
+        return pit_value_list(rt, 2, rt->symbols[PIT_SYMBOL_QUOTE], pit_parse(rt, st, eof));
     case PIT_LEX_TOKEN_INTEGER_LITERAL: {
         i64 idx = st->cur.start;
         i64 base = 10;
@@ -3,6 +3,7 @@
 #include <lcq/pit/parser.h>
 #include <lcq/pit/runtime.h>
 #include <lcq/pit/library.h>
+#include <lcq/pit/runtime/jit.h>
 
 enum pit_value_sort pit_value_sort(pit_value v) {
     /* if this isn't a NaN, or it's a quiet NaN, this is a real double */
@@ -22,24 +23,106 @@ u64 pit_value_data(pit_value v) {
     return v & 0x1ffffffffffff;
 }
 
+static char *well_known_symbol_names[PIT_SYMBOL__SENTINEL] = {
+    [PIT_SYMBOL_QUOTE] = "quote",
+    [PIT_SYMBOL_LAMBDA] = "lambda",
+    [PIT_SYMBOL_PROGN] = "progn",
+    [PIT_SYMBOL_DEFER] = "defer",
+    [PIT_SYMBOL_IF] = "if",
+    [PIT_SYMBOL_COND] = "cond",
+    [PIT_SYMBOL_OR] = "or",
+    [PIT_SYMBOL_LET] = "let",
+    [PIT_SYMBOL_SET] = "set!",
+    [PIT_SYMBOL_FSET] = "fset!",
+    [PIT_SYMBOL_DEFUN] = "defun!",
+    [PIT_SYMBOL_REST] = "&",
+};
+
 pit_runtime *pit_runtime_new(u8 *buf, i64 len) {
     pit_arena *a = pit_arena_new(buf, len, sizeof(u8));
     pit_runtime *ret = pit_arena_alloc_back(a, sizeof(*ret));
     i64 heap_size = len / 4;
     i64 annotations_size = len / 32;
-    i64 symtab_size = len / 16;
+    i64 expansions_size = len / 128;
+    i64 symtab_size = len / 32; /* and about half as much again for its index */
     i64 stack_size = len / 32;
+    i64 compiler_size = len / 64;
+    i64 profile_size = len / 256;
+    i64 coroutines_size = len / 1024;
+    i64 remembered_size = len / 512;
+    i64 handles_size = len / 1024;
+    i64 jit_size = len / 1024;
     ret->heap = pit_arena_new(pit_arena_alloc_back(a, heap_size), heap_size, sizeof(pit_value_heavy));
     ret->backbuffer = pit_arena_new(pit_arena_alloc_back(a, heap_size), heap_size, sizeof(pit_value_heavy));
     ret->annotations = pit_vec_new(pit_annotated_ref)(pit_arena_alloc_back(a, annotations_size), annotations_size);
-    ret->backtrace = pit_vec_new(pit_annotated_ref)(pit_arena_alloc_back(a, annotations_size), annotations_size);
+    ret->annotation_index_len = heap_size / (i64) sizeof(pit_value_heavy);
+    ret->annotation_index = pit_arena_alloc_back(a, ret->annotation_index_len * (i64) sizeof(i32));
+    ret->backbuffer_annotations = pit_vec_new(pit_annotated_ref)(pit_arena_alloc_back(a, annotations_size), annotations_size);
+    ret->expansions = pit_vec_new(pit_expansion)(pit_arena_alloc_back(a, expansions_size), expansions_size);
+    ret->expansion_index = pit_arena_alloc_back(a, ret->annotation_index_len * (i64) sizeof(i32));
+    ret->backbuffer_expansions = pit_vec_new(pit_expansion)(pit_arena_alloc_back(a, expansions_size), expansions_size);
+    ret->backbuffer_annotation_index = pit_arena_alloc_back(a, ret->annotation_index_len * (i64) sizeof(i32));
+    ret->backbuffer_expansion_index = pit_arena_alloc_back(a, ret->annotation_index_len * (i64) sizeof(i32));
+    ret->gc_old = 0;
+    ret->gc_old_back = ret->heap->capacity;
+    ret->gc_old_annotations = ret->gc_old_expansions = 0;
+    ret->remembered = pit_vec_new(pit_ref)(pit_arena_alloc_back(a, remembered_size), remembered_size);
+    ret->gc_nursery = ret->heap->capacity / 64;
+    ret->gc_major = ret->gc_nursery;
+    ret->gc_pending = false;
+    ret->gc_inhibit = 0;
+    ret->gc_count = 0;
+    ret->gc_reclaimed = 0;
+    ret->gc_budget = 0;
+    ret->gc_phase = PIT_GC_IDLE;
+    ret->gc_scan = ret->gc_cursor = ret->gc_kept = 0;
+    ret->gc_flip_annotations = ret->gc_flip_expansions = 0;
+    ret->gc_flip_jit = 0;
+    ret->gc_flipped = ret->gc_copied = ret->gc_stepped = 0;
+    ret->gc_carried = false;
+    ret->handles = pit_vec_new(pit_value)(pit_arena_alloc_back(a, handles_size), handles_size);
     ret->symtab = pit_vec_new(pit_symtab_entry)(pit_arena_alloc_back(a, symtab_size), symtab_size);
+    ret->symtab_index_len = 1;
+    while (ret->symtab_index_len < 2 * (symtab_size / (i64) sizeof(pit_symtab_entry))) ret->symtab_index_len *= 2;
+    ret->symtab_index = pit_arena_alloc_back(a, ret->symtab_index_len * (i64) sizeof(pit_symtab_slot));
+    for (i64 i = 0; i < ret->symtab_index_len; ++i) ret->symtab_index[i].symbol = 0;
     ret->expr_stack = pit_vec_new(pit_value)(pit_arena_alloc_back(a, stack_size), stack_size);
     ret->result_stack = pit_vec_new(pit_value)(pit_arena_alloc_back(a, stack_size), stack_size);
     ret->traversal = pit_vec_new(pit_traversal_entry)(pit_arena_alloc_back(a, stack_size), stack_size);
     ret->saved_bindings = pit_vec_new(pit_value)(pit_arena_alloc_back(a, stack_size), stack_size);
+    ret->frames = pit_vec_new(pit_frame)(pit_arena_alloc_back(a, stack_size), stack_size);
+    ret->calls = pit_vec_new(pit_annotation)(pit_arena_alloc_back(a, stack_size), stack_size);
+    ret->calls_max = stack_size / (i64) sizeof(pit_annotation);
+    ret->coroutines = pit_vec_new(pit_coroutine_activation)(pit_arena_alloc_back(a, coroutines_size), coroutines_size);
+    ret->fuel = 0;
+    ret->eval_forms = ret->eval_frames = ret->eval_stack = -1;
+    ret->eval_value = PIT_NIL;
+    ret->code = pit_vec_new(u32)(pit_arena_alloc_back(a, compiler_size), compiler_size);
+    ret->constants = pit_vec_new(pit_value)(pit_arena_alloc_back(a, compiler_size), compiler_size);
+    ret->profiling = false;
+    ret->profile = pit_vec_new(pit_profile_entry)(pit_arena_alloc_back(a, profile_size), profile_size);
+    ret->profile_index_len = 1;
+    while (ret->profile_index_len < 2 * (profile_size / (i64) sizeof(pit_profile_entry))) ret->profile_index_len *= 2;
+    ret->profile_index = pit_arena_alloc_back(a, ret->profile_index_len * (i64) sizeof(i32));
+    for (i64 i = 0; i < ret->profile_index_len; ++i) ret->profile_index[i] = 0;
+    ret->profile_calls = pit_vec_new(pit_profile_call)(pit_arena_alloc_back(a, stack_size), stack_size);
+    ret->clock = NULL;
     ret->frozen_values = 0;
     ret->frozen_symtab = 0;
+    ret->frozen_back = ret->heap->capacity;
+    ret->frozen_annotations = ret->frozen_expansions = 0;
+    for (i64 i = 0; i < PIT_INTRINSIC__SENTINEL; ++i) ret->intrinsics[i] = NULL;
+    for (i64 i = 0; i < PIT_CONTROL__SENTINEL; ++i) ret->controls[i] = NULL;
+    ret->jit_alloc = NULL;
+    ret->jit_publish = NULL;
+    ret->jit_free = NULL;
+    ret->jit_code = pit_vec_new(pit_jit_entry)(pit_arena_alloc_back(a, jit_size), jit_size);
+    ret->jit_frames_len = jit_size / (i64) sizeof(pit_jit_frame);
+    ret->jit_frames = pit_arena_alloc_back(a, ret->jit_frames_len * (i64) sizeof(pit_jit_frame));
+    for (i64 i = 0; i < ret->jit_frames_len; ++i) ret->jit_frames[i].epoch = 0;
+    ret->jit_threshold = PIT_JIT_THRESHOLD;
+    ret->epoch = 1;
+    ret->macro_epoch = 1;
     ret->error = PIT_NIL;
     ret->source_line = ret->source_column = -1;
     ret->error_line = ret->error_column = -1;
@@ -48,21 +131,35 @@ pit_runtime *pit_runtime_new(u8 *buf, i64 len) {
     pit_value truth = pit_symtab_intern_cstr(ret, "t");
     pit_symtab_set(ret, truth, truth);
     pit_runtime_freeze(ret);
+    /* after freezing, since the library still needs to define most of these */
+    for (i64 i = 0; i < PIT_SYMBOL__SENTINEL; ++i) ret->symbols[i] = pit_symtab_intern_cstr(ret, well_known_symbol_names[i]);
     return ret;
 }
 
 void pit_runtime_freeze(pit_runtime *rt) {
+    pit_gc_promote(rt); /* frozen values are never collected */
     rt->frozen_values = rt->heap->next;
     rt->frozen_symtab = rt->symtab->next;
+    rt->frozen_back = rt->heap->back;
+    rt->frozen_annotations = rt->annotations->next;
+    rt->frozen_expansions = rt->expansions->next;
 }
 void pit_runtime_reset(pit_runtime *rt) {
     rt->heap->next = rt->frozen_values;
+    rt->heap->back = rt->frozen_back;
     rt->symtab->next = rt->frozen_symtab;
+    pit_gc_demote(rt); /* values after the frozen point are gone, and their refs will be reused */
+    pit_jit_drop(rt, rt->frozen_values); /* and so is their machine code */
+    rt->epoch += 1;
+    rt->macro_epoch += 1; /* expansions might refer to values that no longer exist */
+    pit_profile_clear(rt); /* and so might the profile */
+    pit_eval_abandon(rt); /* and a suspended evaluation */
 }
 
 pit_value pit_error_get(pit_runtime *rt) {
     pit_value ret = rt->error;
     rt->error = PIT_NIL;
+    rt->calls->next = 0; /* calls that were interrupted by the error are left on the stack until it's handled */
     return ret;
 }
 
@@ -71,7 +168,7 @@ void pit_error(pit_runtime *rt, char *format, ...) {
         char buf[1024] = {0};
         va_list vargs;
         va_start(vargs, format);
-        pit_libc_string_snprintf(buf, sizeof(buf), format, vargs);
+        pit_libc_string_vsnprintf(buf, sizeof(buf), format, vargs);
         va_end(vargs);
         rt->error = PIT_T; /* we set the error now to prevent infinite recursion */
         rt->error = pit_value_bytes_new_cstr(rt, buf); /* in case this errs also */
@@ -81,22 +178,59 @@ void pit_error(pit_runtime *rt, char *format, ...) {
     }
 }
 
+bool pit_calls_push(pit_runtime *rt, i64 line, i64 column) {
+    pit_annotation a;
+    a.line = line;
+    a.column = column;
+    if (rt->calls->next >= rt->calls_max || pit_vec_push(pit_annotation)(rt->calls, a) < 0) {
+        pit_error(rt, "maximum call depth exceeded");
+        return false;
+    }
+    return true;
+}
+
+/* annotations live in a vector, and annotation_index maps each heavy value directly to its entry.
+   newly allocated heavy values have no annotation, so their index entries are cleared on allocation */
 void pit_annotation_set(struct pit_runtime *rt, pit_ref ref, pit_annotation annotation) {
     pit_annotated_ref a;
+    i64 idx;
+    if (ref < 0 || ref >= rt->annotation_index_len) { pit_error(rt, "annotated ref out of bounds"); return; }
     a.ref = ref;
     a.annotation = annotation;
-    if (pit_vec_push(pit_annotated_ref)(rt->annotations, a) < 0)
-        pit_error(rt, "annotation overflow");
+    idx = pit_vec_push(pit_annotated_ref)(rt->annotations, a);
+    if (idx < 0 || idx >= 0x7fffffff) { pit_error(rt, "annotation overflow"); return; }
+    rt->annotation_index[ref] = (i32) (idx + 1);
 }
 pit_annotated_ref *pit_annotation_get(struct pit_runtime *rt, pit_ref ref) {
-    for (i64 i = 0; i < rt->annotations->next; ++i) {
-        pit_annotated_ref *a = pit_vec_get(pit_annotated_ref)(rt->annotations, i);
-        if (a == NULL) pit_error(rt, "failed to get annotation");
-        else if (a->ref == ref) {
-            return a;
-        }
-    }
-    return NULL;
+    i32 idx;
+    if (ref < 0 || ref >= rt->annotation_index_len) return NULL;
+    idx = rt->annotation_index[ref];
+    if (idx == 0) return NULL;
+    return pit_vec_get(pit_annotated_ref)(rt->annotations, idx - 1);
+}
+
+/* expansions are indexed the same way. the vector only grows until the next GC, which drops stale entries.
+   it's only a cache, so we quietly stop remembering expansions if it fills up */
+void pit_expansion_set(struct pit_runtime *rt, pit_ref ref, pit_value expansion) {
+    pit_expansion e;
+    i64 idx;
+    if (ref < 0 || ref >= rt->annotation_index_len) return;
+    e.ref = ref;
+    e.expansion = expansion;
+    e.epoch = rt->macro_epoch;
+    idx = pit_vec_push(pit_expansion)(rt->expansions, e);
+    if (idx < 0 || idx >= 0x7fffffff) return;
+    rt->expansion_index[ref] = (i32) (idx + 1);
+}
+pit_expansion *pit_expansion_get(struct pit_runtime *rt, pit_ref ref) {
+    i32 idx;
+    pit_expansion *e;
+    if (ref < 0 || ref >= rt->annotation_index_len) return NULL;
+    idx = rt->expansion_index[ref];
+    if (idx == 0) return NULL;
+    e = pit_vec_get(pit_expansion)(rt->expansions, idx - 1);
+    if (e == NULL || e->ref != ref || e->epoch != rt->macro_epoch) return NULL;
+    return e;
 }
 
 void pit_traversal_push_value(struct pit_runtime *rt, pit_vec(pit_traversal_entry) *s, pit_value x) {
@@ -0,0 +1,458 @@
+#include <lcq/pit/runtime/compile.h>
+
+/* like pit_eval, the compiler avoids recursion by keeping a worklist on the traversal stack.
+   entries are expressions to compile, instruction words to emit, and jumps waiting for a target.
+   special forms push their pieces in the order they should be emitted, and then reverse them */
+
+typedef struct {
+    i64 code_reset; /* start of this compilation's instructions in rt->code */
+    i64 constants_reset; /* start of this compilation's constants in rt->constants */
+    pit_value scope; /* alist from local variable names to slot indices, innermost first */
+    i64 slots; /* number of slots in use at the current point */
+    i64 max_slots; /* number of slots the frame needs */
+    pit_value captured; /* names of closure environment entries, in order */
+    i64 caches; /* number of inline caches for calls to global functions */
+    pit_value boxed; /* names of local variables that might be captured, which must be kept in cells */
+} compiler;
+
+static i64 push_entry(pit_runtime *rt, pit_traversal_entry ent) {
+    i64 idx = pit_vec_push(pit_traversal_entry)(rt->traversal, ent);
+    if (idx < 0) pit_error(rt, "compiler traversal overflow");
+    return idx;
+}
+/* tail is true if the value of e is returned from the function; calls there can reuse the frame */
+static void push_compile(pit_runtime *rt, pit_value e, bool tail) {
+    pit_traversal_entry ent;
+    ent.sort = tail ? PIT_TRAVERSAL_ENTRY_COMPILE_TAIL : PIT_TRAVERSAL_ENTRY_COMPILE;
+    ent.in.value = e;
+    push_entry(rt, ent);
+}
+static i64 push_emit(pit_runtime *rt, u32 word) {
+    pit_traversal_entry ent;
+    ent.sort = PIT_TRAVERSAL_ENTRY_EMIT;
+    ent.in.emit.word = word;
+    ent.in.emit.patch = -1;
+    return push_entry(rt, ent);
+}
+/* push a switch to another scope (when entering or leaving a let) */
+static void push_scope(pit_runtime *rt, i64 slots, pit_value scope) {
+    pit_traversal_entry ent;
+    ent.sort = PIT_TRAVERSAL_ENTRY_SCOPE;
+    ent.in.scope = pit_value_cons(rt, pit_value_integer_new(rt, slots), scope);
+    push_entry(rt, ent);
+}
+/* push a jump target, and link the jump instruction at entry idx to it */
+static void push_patch(pit_runtime *rt, i64 idx) {
+    pit_traversal_entry ent;
+    pit_traversal_entry *jump = pit_vec_get(pit_traversal_entry)(rt->traversal, idx);
+    ent.sort = PIT_TRAVERSAL_ENTRY_PATCH;
+    ent.in.patch = -1;
+    if (jump == NULL) { pit_error(rt, "compiler jump link invalid"); return; }
+    jump->in.emit.patch = push_entry(rt, ent);
+}
+/* push a jump target for every unlinked jump with the given opcode since start */
+static void push_patch_all(pit_runtime *rt, i64 start, pit_opcode op) {
+    i64 end = rt->traversal->next;
+    for (i64 i = start; i < end; ++i) {
+        pit_traversal_entry *ent = pit_vec_get(pit_traversal_entry)(rt->traversal, i);
+        if (ent == NULL) { pit_error(rt, "compiler jump link invalid"); return; }
+        if (ent->sort == PIT_TRAVERSAL_ENTRY_EMIT
+            && PIT_OP_CODE(ent->in.emit.word) == op
+            && ent->in.emit.patch < 0
+        ) push_patch(rt, i);
+    }
+}
+/* reverse the entries pushed since start, so that they are popped in the order they were pushed */
+static void reverse_entries(pit_runtime *rt, i64 start) {
+    i64 end = rt->traversal->next - 1;
+    for (i64 i = start; i <= end; ++i) {
+        pit_traversal_entry *ent = pit_vec_get(pit_traversal_entry)(rt->traversal, i);
+        if (ent == NULL) { pit_error(rt, "compiler traversal invalid"); return; }
+        if (ent->sort == PIT_TRAVERSAL_ENTRY_EMIT && ent->in.emit.patch >= start)
+            ent->in.emit.patch = start + end - ent->in.emit.patch;
+    }
+    for (i64 lo = start, hi = end; lo < hi; ++lo, --hi) {
+        pit_traversal_entry *a = pit_vec_get(pit_traversal_entry)(rt->traversal, lo);
+        pit_traversal_entry *b = pit_vec_get(pit_traversal_entry)(rt->traversal, hi);
+        pit_traversal_entry tmp;
+        if (a == NULL || b == NULL) { pit_error(rt, "compiler traversal invalid"); return; }
+        tmp = *a; *a = *b; *b = tmp;
+    }
+}
+
+static void emit(pit_runtime *rt, u32 word) {
+    if (pit_vec_push(u32)(rt->code, word) < 0)
+        pit_error(rt, "bytecode buffer overflow");
+}
+static u32 constant(pit_runtime *rt, compiler *c, pit_value v) {
+    i64 idx = c->constants_reset;
+    for (; idx < rt->constants->next; ++idx) {
+        pit_value *x = pit_vec_get(pit_value)(rt->constants, idx);
+        if (x != NULL && pit_value_eq(*x, v)) return (u32) (idx - c->constants_reset);
+    }
+    idx = pit_vec_push(pit_value)(rt->constants, v);
+    if (idx < 0) { pit_error(rt, "compiler constant overflow"); return 0; }
+    if (idx - c->constants_reset > PIT_OP_OPERAND_MAX) { pit_error(rt, "too many constants in function"); return 0; }
+    return (u32) (idx - c->constants_reset);
+}
+
+typedef enum {
+    VARIABLE_GLOBAL, /* not lexically bound: look it up in the symbol table */
+    VARIABLE_LOCAL, /* slot in the current frame */
+    VARIABLE_CAPTURED, /* entry in the closure environment */
+} variable_sort;
+static variable_sort resolve(pit_runtime *rt, compiler *c, pit_value sym, i64 *idx) {
+    i64 i = 0;
+    for (pit_value s = c->scope; s != PIT_NIL; s = pit_value_cons_cdr(rt, s)) {
+        pit_value b = pit_value_cons_car(rt, s);
+        if (pit_value_eq(pit_value_cons_car(rt, b), sym)) {
+            *idx = pit_value_as_integer(rt, pit_value_cons_cdr(rt, b));
+            return VARIABLE_LOCAL;
+        }
+    }
+    for (pit_value s = c->captured; s != PIT_NIL; s = pit_value_cons_cdr(rt, s), ++i) {
+        if (pit_value_eq(pit_value_cons_car(rt, s), sym)) {
+            *idx = i;
+            return VARIABLE_CAPTURED;
+        }
+    }
+    return VARIABLE_GLOBAL;
+}
+
+/* names of variables that might be captured by a lambda within e.
+   rather than tracking scopes, we take every symbol used as a variable within any inner lambda.
+   that over-approximates, but only costs a cell for an unlucky variable that shares a name with a captured one.
+   macros that weren't expanded in advance are expanded here, which the compiler will see again from the memo */
+static pit_value boxed_names(pit_runtime *rt, pit_value e) {
+    i64 expr_stack_reset = rt->expr_stack->next;
+    pit_value ret = PIT_NIL;
+    if (pit_vec_push(pit_value)(rt->expr_stack, pit_value_cons(rt, PIT_NIL, e)) < 0) {
+        pit_error(rt, "compiler stack overflow");
+        return PIT_NIL;
+    }
+    while (rt->expr_stack->next > expr_stack_reset) {
+        pit_value inner_cur, cur;
+        bool inner;
+        if (pit_vec_pop(pit_value)(rt->expr_stack, &inner_cur) < 0) { pit_error(rt, "compiler stack underflow"); break; }
+        inner = pit_value_cons_car(rt, inner_cur) != PIT_NIL;
+        cur = pit_value_cons_cdr(rt, inner_cur);
+        if (pit_value_is_cons(rt, cur)) {
+            pit_value fsym = pit_value_cons_car(rt, cur);
+            pit_value args = pit_value_cons_cdr(rt, cur);
+            if (pit_value_eq(fsym, rt->symbols[PIT_SYMBOL_QUOTE])) continue;
+            if (pit_value_is_symbol(rt, fsym) && pit_symtab_is_symbol_macro(rt, fsym)) {
+                pit_value expanded = pit_macroexpand(rt, cur);
+                if (rt->error != PIT_NIL) break;
+                if (pit_vec_push(pit_value)(rt->expr_stack, pit_value_cons(rt, inner ? PIT_T : PIT_NIL, expanded)) < 0) {
+                    pit_error(rt, "compiler stack overflow");
+                    break;
+                }
+                continue;
+            }
+            if (pit_value_eq(fsym, rt->symbols[PIT_SYMBOL_LAMBDA])) {
+                inner = true;
+            } else if (inner && pit_value_eq(fsym, rt->symbols[PIT_SYMBOL_SET])) {
+                /* (set! 'x v) assigns to x */
+                pit_value target = pit_value_cons_car(rt, args);
+                if (pit_value_is_cons(rt, target) && pit_value_eq(pit_value_cons_car(rt, target), rt->symbols[PIT_SYMBOL_QUOTE])) {
+                    pit_value sym = pit_value_cons_car(rt, pit_value_cons_cdr(rt, target));
+                    if (pit_value_is_symbol(rt, sym)) ret = pit_value_cons(rt, sym, ret);
+                }
+            }
+            for (pit_value x = cur; pit_value_is_cons(rt, x); x = pit_value_cons_cdr(rt, x)) {
+                if (pit_vec_push(pit_value)(rt->expr_stack, pit_value_cons(rt, inner ? PIT_T : PIT_NIL, pit_value_cons_car(rt, x))) < 0) {
+                    pit_error(rt, "compiler stack overflow");
+                    break;
+                }
+            }
+        } else if (inner && pit_value_is_symbol(rt, cur) && pit_value_list_contains_eq(rt, cur, ret) == PIT_NIL) {
+            ret = pit_value_cons(rt, cur, ret);
+        }
+    }
+    rt->expr_stack->next = expr_stack_reset;
+    return ret;
+}
+static bool is_boxed(pit_runtime *rt, compiler *c, pit_value sym) {
+    return pit_value_list_contains_eq(rt, sym, c->boxed) != PIT_NIL;
+}
+
+/* is f a lambda expression that can be applied to args by binding slots in the current frame?
+   that's the case when it has no rest parameter and exactly as many parameters as args */
+static bool is_inline_lambda(pit_runtime *rt, pit_value f, pit_value args) {
+    pit_value params;
+    if (!pit_value_is_cons(rt, f)) return false;
+    if (!pit_value_is_symbol(rt, pit_value_cons_car(rt, f))
+        || !pit_value_eq(pit_value_cons_car(rt, f), rt->symbols[PIT_SYMBOL_LAMBDA])
+    ) return false;
+    params = pit_value_cons_car(rt, pit_value_cons_cdr(rt, f));
+    while (params != PIT_NIL && args != PIT_NIL) {
+        if (pit_value_eq(pit_value_cons_car(rt, params), rt->symbols[PIT_SYMBOL_REST])) return false;
+        params = pit_value_cons_cdr(rt, params);
+        args = pit_value_cons_cdr(rt, args);
+    }
+    return params == PIT_NIL && args == PIT_NIL;
+}
+
+/* is e of the form (set! 'x v) for some lexically bound x? */
+static bool is_lexical_set(pit_runtime *rt, compiler *c, pit_value args, variable_sort *sort, i64 *idx) {
+    pit_value quoted = pit_value_cons_car(rt, args);
+    pit_value sym;
+    if (!pit_value_is_cons(rt, quoted)
+        || !pit_value_is_symbol(rt, pit_value_cons_car(rt, quoted))
+        || !pit_value_eq(pit_value_cons_car(rt, quoted), rt->symbols[PIT_SYMBOL_QUOTE])
+    ) return false;
+    sym = pit_value_cons_car(rt, pit_value_cons_cdr(rt, quoted));
+    if (!pit_value_is_symbol(rt, sym) || pit_value_cons_cdr(rt, pit_value_cons_cdr(rt, args)) != PIT_NIL) return false;
+    *sort = resolve(rt, c, sym, idx);
+    return *sort != VARIABLE_GLOBAL;
+}
+
+/* is (fsym . args) a call to a built-in the VM can perform inline? returns which one, or -1 */
+static i64 intrinsic(pit_runtime *rt, pit_value fsym, pit_value args) {
+    pit_symtab_entry *ent = pit_symtab_lookup(rt, fsym);
+    pit_value f;
+    if (ent == NULL || pit_value_sort(ent->function) != PIT_VALUE_SORT_REF) return -1;
+    if (args == PIT_NIL || pit_value_cons_cdr(rt, args) == PIT_NIL
+        || pit_value_cons_cdr(rt, pit_value_cons_cdr(rt, args)) != PIT_NIL
+    ) return -1;
+    f = pit_value_cell_get(rt, ent->function, fsym);
+    for (i64 op = 0; op < PIT_INTRINSIC__SENTINEL; ++op) {
+        if (pit_vm_is_intrinsic(rt, f, (pit_intrinsic) op)) return op;
+    }
+    return -1;
+}
+
+/* push a sequence of forms like progn: all values but the last are discarded */
+static void push_body(pit_runtime *rt, compiler *c, pit_value forms, bool tail) {
+    if (forms == PIT_NIL) {
+        push_emit(rt, PIT_OP(PIT_OP_CONST, constant(rt, c, PIT_NIL)));
+        return;
+    }
+    while (forms != PIT_NIL) {
+        pit_value form = pit_value_cons_car(rt, forms);
+        forms = pit_value_cons_cdr(rt, forms);
+        push_compile(rt, form, tail && forms == PIT_NIL);
+        if (forms != PIT_NIL) push_emit(rt, PIT_OP(PIT_OP_POP, 0));
+    }
+}
+
+static void compile(pit_runtime *rt, compiler *c, pit_value e, bool tail) {
+    i64 start = rt->traversal->next;
+    if (pit_value_is_cons(rt, e)) {
+        pit_value fsym = pit_value_cons_car(rt, e);
+        pit_value args = pit_value_cons_cdr(rt, e);
+        bool is_symbol = pit_value_is_symbol(rt, fsym);
+        variable_sort sort;
+        i64 idx;
+        if (is_symbol && pit_value_eq(fsym, rt->symbols[PIT_SYMBOL_QUOTE])) {
+            emit(rt, PIT_OP(PIT_OP_CONST, constant(rt, c, pit_value_cons_car(rt, args))));
+        } else if (is_symbol && pit_value_eq(fsym, rt->symbols[PIT_SYMBOL_IF])) {
+            i64 jump_else, jump_end;
+            push_compile(rt, pit_value_cons_car(rt, args), false);
+            jump_else = push_emit(rt, PIT_OP(PIT_OP_JUMP_NIL, 0));
+            push_compile(rt, pit_value_cons_car(rt, pit_value_cons_cdr(rt, args)), tail);
+            jump_end = push_emit(rt, PIT_OP(PIT_OP_JUMP, 0));
+            push_patch(rt, jump_else);
+            push_compile(rt, pit_value_cons_car(rt, pit_value_cons_cdr(rt, pit_value_cons_cdr(rt, args))), tail);
+            push_patch(rt, jump_end);
+            reverse_entries(rt, start);
+        } else if (is_symbol && pit_value_eq(fsym, rt->symbols[PIT_SYMBOL_COND])) {
+            while (args != PIT_NIL) {
+                pit_value clause = pit_value_cons_car(rt, args);
+                i64 jump_next;
+                push_compile(rt, pit_value_cons_car(rt, clause), false);
+                jump_next = push_emit(rt, PIT_OP(PIT_OP_JUMP_NIL, 0));
+                push_body(rt, c, pit_value_cons_cdr(rt, clause), tail);
+                push_emit(rt, PIT_OP(PIT_OP_JUMP, 0));
+                push_patch(rt, jump_next);
+                args = pit_value_cons_cdr(rt, args);
+            }
+            push_emit(rt, PIT_OP(PIT_OP_CONST, constant(rt, c, PIT_NIL)));
+            push_patch_all(rt, start, PIT_OP_JUMP); /* every clause jumps to the end */
+            reverse_entries(rt, start);
+        } else if (is_symbol && pit_value_eq(fsym, rt->symbols[PIT_SYMBOL_PROGN])) {
+            push_body(rt, c, args, tail);
+            reverse_entries(rt, start);
+        } else if (is_symbol && pit_value_eq(fsym, rt->symbols[PIT_SYMBOL_OR])) {
+            if (args == PIT_NIL) push_emit(rt, PIT_OP(PIT_OP_CONST, constant(rt, c, PIT_NIL)));
+            while (args != PIT_NIL) {
+                pit_value arg = pit_value_cons_car(rt, args);
+                args = pit_value_cons_cdr(rt, args);
+                push_compile(rt, arg, tail && args == PIT_NIL);
+                if (args != PIT_NIL) push_emit(rt, PIT_OP(PIT_OP_JUMP_NOT_NIL_OR_POP, 0));
+            }
+            push_patch_all(rt, start, PIT_OP_JUMP_NOT_NIL_OR_POP);
+            reverse_entries(rt, start);
+        } else if (is_symbol && pit_value_eq(fsym, rt->symbols[PIT_SYMBOL_LAMBDA])) {
+            /* push the cells of the variables the new closure captures, then build it */
+            pit_value params = pit_value_cons_car(rt, args);
+            pit_value body = pit_value_cons(rt, rt->symbols[PIT_SYMBOL_PROGN], pit_value_cons_cdr(rt, args));
+            pit_value enclosing = c->captured;
+            pit_value freevars, template;
+            for (pit_value sc = c->scope; sc != PIT_NIL; sc = pit_value_cons_cdr(rt, sc)) {
+                enclosing = pit_value_cons(rt, pit_value_cons_car(rt, pit_value_cons_car(rt, sc)), enclosing);
+            }
+            freevars = pit_value_func_free_vars(rt, params, body, enclosing);
+            for (pit_value fv = freevars; fv != PIT_NIL; fv = pit_value_cons_cdr(rt, fv)) {
+                pit_value sym = pit_value_cons_car(rt, fv);
+                switch (resolve(rt, c, sym, &idx)) {
+                case VARIABLE_LOCAL:
+                    if (!is_boxed(rt, c, sym)) { pit_error(rt, "compiler captured a variable without a cell"); return; }
+                    emit(rt, PIT_OP(PIT_OP_CELL_LOCAL, idx));
+                    break;
+                case VARIABLE_CAPTURED: emit(rt, PIT_OP(PIT_OP_CELL_ENV, idx)); break;
+                case VARIABLE_GLOBAL: pit_error(rt, "compiler captured a global variable"); return;
+                }
+            }
+            /* the body is compiled now, once, rather than each time a closure is made from it */
+            template = pit_value_func_new(rt, params, freevars, PIT_NIL, body);
+            if (rt->error != PIT_NIL) return;
+            emit(rt, PIT_OP(PIT_OP_CLOSURE, constant(rt, c, template)));
+            emit(rt, (u32) pit_value_list_len(rt, freevars));
+        } else if (is_symbol && pit_value_eq(fsym, rt->symbols[PIT_SYMBOL_SET]) && is_lexical_set(rt, c, args, &sort, &idx)) {
+            push_compile(rt, pit_value_cons_car(rt, pit_value_cons_cdr(rt, args)), false);
+            if (sort == VARIABLE_CAPTURED) push_emit(rt, PIT_OP(PIT_OP_SET_ENV, idx));
+            else if (is_boxed(rt, c, pit_value_cons_car(rt, pit_value_cons_cdr(rt, pit_value_cons_car(rt, args))))) push_emit(rt, PIT_OP(PIT_OP_SET_LOCAL, idx));
+            else push_emit(rt, PIT_OP(PIT_OP_SET_SLOT, idx));
+            reverse_entries(rt, start);
+        } else if (is_inline_lambda(rt, fsym, args)) {
+            /* ((lambda (x y) body) a b), which is what let expands to: bind x and y to new slots in this frame */
+            pit_value params = pit_value_cons_car(rt, pit_value_cons_cdr(rt, fsym));
+            pit_value scope = c->scope;
+            i64 n = 0, i;
+            for (pit_value a = args; a != PIT_NIL; a = pit_value_cons_cdr(rt, a)) {
+                push_compile(rt, pit_value_cons_car(rt, a), false);
+            }
+            for (pit_value p = params; p != PIT_NIL; p = pit_value_cons_cdr(rt, p), ++n) {
+                scope = pit_value_cons(rt, pit_value_cons(rt, pit_value_cons_car(rt, p), pit_value_integer_new(rt, c->slots + n)), scope);
+            }
+            if (c->slots + n > PIT_OP_OPERAND_MAX) { pit_error(rt, "too many local variables in function"); return; }
+            /* the arguments are on the stack in order, so the last parameter is bound first */
+            i = n;
+            for (pit_value p = pit_value_list_reverse(rt, params); p != PIT_NIL; p = pit_value_cons_cdr(rt, p)) {
+                push_emit(rt, PIT_OP(is_boxed(rt, c, pit_value_cons_car(rt, p)) ? PIT_OP_BIND : PIT_OP_BIND_SLOT, c->slots + --i));
+            }
+            push_scope(rt, c->slots + n, scope);
+            push_body(rt, c, pit_value_cons_cdr(rt, pit_value_cons_cdr(rt, fsym)), tail);
+            push_scope(rt, c->slots, c->scope);
+            reverse_entries(rt, start);
+        } else if (is_symbol && pit_symtab_is_symbol_special_form(rt, fsym)) {
+            /* special forms we don't know how to compile directly manipulate the evaluator's stacks */
+            emit(rt, PIT_OP(PIT_OP_EVAL, constant(rt, c, e)));
+        } else if (is_symbol && pit_symtab_is_symbol_macro(rt, fsym)) {
+            /* macros defined after the body was expanded */
+            push_compile(rt, pit_macroexpand(rt, e), tail);
+        } else if (is_symbol && (idx = intrinsic(rt, fsym, args)) >= 0) {
+            pit_annotated_ref *ann = pit_annotation_get(rt, pit_value_as_ref(rt, e));
+            push_compile(rt, pit_value_cons_car(rt, args), false);
+            push_compile(rt, pit_value_cons_car(rt, pit_value_cons_cdr(rt, args)), false);
+            push_emit(rt, PIT_OP(PIT_OP_INTRINSIC, idx));
+            push_emit(rt, constant(rt, c, fsym));
+            push_emit(rt, (u32) c->caches++);
+            push_emit(rt, ann == NULL ? 0 : PIT_SITE(ann->annotation.line, ann->annotation.column));
+            reverse_entries(rt, start);
+        } else {
+            pit_annotated_ref *ann = pit_annotation_get(rt, pit_value_as_ref(rt, e));
+            i64 argcount = 0;
+            if (is_symbol) {
+                push_emit(rt, PIT_OP(PIT_OP_FUNC, constant(rt, c, fsym)));
+                push_emit(rt, (u32) c->caches);
+            } else push_compile(rt, fsym, false);
+            while (args != PIT_NIL) {
+                push_compile(rt, pit_value_cons_car(rt, args), false);
+                args = pit_value_cons_cdr(rt, args);
+                argcount += 1;
+            }
+            if (argcount > PIT_OP_OPERAND_MAX) { pit_error(rt, "too many arguments in call"); return; }
+            push_emit(rt, PIT_OP(tail ? PIT_OP_TAIL_CALL : PIT_OP_CALL, argcount));
+            push_emit(rt, ann == NULL ? 0 : PIT_SITE(ann->annotation.line, ann->annotation.column));
+            push_emit(rt, is_symbol ? (u32) ++c->caches : 0); /* the cache the function was looked up through */
+            reverse_entries(rt, start);
+        }
+    } else if (pit_value_is_symbol(rt, e)) {
+        pit_symtab_entry *ent = pit_symtab_lookup(rt, e);
+        i64 idx;
+        if (ent == NULL) { pit_error(rt, "bad symbol"); return; }
+        if (ent->is_keyword || e == PIT_NIL || e == PIT_T) {
+            emit(rt, PIT_OP(PIT_OP_CONST, constant(rt, c, e)));
+        } else switch (resolve(rt, c, e, &idx)) {
+            case VARIABLE_LOCAL: emit(rt, PIT_OP(is_boxed(rt, c, e) ? PIT_OP_LOCAL : PIT_OP_SLOT, idx)); break;
+            case VARIABLE_CAPTURED: emit(rt, PIT_OP(PIT_OP_ENV, idx)); break;
+            case VARIABLE_GLOBAL: emit(rt, PIT_OP(PIT_OP_VAR, constant(rt, c, e))); break;
+        }
+    } else { /* other expressions evaluate to themselves! */
+        emit(rt, PIT_OP(PIT_OP_CONST, constant(rt, c, e)));
+    }
+}
+
+pit_value pit_compile(pit_runtime *rt, pit_value params, pit_value captured, pit_value top) {
+    compiler c;
+    i64 traversal_reset = rt->traversal->next;
+    pit_value ret = PIT_NIL;
+    c.code_reset = rt->code->next;
+    c.constants_reset = rt->constants->next;
+    c.scope = PIT_NIL;
+    c.slots = 0;
+    c.captured = captured;
+    c.caches = 0;
+    c.boxed = boxed_names(rt, top);
+    for (; params != PIT_NIL; params = pit_value_cons_cdr(rt, params), ++c.slots) {
+        pit_value param = pit_value_cons_car(rt, params);
+        c.scope = pit_value_cons(rt, pit_value_cons(rt, param, pit_value_integer_new(rt, c.slots)), c.scope);
+        /* arguments arrive as plain values, so captured parameters are moved into cells on entry */
+        if (is_boxed(rt, &c, param)) emit(rt, PIT_OP(PIT_OP_BOX, c.slots));
+    }
+    c.max_slots = c.slots;
+    push_emit(rt, PIT_OP(PIT_OP_RETURN, 0));
+    push_compile(rt, top, true);
+    while (rt->traversal->next > traversal_reset) {
+        pit_traversal_entry ent;
+        if (rt->error != PIT_NIL) goto end;
+        if (pit_vec_pop(pit_traversal_entry)(rt->traversal, &ent) < 0)
+            pit_error(rt, "compiler traversal underflow");
+        switch (ent.sort) {
+        case PIT_TRAVERSAL_ENTRY_COMPILE:
+        case PIT_TRAVERSAL_ENTRY_COMPILE_TAIL:
+            compile(rt, &c, ent.in.value, ent.sort == PIT_TRAVERSAL_ENTRY_COMPILE_TAIL);
+            break;
+        case PIT_TRAVERSAL_ENTRY_EMIT: {
+            i64 at = rt->code->next - c.code_reset;
+            emit(rt, ent.in.emit.word);
+            if (ent.in.emit.patch >= 0) {
+                pit_traversal_entry *target = pit_vec_get(pit_traversal_entry)(rt->traversal, ent.in.emit.patch);
+                if (target == NULL) pit_error(rt, "compiler jump link invalid");
+                else target->in.patch = at;
+            }
+            break;
+        }
+        case PIT_TRAVERSAL_ENTRY_PATCH: {
+            i64 here = rt->code->next - c.code_reset;
+            u32 *jump = pit_vec_get(u32)(rt->code, c.code_reset + ent.in.patch);
+            if (ent.in.patch < 0 || jump == NULL) pit_error(rt, "compiler produced a dangling jump");
+            else if (here > PIT_OP_OPERAND_MAX) pit_error(rt, "function too large to compile");
+            else *jump |= PIT_OP(0, here);
+            break;
+        }
+        case PIT_TRAVERSAL_ENTRY_SCOPE:
+            c.slots = pit_value_as_integer(rt, pit_value_cons_car(rt, ent.in.scope));
+            c.scope = pit_value_cons_cdr(rt, ent.in.scope);
+            if (c.slots > c.max_slots) c.max_slots = c.slots;
+            break;
+        default:
+            pit_error(rt, "unknown traversal entry");
+            goto end;
+        }
+    }
+    if (rt->error == PIT_NIL) {
+        ret = pit_value_proto_new(rt, c.max_slots,
+            pit_vec_get(u32)(rt->code, c.code_reset), rt->code->next - c.code_reset,
+            pit_vec_get(pit_value)(rt->constants, c.constants_reset), rt->constants->next - c.constants_reset,
+            c.caches
+        );
+    }
+end:
+    rt->traversal->next = traversal_reset;
+    rt->code->next = c.code_reset;
+    rt->constants->next = c.constants_reset;
+    return ret;
+}
@@ -6,9 +6,11 @@ i64 pit_dump_with_callback(
     pit_dump_callback cb, void *data
 ) {
     i64 traversal_reset = rt->traversal->next;
+    pit_value error_reset = rt->error; /* we might be dumping the error itself, so only stop for new errors */
     char *buf = start;
     char *end = start + buf_len;
     pit_value_heavy *h = NULL;
+    rt->error = PIT_NIL;
     pit_traversal_push_value(rt, rt->traversal, top);
     while (rt->traversal->next > traversal_reset) {
         pit_traversal_entry ent;
@@ -135,6 +137,7 @@ i64 pit_dump_with_callback(
     }
 end:
     rt->traversal->next = traversal_reset;
+    if (error_reset != PIT_NIL) rt->error = error_reset;
     return (i64) (buf - start);
 }
 
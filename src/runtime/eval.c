@@ -1,10 +1,121 @@
 #include <lcq/pit/runtime/eval.h>
 
+/* top-level forms are compiled to a function of no arguments, which we then call.
+   like other Lisps, we first split up top-level progn forms (and macros that expand to them),
+   so that each form is compiled after those before it have run; a macro defined by one form can be used by the next.
+   this runs the forms on expr_stack above expr_stack_reset, leaving the value of the last in ret.
+   if resumable, each form is a step, and this returns false when rt->fuel runs out,
+   either between forms or in the function one was compiled to (rt->eval_frames says which) */
+static bool eval_forms(pit_runtime *rt, i64 expr_stack_reset, pit_value *ret, bool resumable) {
+    while (rt->expr_stack->next > expr_stack_reset) {
+        pit_value cur = PIT_NIL;
+        pit_value fsym, f;
+        if (rt->error != PIT_NIL) return true;
+        if (resumable && --rt->fuel < 0) {
+            rt->fuel = 0;
+            return false;
+        }
+        if (pit_vec_pop(pit_value)(rt->expr_stack, &cur) < 0)
+            pit_error(rt, "evaluation stack underflow");
+        fsym = pit_value_is_cons(rt, cur) ? pit_value_cons_car(rt, cur) : PIT_NIL;
+        if (pit_value_is_symbol(rt, fsym) && fsym != PIT_NIL) {
+            if (pit_symtab_is_symbol_macro(rt, fsym)) {
+                pit_value res = pit_macroexpand_form(rt, cur);
+                if (pit_vec_push(pit_value)(rt->expr_stack, res) < 0)
+                    pit_error(rt, "evaluation stack overflow");
+                continue;
+            }
+            if (pit_value_eq(fsym, rt->symbols[PIT_SYMBOL_PROGN])) {
+                /* push the body forms in reverse, so that they're popped in order */
+                i64 start = rt->expr_stack->next;
+                *ret = PIT_NIL;
+                for (pit_value forms = pit_value_cons_cdr(rt, cur); forms != PIT_NIL; forms = pit_value_cons_cdr(rt, forms)) {
+                    if (pit_vec_push(pit_value)(rt->expr_stack, pit_value_cons_car(rt, forms)) < 0)
+                        pit_error(rt, "evaluation stack overflow");
+                }
+                for (i64 lo = start, hi = rt->expr_stack->next - 1; lo < hi; ++lo, --hi) {
+                    pit_value *a = pit_vec_get(pit_value)(rt->expr_stack, lo);
+                    pit_value *b = pit_vec_get(pit_value)(rt->expr_stack, hi);
+                    pit_value tmp = *a; *a = *b; *b = tmp;
+                }
+                continue;
+            }
+        }
+        f = pit_value_func_new(rt, PIT_NIL, PIT_NIL, PIT_NIL, pit_macroexpand(rt, cur));
+        if (rt->error != PIT_NIL) return true;
+        if (resumable) {
+            bool suspended = false;
+            rt->eval_frames = rt->frames->next;
+            rt->eval_stack = rt->result_stack->next;
+            *ret = pit_vm_start(rt, f, &suspended);
+            if (suspended) return false;
+            rt->eval_frames = rt->eval_stack = -1;
+        } else {
+            *ret = pit_vm_apply(rt, f, PIT_NIL);
+        }
+    }
+    return true;
+}
+
 pit_value pit_eval(pit_runtime *rt, pit_value top) {
+    i64 expr_stack_reset = rt->expr_stack->next;
+    pit_value ret = PIT_NIL;
+    if (pit_vec_push(pit_value)(rt->expr_stack, top) < 0)
+        pit_error(rt, "evaluation stack overflow");
+    eval_forms(rt, expr_stack_reset, &ret, false);
+    rt->expr_stack->next = expr_stack_reset;
+    return rt->error == PIT_NIL ? ret : PIT_NIL;
+}
+
+void pit_eval_start(pit_runtime *rt, pit_value e) {
+    if (rt->eval_forms >= 0) { pit_error(rt, "an evaluation is already in progress"); return; }
+    rt->eval_forms = rt->expr_stack->next;
+    rt->eval_frames = rt->eval_stack = -1;
+    rt->eval_value = PIT_NIL;
+    if (pit_vec_push(pit_value)(rt->expr_stack, e) < 0)
+        pit_error(rt, "evaluation stack overflow");
+}
+
+bool pit_eval_resume(pit_runtime *rt, i64 budget, pit_value *result) {
+    bool done = true;
+    *result = PIT_NIL;
+    if (rt->eval_forms < 0) { pit_error(rt, "no evaluation is in progress"); return true; }
+    rt->fuel = budget;
+    if (rt->error == PIT_NIL && rt->eval_frames >= 0) {
+        /* finish the function the evaluation was suspended in before moving on to the next form */
+        bool suspended = false;
+        pit_value v = pit_vm_resume(rt, rt->eval_frames, rt->eval_stack, &suspended);
+        if (suspended) return false;
+        rt->eval_value = v;
+        rt->eval_frames = rt->eval_stack = -1;
+    }
+    if (rt->error == PIT_NIL) done = eval_forms(rt, rt->eval_forms, &rt->eval_value, true);
+    if (!done) return false;
+    if (rt->error == PIT_NIL) *result = rt->eval_value;
+    pit_eval_abandon(rt);
+    return true;
+}
+
+void pit_eval_abandon(pit_runtime *rt) {
+    if (rt->eval_forms < 0) return;
+    if (rt->eval_frames >= 0 && rt->frames->next > rt->eval_frames) {
+        pit_frame *bottom = pit_vec_get(pit_frame)(rt->frames, rt->eval_frames);
+        if (rt->profiling) pit_profile_unwind(rt, rt->eval_frames);
+        pit_vm_coroutines_unwind(rt, rt->eval_frames);
+        rt->calls->next = bottom->calls;
+        rt->frames->next = rt->eval_frames;
+        rt->result_stack->next = rt->eval_stack;
+    }
+    rt->expr_stack->next = rt->eval_forms;
+    rt->eval_forms = rt->eval_frames = rt->eval_stack = -1;
+    rt->eval_value = PIT_NIL;
+}
+
+pit_value pit_interpret(pit_runtime *rt, pit_value top) {
     i64 expr_stack_reset = rt->expr_stack->next;
     i64 result_stack_reset = rt->result_stack->next;
     i64 traversal_reset = rt->traversal->next;
-    // pit_vec_reset(pit_annotated_ref)(rt->backtrace);
+    rt->gc_inhibit += 1; /* special forms hold on to values, and applications to their annotations */
     if (pit_vec_push(pit_value)(rt->expr_stack, top) < 0)
         pit_error(rt, "evaluation stack overflow");
     /* first, convert the expression tree into "polish notation" in traversal */
@@ -17,16 +128,17 @@ pit_value pit_eval(pit_runtime *rt, pit_value top) {
             pit_value fsym = pit_value_cons_car(rt, cur);
             bool is_symbol = pit_value_is_symbol(rt, fsym);
             pit_annotated_ref *ann = pit_annotation_get(rt, pit_value_as_ref(rt, cur));
-            if (is_symbol && pit_symtab_is_symbol_special_form(rt, fsym)) { /* special forms */
-                pit_value f = pit_symtab_fget(rt, fsym);
+            /* look the symbol up once, rather than once each to check for special forms, macros and functions */
+            pit_symtab_entry *fent = is_symbol ? pit_symtab_lookup(rt, fsym) : NULL;
+            if (is_symbol && !fent) { pit_error(rt, "bad symbol"); goto end; }
+            if (fent && fent->is_special_form) { /* special forms */
+                pit_value f = pit_value_cell_get(rt, fent->function, fsym);
                 pit_value args = pit_value_cons_cdr(rt, cur);
                 /* special forms are nativefuncs that directly manipulate the stacks
                    basically macros, but we don't need to evaluate the return value */
                 pit_value_apply(rt, f, args);
-            } else if (is_symbol && pit_symtab_is_symbol_macro(rt, fsym)) { /* macros */
-                pit_value f = pit_symtab_fget(rt, fsym);
-                pit_value args = pit_value_cons_cdr(rt, cur);
-                pit_value res = pit_value_apply(rt, f, args);
+            } else if (fent && fent->is_macro) { /* macros */
+                pit_value res = pit_macroexpand_form(rt, cur);
                 if (pit_vec_push(pit_value)(rt->expr_stack, res) < 0)
                     pit_error(rt, "evaluation stack overflow");
             } else { /* normal functions */
@@ -44,7 +156,7 @@ pit_value pit_eval(pit_runtime *rt, pit_value top) {
                 }
                 pit_traversal_push_application(rt, rt->traversal, argcount, ann);
                 if (is_symbol) {
-                    pit_value f = pit_symtab_fget(rt, fsym);
+                    pit_value f = pit_value_cell_get(rt, fent->function, fsym);
                     pit_traversal_push_value(rt, rt->traversal, f);
                 }
             }
@@ -72,21 +184,29 @@ pit_value pit_eval(pit_runtime *rt, pit_value top) {
             break;
         case PIT_TRAVERSAL_ENTRY_APPLICATION: {
             pit_value f = PIT_NIL;
-            pit_value args = PIT_NIL;
-            if (pit_vec_pop(pit_value)(rt->result_stack, &f) < 0)
+            pit_value ret;
+            i64 argc = ent->in.application.arity;
+            i64 args_start;
+            i64 calls_reset = rt->calls->next;
+            if (pit_vec_pop(pit_value)(rt->result_stack, &f) < 0 || rt->result_stack->next < argc) {
                 pit_error(rt, "evaluation result stack underflow");
-            for (i64 i = 0; i < ent->in.application.arity; ++i) {
-                pit_value a = PIT_NIL;
-                if (pit_vec_pop(pit_value)(rt->result_stack, &a) < 0)
-                    pit_error(rt, "evaluation result stack underflow");
-                args = pit_value_cons(rt, a, args);
+                goto end;
             }
+            /* the arguments stay where they were evaluated, and are passed to the function in place */
+            args_start = rt->result_stack->next - argc;
             if (ent->in.application.annotation != NULL) {
                 rt->source_line = ent->in.application.annotation->annotation.line;
                 rt->source_column = ent->in.application.annotation->annotation.column;
-                pit_vec_push(pit_annotated_ref)(rt->backtrace, *ent->in.application.annotation);
+                pit_calls_push(rt, rt->source_line, rt->source_column);
+            } else {
+                pit_calls_push(rt, -1, -1);
             }
-            if (pit_vec_push(pit_value)(rt->result_stack, pit_value_apply(rt, f, args)) < 0)
+            if (rt->error != PIT_NIL) goto end;
+            ret = pit_value_apply_argv(rt, f, argc, pit_vec_get(pit_value)(rt->result_stack, args_start));
+            rt->result_stack->next = args_start;
+            if (rt->error != PIT_NIL) goto end; /* leave the call on the stack for the backtrace */
+            rt->calls->next = calls_reset;
+            if (pit_vec_push(pit_value)(rt->result_stack, ret) < 0)
                 pit_error(rt, "evaluation result stack underflow");
             break;
         }
@@ -102,6 +222,7 @@ end: {
         rt->expr_stack->next = expr_stack_reset;
         rt->result_stack->next = result_stack_reset;
         rt->traversal->next = traversal_reset;
+        rt->gc_inhibit -= 1;
         return ret;
     }
 }
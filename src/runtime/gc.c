@@ -1,44 +1,230 @@
 #include <lcq/pit/runtime/gc.h>
+#include <lcq/pit/runtime/jit.h>
 
-static i64 gc_copy(pit_runtime *rt, pit_value_heavy *h) {
+/* during an incremental collection the heap is tospace, and fromspace is the backbuffer. otherwise it's the other way around */
+static pit_arena *gc_fromspace(pit_runtime *rt) {
+    return rt->gc_phase == PIT_GC_IDLE ? rt->heap : rt->backbuffer;
+}
+static pit_arena *gc_tospace(pit_runtime *rt) {
+    return rt->gc_phase == PIT_GC_IDLE ? rt->backbuffer : rt->heap;
+}
+/* during an incremental collection, the value at r in fromspace was just copied to ret.
+   the mutator might look for the copy's annotation before the collection is over, so it goes straight into annotations */
+static void gc_carry_annotation(pit_runtime *rt, pit_ref r, pit_ref ret) {
+    i32 idx = rt->backbuffer_annotation_index[r];
+    pit_annotated_ref *a = idx > 0 ? pit_vec_get(pit_annotated_ref)(rt->annotations, idx - 1) : NULL;
+    rt->annotation_index[ret] = 0;
+    rt->expansion_index[ret] = 0; /* expansions are carried over once scanning is done */
+    if (a != NULL && a->ref == r) {
+        pit_annotated_ref moved = *a;
+        i64 n;
+        moved.ref = ret;
+        n = pit_vec_push(pit_annotated_ref)(rt->annotations, moved);
+        if (n < 0) rt->annotations->next -= 1; /* the copy just loses its source location */
+        else rt->annotation_index[ret] = (i32) (n + 1);
+    }
+}
+/* copy the young heavy value at r to tospace (unless it's already there), carrying its annotation along.
+   outside of incremental collections, it keeps its index, since tospace is laid out like the heap will be after the collection */
+static i64 gc_copy(pit_runtime *rt, pit_ref r, pit_value_heavy *h) {
     if (h->hsort == PIT_VALUE_HEAVY_SORT_FORWARDING_POINTER) {
         return h->in.forwarding_pointer;
     } else {
-        i64 ret = rt->backbuffer->next;
-        pit_value_heavy *g = pit_arena_alloc(rt->backbuffer);
+        pit_arena *tospace = gc_tospace(rt);
+        i64 ret = tospace->next;
+        pit_value_heavy *g = pit_arena_alloc(tospace);
         *g = *h;
+        g->remembered = false;
+        g->gray = true;
         h->hsort = PIT_VALUE_HEAVY_SORT_FORWARDING_POINTER;
         h->in.forwarding_pointer = ret;
+        if (rt->gc_phase != PIT_GC_IDLE) {
+            gc_carry_annotation(rt, r, ret);
+            rt->gc_copied += tospace->elem_size;
+            rt->gc_reclaimed -= 1; /* the flip counted it as freed */
+        } else {
+            pit_annotated_ref *ann = pit_annotation_get(rt, r);
+            if (ann != NULL) {
+                pit_annotated_ref newann = *ann;
+                newann.ref = ret;
+                if (pit_vec_push(pit_annotated_ref)(rt->backbuffer_annotations, newann) < 0) pit_error(rt, "annotation overflow");
+            }
+        }
         return ret;
     }
 }
 static pit_value gc_copy_value(pit_runtime *rt, pit_value v) {
     if (pit_value_sort(v) == PIT_VALUE_SORT_REF) {
         pit_ref r = pit_value_as_ref(rt, v);
-        pit_value_heavy *h = pit_value_ref_deref(rt, r);
-        i64 new = gc_copy(rt, h);
-        pit_annotated_ref *ann = pit_annotation_get(rt, r);
-        if (ann != NULL) {
-            pit_annotated_ref newann = *ann;
-            newann.ref = new;
-            if (pit_vec_push(pit_annotated_ref)(rt->backtrace, newann) < 0)
-                pit_error(rt, "annotation overflow");
-        }
-        return pit_value_ref_new(rt, new);
+        pit_value_heavy *h;
+        if (r < rt->gc_old) return v; /* old values stay where they are */
+        h = pit_arena_get(gc_fromspace(rt), r);
+        return pit_value_ref_new(rt, gc_copy(rt, r, h));
     } else {
         return v;
     }
 }
-void pit_gc(pit_runtime *rt) {
-    rt->frozen_values = 0;
-    rt->frozen_symtab = 0;
-    pit_arena *fromspace = rt->heap;
-    pit_arena *tospace = rt->backbuffer;
-    pit_vec(pit_annotated_ref) *fromspace_ann = rt->annotations;
-    pit_vec(pit_annotated_ref) *tospace_ann = rt->backtrace;
-    pit_arena_reset(tospace);
-    pit_vec_reset(pit_annotated_ref)(tospace_ann);
-    /* populate tospace with immediately reachable values */
+/* copy the young values that h refers to, and update h to refer to the copies */
+static void gc_trace(pit_runtime *rt, pit_value_heavy *h) {
+    switch (h->hsort) {
+    case PIT_VALUE_HEAVY_SORT_CELL:
+        h->in.cell = gc_copy_value(rt, h->in.cell);
+        break;
+    case PIT_VALUE_HEAVY_SORT_CONS:
+        h->in.cons.car = gc_copy_value(rt, h->in.cons.car);
+        h->in.cons.cdr = gc_copy_value(rt, h->in.cons.cdr);
+        break;
+    case PIT_VALUE_HEAVY_SORT_ARRAY:
+        for (i64 i = 0; i < h->in.array.len; ++i) {
+            h->in.array.data[i] = gc_copy_value(rt, h->in.array.data[i]);
+        }
+        break;
+    case PIT_VALUE_HEAVY_SORT_BYTES: break;
+    case PIT_VALUE_HEAVY_SORT_FUNC:
+        h->in.func.env = gc_copy_value(rt, h->in.func.env);
+        h->in.func.args = gc_copy_value(rt, h->in.func.args);
+        h->in.func.arg_rest_nm = gc_copy_value(rt, h->in.func.arg_rest_nm);
+        h->in.func.proto = gc_copy_value(rt, h->in.func.proto);
+        break;
+    case PIT_VALUE_HEAVY_SORT_PROTO:
+        h->in.proto.consts = gc_copy_value(rt, h->in.proto.consts);
+        break;
+    case PIT_VALUE_HEAVY_SORT_COROUTINE:
+        h->in.coroutine.func = gc_copy_value(rt, h->in.coroutine.func);
+        h->in.coroutine.saved = gc_copy_value(rt, h->in.coroutine.saved);
+        break;
+    case PIT_VALUE_HEAVY_SORT_NATIVEFUNC: break;
+    case PIT_VALUE_HEAVY_SORT_NATIVEDATA:
+        h->in.nativedata.tag = gc_copy_value(rt, h->in.nativedata.tag);
+        break;
+    case PIT_VALUE_HEAVY_SORT_FORWARDING_POINTER:
+        pit_error(rt, "garbage collection broken! encountered forwarding pointer in to-space");
+        break;
+    }
+}
+/* copy the bytestring, array or bytecode that the copied value h owns to the back of tospace */
+static void gc_copy_data(pit_arena *tospace, pit_value_heavy *h) {
+    switch (h->hsort) {
+    case PIT_VALUE_HEAVY_SORT_ARRAY: {
+        i64 byte_len = 0; pit_mul(&byte_len, sizeof(pit_value), h->in.array.len);
+        pit_value *data = pit_arena_alloc_back(tospace, byte_len);
+        for (i64 i = 0; i < h->in.array.len; ++i) {
+            data[i] = h->in.array.data[i];
+        }
+        h->in.array.data = data;
+        break;
+    }
+    case PIT_VALUE_HEAVY_SORT_BYTES: {
+        u8 *data = pit_arena_alloc_back(tospace, h->in.bytes.len);
+        for (i64 i = 0; i < h->in.bytes.len; ++i) {
+            data[i] = h->in.bytes.data[i];
+        }
+        h->in.bytes.data = data;
+        break;
+    }
+    case PIT_VALUE_HEAVY_SORT_PROTO: {
+        i64 byte_len = 0; pit_mul(&byte_len, sizeof(u32), h->in.proto.len);
+        i64 caches_len = 0; pit_mul(&caches_len, sizeof(pit_inline_cache), h->in.proto.ncaches);
+        pit_proto_jit *jit = pit_arena_alloc_back(tospace, (i64) sizeof(pit_proto_jit) + caches_len + byte_len);
+        pit_inline_cache *caches = (pit_inline_cache *) (void *) (jit + 1);
+        u32 *code = (u32 *) (void *) (caches + h->in.proto.ncaches);
+        *jit = *pit_value_proto_jit(h); /* machine code lives outside the heap, so it doesn't move */
+        for (i64 i = 0; i < h->in.proto.ncaches; ++i) { /* cached functions move, so start over */
+            caches[i].epoch = 0;
+            caches[i].f = PIT_NIL;
+            caches[i].h = NULL;
+            caches[i].jit_epoch = 0;
+        }
+        for (i64 i = 0; i < h->in.proto.len; ++i) {
+            code[i] = h->in.proto.code[i];
+        }
+        h->in.proto.code = code;
+        break;
+    }
+    default: break;
+    }
+}
+/* scan the gray value h in tospace: copy its bytestring, array or bytecode, and the values it refers to */
+static void gc_blacken(pit_runtime *rt, pit_arena *tospace, pit_value_heavy *h) {
+    i64 back = tospace->back;
+    gc_copy_data(tospace, h);
+    if (rt->gc_phase != PIT_GC_IDLE) rt->gc_copied += back - tospace->back;
+    gc_trace(rt, h);
+    h->gray = false;
+}
+/* copy everything referred to by values in tospace from index scan onwards; returns the new end of tospace */
+static i64 gc_scan(pit_runtime *rt, pit_arena *tospace, i64 scan) {
+    for (; scan < tospace->next; ++scan) gc_blacken(rt, tospace, pit_arena_get(tospace, scan));
+    return scan;
+}
+/* expansions are remembered only as long as their macro application is reachable otherwise.
+   keeping an expansion can make other applications reachable, so repeat until nothing changes.
+   applications that are old are kept, and only expansions made since the last collection can refer to young values */
+static void gc_copy_expansions(pit_runtime *rt, pit_arena *tospace, i64 scan) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (i64 i = rt->gc_old_expansions; i < rt->expansions->next; ++i) {
+            pit_expansion *e = pit_vec_get(pit_expansion)(rt->expansions, i);
+            pit_value_heavy *h;
+            pit_expansion moved;
+            if (e == NULL || e->ref < 0 || e->epoch != rt->macro_epoch) continue;
+            if (rt->expansion_index[e->ref] != (i32) (i + 1)) continue; /* superseded, or the ref was reused */
+            if (e->ref < rt->gc_old) {
+                moved.ref = e->ref;
+            } else {
+                h = pit_value_ref_deref(rt, e->ref);
+                if (h == NULL || h->hsort != PIT_VALUE_HEAVY_SORT_FORWARDING_POINTER) continue;
+                moved.ref = h->in.forwarding_pointer;
+            }
+            moved.expansion = gc_copy_value(rt, e->expansion);
+            moved.epoch = e->epoch;
+            e->ref = -1;
+            if (pit_vec_push(pit_expansion)(rt->backbuffer_expansions, moved) < 0) rt->backbuffer_expansions->next -= 1;
+            changed = true;
+        }
+        scan = gc_scan(rt, tospace, scan);
+    }
+}
+/* replace the entries in annotations and expansions made since the last collection with the ones that were kept,
+   which are now all for old values */
+static void gc_replace_entries(pit_runtime *rt, i64 end) {
+    for (i64 i = rt->gc_old_annotations; i < rt->annotations->next; ++i) { /* old values annotated since */
+        pit_annotated_ref *a = pit_vec_get(pit_annotated_ref)(rt->annotations, i);
+        if (a == NULL || a->ref >= rt->gc_old || rt->annotation_index[a->ref] != (i32) (i + 1)) continue;
+        if (pit_vec_push(pit_annotated_ref)(rt->backbuffer_annotations, *a) < 0) pit_error(rt, "annotation overflow");
+    }
+    for (i64 r = rt->gc_old; r < end; ++r) {
+        rt->annotation_index[r] = 0;
+        rt->expansion_index[r] = 0;
+    }
+    rt->annotations->next = rt->gc_old_annotations;
+    for (i64 i = 0; i < rt->backbuffer_annotations->next; ++i) {
+        pit_annotated_ref *a = pit_vec_get(pit_annotated_ref)(rt->backbuffer_annotations, i);
+        i64 idx;
+        if (a == NULL) break;
+        idx = pit_vec_push(pit_annotated_ref)(rt->annotations, *a);
+        if (idx < 0) { pit_error(rt, "annotation overflow"); break; }
+        rt->annotation_index[a->ref] = (i32) (idx + 1);
+    }
+    rt->expansions->next = rt->gc_old_expansions;
+    for (i64 i = 0; i < rt->backbuffer_expansions->next; ++i) {
+        pit_expansion *e = pit_vec_get(pit_expansion)(rt->backbuffer_expansions, i);
+        i64 idx;
+        if (e == NULL) break;
+        idx = pit_vec_push(pit_expansion)(rt->expansions, *e);
+        if (idx < 0) { rt->expansions->next -= 1; break; }
+        rt->expansion_index[e->ref] = (i32) (idx + 1);
+    }
+    pit_vec_reset(pit_annotated_ref)(rt->backbuffer_annotations);
+    pit_vec_reset(pit_expansion)(rt->backbuffer_expansions);
+}
+static void *gc_rebase(pit_arena *from, pit_arena *to, void *p) {
+    return &to->data[(u8 *) p - from->data];
+}
+/* copy the values the runtime refers to directly, and the young values that old ones refer to */
+static void gc_copy_roots(pit_runtime *rt) {
+    i64 kept = 0;
     for (i64 i = 0; i < rt->symtab->next; ++i) {
         pit_symtab_entry *ent = pit_vec_get(pit_symtab_entry)(rt->symtab, i);
         if (ent == NULL) continue; /* TODO warn on failure here? */
@@ -50,51 +236,397 @@ void pit_gc(pit_runtime *rt) {
         pit_value *v = pit_vec_get(pit_value)(rt->saved_bindings, i);
         if (v != NULL) *v = gc_copy_value(rt, *v); /* TODO warn on failure here? */
     }
-    for (i64 scan = 0; scan < tospace->next; ++scan) {
-        pit_value_heavy *h = pit_arena_get(tospace, scan);
-        switch (h->hsort) {
-        case PIT_VALUE_HEAVY_SORT_CELL:
-            h->in.cell = gc_copy_value(rt, h->in.cell);
-            break;
-        case PIT_VALUE_HEAVY_SORT_CONS:
-            h->in.cons.car = gc_copy_value(rt, h->in.cons.car);
-            h->in.cons.cdr = gc_copy_value(rt, h->in.cons.cdr);
-            break;
-        case PIT_VALUE_HEAVY_SORT_ARRAY: {
-            i64 byte_len = 0; pit_mul(&byte_len, sizeof(pit_value), h->in.array.len);
-            pit_value *data = pit_arena_alloc_back(tospace, byte_len);
-            for (i64 i = 0; i < h->in.array.len; ++i) {
-                data[i] = gc_copy_value(rt, h->in.array.data[i]);
+    for (i64 i = 0; i < rt->profile->next; ++i) { /* profiled functions are kept until the profile is cleared */
+        pit_profile_entry *e = pit_vec_get(pit_profile_entry)(rt->profile, i);
+        if (e != NULL) e->function = gc_copy_value(rt, e->function);
+    }
+    for (i64 i = 0; i < rt->coroutines->next; ++i) {
+        pit_coroutine_activation *act = pit_vec_get(pit_coroutine_activation)(rt->coroutines, i);
+        if (act != NULL) act->coroutine = gc_copy_value(rt, act->coroutine);
+    }
+    /* evaluation in progress (suspended, or below a safe point) keeps everything it needs on the stacks */
+    for (i64 i = 0; i < rt->expr_stack->next; ++i) {
+        pit_value *v = pit_vec_get(pit_value)(rt->expr_stack, i);
+        if (v != NULL) *v = gc_copy_value(rt, *v);
+    }
+    for (i64 i = 0; i < rt->result_stack->next; ++i) {
+        pit_value *v = pit_vec_get(pit_value)(rt->result_stack, i);
+        if (v != NULL) *v = gc_copy_value(rt, *v);
+    }
+    for (i64 i = 0; i < rt->traversal->next; ++i) {
+        pit_traversal_entry *ent = pit_vec_get(pit_traversal_entry)(rt->traversal, i);
+        if (ent != NULL && ent->sort == PIT_TRAVERSAL_ENTRY_VALUE) ent->in.value = gc_copy_value(rt, ent->in.value);
+    }
+    for (i64 i = 0; i < rt->frames->next; ++i) {
+        pit_frame *fr = pit_vec_get(pit_frame)(rt->frames, i);
+        if (fr != NULL) fr->func = gc_copy_value(rt, fr->func);
+    }
+    for (i64 i = 0; i < rt->handles->next; ++i) {
+        pit_value *v = pit_vec_get(pit_value)(rt->handles, i);
+        if (v != NULL) *v = gc_copy_value(rt, *v);
+    }
+    rt->eval_value = gc_copy_value(rt, rt->eval_value);
+    for (i64 i = 0; i < rt->remembered->next; ++i) {
+        pit_ref *r = pit_vec_get(pit_ref)(rt->remembered, i);
+        pit_value_heavy *h;
+        if (r == NULL || *r >= rt->gc_old || (h = pit_value_ref_deref(rt, *r)) == NULL) continue; /* demoted since */
+        gc_trace(rt, h);
+        if (*r < rt->frozen_values) *pit_vec_get(pit_ref)(rt->remembered, kept++) = *r;
+        else h->remembered = false;
+    }
+    rt->remembered->next = kept;
+}
+/* the protos at refs from onwards in fromspace, among the first n entries of jit_code, were either copied or are gone.
+   point the entries for copies at them, and free the machine code of the rest */
+static void gc_sweep_jit(pit_runtime *rt, pit_arena *fromspace, pit_ref from, i64 n) {
+    i64 kept = 0;
+    for (i64 i = 0; i < rt->jit_code->next; ++i) {
+        pit_jit_entry *e = pit_vec_get(pit_jit_entry)(rt->jit_code, i);
+        if (i < n && e->proto >= from) {
+            pit_value_heavy *h = pit_arena_get(fromspace, e->proto);
+            if (h == NULL || h->hsort != PIT_VALUE_HEAVY_SORT_FORWARDING_POINTER) {
+                pit_jit_free(rt, e->native);
+                continue;
             }
-            h->in.array.data = data;
-            break;
+            e->proto = h->in.forwarding_pointer;
         }
-        case PIT_VALUE_HEAVY_SORT_BYTES: {
-            u8 *data = pit_arena_alloc_back(tospace, h->in.bytes.len);
-            for (i64 i = 0; i < h->in.bytes.len; ++i) {
-                data[i] = h->in.bytes.data[i];
+        *pit_vec_get(pit_jit_entry)(rt->jit_code, kept++) = *e;
+    }
+    rt->jit_code->next = kept;
+}
+/* copy the young values that are still reachable, and make them old */
+static void gc_collect(pit_runtime *rt) {
+    pit_arena *tospace = rt->backbuffer;
+    i64 end;
+    i64 allocated = rt->heap->next;
+    rt->epoch += 1; /* functions are about to move */
+    rt->gc_count += 1;
+    rt->gc_pending = false;
+    /* young values are copied to the same indices they'll have at the end, after the old values */
+    tospace->next = rt->gc_old;
+    tospace->back = rt->gc_old_back;
+    pit_vec_reset(pit_annotated_ref)(rt->backbuffer_annotations);
+    pit_vec_reset(pit_expansion)(rt->backbuffer_expansions);
+    gc_copy_roots(rt);
+    gc_copy_expansions(rt, tospace, gc_scan(rt, tospace, rt->gc_old));
+    end = tospace->next;
+    gc_sweep_jit(rt, rt->heap, rt->gc_old, rt->jit_code->next); /* while the forwarding pointers are still there */
+    gc_replace_entries(rt, end);
+    if (rt->gc_old == 0 && rt->gc_old_back == rt->heap->capacity) {
+        /* everything was copied, so tospace becomes the heap */
+        rt->backbuffer = rt->heap;
+        rt->heap = tospace;
+    } else {
+        /* otherwise the copies go back after the old values. only their bytestrings and arrays move */
+        pit_libc_string_memcpy(
+            &rt->heap->data[rt->gc_old * rt->heap->elem_size],
+            &tospace->data[rt->gc_old * tospace->elem_size],
+            (size_t) ((end - rt->gc_old) * tospace->elem_size));
+        pit_libc_string_memcpy(&rt->heap->data[tospace->back], &tospace->data[tospace->back], (size_t) (rt->gc_old_back - tospace->back));
+        rt->heap->next = end;
+        rt->heap->back = tospace->back;
+        for (i64 r = rt->gc_old; r < end; ++r) {
+            pit_value_heavy *h = pit_arena_get(rt->heap, r);
+            switch (h->hsort) {
+            case PIT_VALUE_HEAVY_SORT_ARRAY: h->in.array.data = gc_rebase(tospace, rt->heap, h->in.array.data); break;
+            case PIT_VALUE_HEAVY_SORT_BYTES: h->in.bytes.data = gc_rebase(tospace, rt->heap, h->in.bytes.data); break;
+            case PIT_VALUE_HEAVY_SORT_PROTO: h->in.proto.code = gc_rebase(tospace, rt->heap, h->in.proto.code); break;
+            default: break;
             }
-            h->in.bytes.data = data;
-            break;
         }
-        case PIT_VALUE_HEAVY_SORT_FUNC:
-            h->in.func.env = gc_copy_value(rt, h->in.func.env);
-            h->in.func.args = gc_copy_value(rt, h->in.func.args);
-            h->in.func.arg_rest_nm = gc_copy_value(rt, h->in.func.arg_rest_nm);
-            h->in.func.body = gc_copy_value(rt, h->in.func.body);
+    }
+    rt->gc_reclaimed += allocated - rt->heap->next;
+    rt->gc_old = rt->heap->next;
+    rt->gc_old_back = rt->heap->back;
+    rt->gc_old_annotations = rt->annotations->next;
+    rt->gc_old_expansions = rt->expansions->next;
+    pit_profile_moved(rt);
+}
+
+static i64 gc_young_bytes(pit_runtime *rt) {
+    return (rt->heap->next - rt->gc_old) * rt->heap->elem_size + (rt->gc_old_back - rt->heap->back);
+}
+static i64 gc_free_bytes(pit_runtime *rt) {
+    return rt->heap->back - rt->heap->next * rt->heap->elem_size;
+}
+static i64 gc_old_bytes(pit_runtime *rt) { /* frozen values don't count, since they're never collected */
+    return (rt->gc_old - rt->frozen_values) * rt->heap->elem_size + (rt->frozen_back - rt->gc_old_back);
+}
+/* whether the rest of fromspace might not fit in the room left in the heap, so the incremental collection can't wait */
+static bool gc_behind(pit_runtime *rt) {
+    return rt->gc_flipped - rt->gc_copied > gc_free_bytes(rt);
+}
+
+/* begin an incremental major collection. tospace becomes the heap straight away, so that the mutator only ever sees copies:
+   only the roots are copied now, and the values they refer to are scanned a few at a time afterwards.
+   frozen values aren't collected, but they're needed in both, so they're copied across along with their entries in the indices */
+static void gc_flip(pit_runtime *rt) {
+    pit_arena *fromspace = rt->heap;
+    pit_arena *tospace = rt->backbuffer;
+    i32 *index;
+    pit_gc_demote(rt);
+    rt->epoch += 1; /* functions are about to move */
+    rt->gc_count += 1;
+    rt->gc_pending = false;
+    rt->gc_flipped = gc_young_bytes(rt);
+    rt->gc_copied = rt->gc_stepped = 0;
+    rt->gc_reclaimed += fromspace->next - rt->frozen_values; /* copies are taken off this as they're made */
+    pit_libc_string_memcpy(tospace->data, fromspace->data, (size_t) (rt->frozen_values * fromspace->elem_size));
+    tospace->next = rt->frozen_values;
+    tospace->back = rt->frozen_back; /* frozen bytestrings and arrays stay where they are, and nothing is allocated over them */
+    rt->heap = tospace;
+    rt->backbuffer = fromspace;
+    index = rt->annotation_index;
+    rt->annotation_index = rt->backbuffer_annotation_index;
+    rt->backbuffer_annotation_index = index;
+    index = rt->expansion_index;
+    rt->expansion_index = rt->backbuffer_expansion_index;
+    rt->backbuffer_expansion_index = index;
+    pit_libc_string_memcpy((u8 *) rt->annotation_index, (u8 *) rt->backbuffer_annotation_index, (size_t) rt->frozen_values * sizeof(i32));
+    pit_libc_string_memcpy((u8 *) rt->expansion_index, (u8 *) rt->backbuffer_expansion_index, (size_t) rt->frozen_values * sizeof(i32));
+    rt->gc_phase = PIT_GC_SCAN;
+    rt->gc_scan = rt->frozen_values;
+    rt->gc_flip_annotations = rt->annotations->next;
+    rt->gc_flip_expansions = rt->expansions->next;
+    rt->gc_flip_jit = rt->jit_code->next;
+    gc_copy_roots(rt);
+    /* frozen macro applications are never collected, so their current expansions are roots too */
+    for (i64 i = rt->frozen_expansions; i < rt->gc_flip_expansions; ++i) {
+        pit_expansion *e = pit_vec_get(pit_expansion)(rt->expansions, i);
+        if (e == NULL || e->ref < 0 || e->ref >= rt->frozen_values || e->epoch != rt->macro_epoch) continue;
+        if (rt->expansion_index[e->ref] == (i32) (i + 1)) e->expansion = gc_copy_value(rt, e->expansion);
+    }
+    pit_profile_moved(rt);
+}
+/* carry the expansion at i in expansions over to the copy of its macro application, if the application has been copied.
+   the expansion is only kept as long as the application is reachable otherwise, like in gc_copy_expansions */
+static void gc_carry_expansion(pit_runtime *rt, i64 i) {
+    pit_expansion *e = pit_vec_get(pit_expansion)(rt->expansions, i);
+    pit_value_heavy *h;
+    pit_expansion moved;
+    i64 copies = rt->heap->next;
+    i64 n;
+    /* frozen applications' expansions were kept at the flip, and those carried over already have no ref */
+    if (e == NULL || e->ref < rt->frozen_values || e->epoch != rt->macro_epoch) return;
+    if (rt->backbuffer_expansion_index[e->ref] != (i32) (i + 1)) return; /* superseded */
+    h = pit_arena_get(rt->backbuffer, e->ref);
+    if (h == NULL || h->hsort != PIT_VALUE_HEAVY_SORT_FORWARDING_POINTER) return; /* not reachable, as far as we know yet */
+    moved.ref = h->in.forwarding_pointer;
+    e->ref = -1;
+    if (rt->expansion_index[moved.ref] != 0) return; /* the mutator expanded the copy itself */
+    moved.expansion = gc_copy_value(rt, e->expansion);
+    moved.epoch = e->epoch;
+    n = pit_vec_push(pit_expansion)(rt->expansions, moved);
+    if (n < 0) { rt->expansions->next -= 1; return; }
+    rt->expansion_index[moved.ref] = (i32) (n + 1);
+    if (rt->heap->next != copies) rt->gc_carried = true;
+}
+/* keep the entry of annotations at gc_cursor if it's current and not for fromspace, moving it down to gc_kept */
+static void gc_drop_annotation(pit_runtime *rt) {
+    i64 i = rt->gc_cursor++;
+    pit_annotated_ref *a = pit_vec_get(pit_annotated_ref)(rt->annotations, i);
+    if (a == NULL || (i < rt->gc_flip_annotations && a->ref >= rt->frozen_values)) return;
+    if (a->ref < 0 || a->ref >= rt->heap->next || rt->annotation_index[a->ref] != (i32) (i + 1)) return;
+    rt->annotation_index[a->ref] = (i32) (rt->gc_kept + 1);
+    *pit_vec_get(pit_annotated_ref)(rt->annotations, rt->gc_kept++) = *a;
+}
+/* and the same for the entry of expansions at gc_cursor */
+static void gc_drop_expansion(pit_runtime *rt) {
+    i64 i = rt->gc_cursor++;
+    pit_expansion *e = pit_vec_get(pit_expansion)(rt->expansions, i);
+    if (e == NULL || (i < rt->gc_flip_expansions && e->ref >= rt->frozen_values)) return;
+    if (e->ref < 0 || e->ref >= rt->heap->next || e->epoch != rt->macro_epoch || rt->expansion_index[e->ref] != (i32) (i + 1)) return;
+    rt->expansion_index[e->ref] = (i32) (rt->gc_kept + 1);
+    *pit_vec_get(pit_expansion)(rt->expansions, rt->gc_kept++) = *e;
+}
+/* the incremental collection is over. everything in the heap is old now, including what was allocated during it */
+static void gc_end(pit_runtime *rt) {
+    gc_sweep_jit(rt, rt->backbuffer, rt->frozen_values, rt->gc_flip_jit);
+    rt->gc_phase = PIT_GC_IDLE;
+    rt->gc_old = rt->heap->next;
+    rt->gc_old_back = rt->heap->back;
+    rt->gc_old_annotations = rt->annotations->next;
+    rt->gc_old_expansions = rt->expansions->next;
+    rt->gc_major = 2 * gc_old_bytes(rt) + rt->gc_nursery;
+}
+/* do up to budget units of the incremental collection's work: each is scanning a value, or looking at an entry */
+static void gc_work(pit_runtime *rt, i64 budget) {
+    while (budget > 0) {
+        switch (rt->gc_phase) {
+        case PIT_GC_IDLE: return;
+        case PIT_GC_SCAN:
+            if (rt->gc_scan < rt->heap->next) {
+                pit_value_heavy *h = pit_arena_get(rt->heap, rt->gc_scan++);
+                if (h->gray) { /* and values the mutator allocated since the flip aren't */
+                    gc_blacken(rt, rt->heap, h);
+                    budget -= 1;
+                }
+            } else {
+                rt->gc_phase = PIT_GC_CARRY_EXPANSIONS;
+                rt->gc_cursor = rt->frozen_expansions;
+                rt->gc_carried = false;
+            }
             break;
-        case PIT_VALUE_HEAVY_SORT_NATIVEFUNC: break;
-        case PIT_VALUE_HEAVY_SORT_NATIVEDATA:
-            h->in.nativedata.tag = gc_copy_value(rt, h->in.nativedata.tag);
+        case PIT_GC_CARRY_EXPANSIONS:
+            if (rt->gc_cursor < rt->gc_flip_expansions) {
+                gc_carry_expansion(rt, rt->gc_cursor++);
+                budget -= 1;
+            } else if (rt->gc_carried) {
+                rt->gc_phase = PIT_GC_SCAN; /* what was carried over might make more applications reachable */
+            } else {
+                rt->gc_phase = PIT_GC_DROP_ANNOTATIONS;
+                rt->gc_cursor = rt->gc_kept = rt->frozen_annotations;
+            }
             break;
-        case PIT_VALUE_HEAVY_SORT_FORWARDING_POINTER:
-            pit_error(rt, "garbage collection broken! encountered forwarding pointer in to-space");
+        case PIT_GC_DROP_ANNOTATIONS:
+            if (rt->gc_cursor < rt->annotations->next) {
+                gc_drop_annotation(rt);
+                budget -= 1;
+            } else {
+                rt->annotations->next = rt->gc_kept;
+                rt->gc_phase = PIT_GC_DROP_EXPANSIONS;
+                rt->gc_cursor = rt->gc_kept = rt->frozen_expansions;
+            }
+            break;
+        case PIT_GC_DROP_EXPANSIONS:
+            if (rt->gc_cursor < rt->expansions->next) {
+                gc_drop_expansion(rt);
+                budget -= 1;
+            } else {
+                rt->expansions->next = rt->gc_kept;
+                gc_end(rt);
+            }
             break;
         }
     }
-    rt->heap = tospace;
-    rt->backbuffer = fromspace;
-    rt->annotations = tospace_ann;
-    rt->backtrace = fromspace_ann;
-    pit_vec_reset(pit_annotated_ref)(rt->backtrace);
+}
+static void gc_step(pit_runtime *rt, i64 budget) {
+    gc_work(rt, budget);
+    rt->gc_stepped = gc_young_bytes(rt) - rt->gc_copied;
+}
+static void gc_finish(pit_runtime *rt) {
+    while (rt->gc_phase != PIT_GC_IDLE) gc_work(rt, rt->heap->capacity);
+}
+
+void pit_gc(pit_runtime *rt) {
+    gc_finish(rt); /* the values it copied might still refer to fromspace */
+    pit_gc_demote(rt);
+    gc_collect(rt);
+    rt->gc_major = 2 * gc_old_bytes(rt) + rt->gc_nursery; /* let the old generation double before collecting it again */
+}
+void pit_gc_minor(pit_runtime *rt) {
+    if (rt->gc_phase != PIT_GC_IDLE) gc_finish(rt); /* which leaves nothing young */
+    else gc_collect(rt);
+}
+void pit_gc_collect(pit_runtime *rt) {
+    i64 young = gc_young_bytes(rt);
+    rt->gc_pending = false;
+    if (!pit_gc_due(rt)) return;
+    if (rt->gc_phase != PIT_GC_IDLE) {
+        if (rt->gc_budget > 0 && !gc_behind(rt)) gc_step(rt, rt->gc_budget);
+        else gc_finish(rt);
+    } else if (young > gc_free_bytes(rt)) {
+        /* the heap is running out, and only a major collection can make more room than young values take */
+        pit_gc(rt);
+    } else if (gc_old_bytes(rt) + young > rt->gc_major) {
+        /* survivors are promoted, so if they'd take the old generation past its limit, it's time to collect that too */
+        if (rt->gc_budget > 0) {
+            gc_flip(rt);
+            gc_step(rt, rt->gc_budget);
+        } else {
+            pit_gc(rt);
+        }
+    } else {
+        pit_gc_minor(rt);
+    }
+}
+bool pit_gc_due(pit_runtime *rt) {
+    i64 young = gc_young_bytes(rt);
+    if (rt->gc_phase != PIT_GC_IDLE) { /* a step for every gc_budget values' worth of allocation */
+        return young - rt->gc_copied - rt->gc_stepped >= rt->gc_budget * rt->heap->elem_size || gc_behind(rt);
+    }
+    return young >= rt->gc_nursery || young > gc_free_bytes(rt);
+}
+void pit_gc_safepoint(pit_runtime *rt) {
+    if (rt->gc_pending && rt->gc_inhibit == 0) pit_gc_collect(rt);
+}
+bool pit_gc_step(pit_runtime *rt, i64 budget) {
+    i64 young = gc_young_bytes(rt);
+    if (rt->gc_phase == PIT_GC_IDLE) {
+        /* minor collections are already short, and if the heap is running out it's too late to collect a bit at a time */
+        if (gc_old_bytes(rt) + young <= rt->gc_major || young > gc_free_bytes(rt)) return false;
+        gc_flip(rt);
+    }
+    gc_step(rt, budget);
+    return rt->gc_phase != PIT_GC_IDLE;
+}
+void pit_gc_read_barrier(pit_runtime *rt, pit_ref r) {
+    pit_value_heavy *h = pit_arena_get(rt->heap, r);
+    if (rt->gc_phase == PIT_GC_IDLE) h->gray = false; /* left behind by an incremental collection that was abandoned */
+    else gc_blacken(rt, rt->heap, h);
+}
+
+void pit_gc_write_barrier(pit_runtime *rt, pit_ref r, pit_value v) {
+    pit_value_heavy *h;
+    if (r >= rt->gc_old || pit_value_sort(v) != PIT_VALUE_SORT_REF) return;
+    /* old values only need to remember young values, but frozen values need to remember anything that isn't frozen */
+    if (pit_value_as_ref(rt, v) < (r < rt->frozen_values ? rt->frozen_values : rt->gc_old)) return;
+    if ((h = pit_value_ref_deref(rt, r)) == NULL || h->remembered) return;
+    if (pit_vec_push(pit_ref)(rt->remembered, r) < 0) {
+        rt->remembered->next -= 1;
+        gc_finish(rt); /* demoting abandons an incremental collection */
+        if (r < rt->frozen_values) {
+            /* too many frozen values have changed to keep track of: give up on the frozen point,
+               so that collections copy everything like any other value */
+            rt->frozen_values = rt->frozen_symtab = 0;
+            rt->frozen_back = rt->heap->capacity;
+            rt->frozen_annotations = rt->frozen_expansions = 0;
+        }
+        /* too many to remember: make everything young, so that the next collection copies it all */
+        pit_gc_demote(rt);
+        return;
+    }
+    h->remembered = true;
+}
+void pit_gc_demote(pit_runtime *rt) {
+    i64 kept = 0;
+    rt->gc_phase = PIT_GC_IDLE; /* any incremental collection was either finished, or copied values that have been discarded */
+    rt->gc_old = rt->frozen_values;
+    rt->gc_old_back = rt->frozen_back; /* the data of demoted values stays where it is until they're copied */
+    rt->gc_old_annotations = rt->frozen_annotations;
+    rt->gc_old_expansions = rt->frozen_expansions;
+    for (i64 i = 0; i < rt->remembered->next; ++i) {
+        pit_ref *e = pit_vec_get(pit_ref)(rt->remembered, i);
+        if (e != NULL && *e < rt->gc_old) *pit_vec_get(pit_ref)(rt->remembered, kept++) = *e;
+    }
+    rt->remembered->next = kept;
+}
+void pit_gc_promote(pit_runtime *rt) {
+    gc_finish(rt);
+    /* young values never had their flag checked, and copying a heavy value copies the flag too */
+    for (pit_ref r = rt->gc_old; r < rt->heap->next; ++r) {
+        pit_value_heavy *h = pit_arena_get(rt->heap, r);
+        if (h != NULL) h->remembered = false;
+    }
+    /* nothing is young now, so there's nothing to remember */
+    for (i64 i = 0; i < rt->remembered->next; ++i) {
+        pit_ref *e = pit_vec_get(pit_ref)(rt->remembered, i);
+        pit_value_heavy *h;
+        if (e != NULL && (h = pit_value_ref_deref(rt, *e)) != NULL) h->remembered = false;
+    }
+    pit_vec_reset(pit_ref)(rt->remembered);
+    rt->gc_old = rt->heap->next;
+    rt->gc_old_back = rt->heap->back;
+    rt->gc_old_annotations = rt->annotations->next;
+    rt->gc_old_expansions = rt->expansions->next;
+}
+
+pit_value *pit_handle_new(pit_runtime *rt, pit_value v) {
+    i64 idx = pit_vec_push(pit_value)(rt->handles, v);
+    if (idx < 0) {
+        rt->handles->next -= 1;
+        pit_error(rt, "too many handles");
+        return NULL;
+    }
+    return pit_vec_get(pit_value)(rt->handles, idx);
 }
@@ -0,0 +1,803 @@
+#include <lcq/pit/runtime/jit.h>
+
+#if defined(__x86_64__)
+
+/* generated code keeps the VM's state in callee-saved registers, so that calls into the runtime preserve it */
+enum { RAX=0, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+#define ST RBX /* pit_jit_state * */
+#define RT RBP /* pit_runtime * */
+#define SP R12 /* next free entry on the evaluation stack */
+#define SLOTS R13
+#define CONSTS R14
+#define CACHES R15
+
+/* condition codes, as the low nibble of jcc and setcc */
+enum { CC_B=0x2, CC_AE=0x3, CC_E=0x4, CC_NE=0x5, CC_A=0x7, CC_L=0xc, CC_GE=0xd, CC_LE=0xe, CC_G=0xf };
+
+#define INTEGER_TAG 0xfff2000000000000 /* see IS_INTEGER in vm.c */
+
+/* offsets of the fields generated code uses */
+#define STATE(f) ((i64) offsetof(pit_jit_state, f))
+#define RUNTIME(f) ((i64) offsetof(pit_runtime, f))
+#define CACHE(f) ((i64) offsetof(pit_inline_cache, f))
+#define NATIVE(f) ((i64) offsetof(pit_jit_code, f))
+#define RECORD(f) ((i64) offsetof(pit_jit_frame, f))
+/* every vec has the same layout */
+#define VEC(f) ((i64) offsetof(pit_vec(pit_frame), f))
+/* a field of the frame just below index n in frames (the innermost one, if n is frames->next), relative to frames + n * sizeof(pit_frame) */
+#define FRAME_BELOW(f) (VEC(data) - (i64) sizeof(pit_frame) + (i64) offsetof(pit_frame, f))
+
+/* code is generated twice: once without a buffer to measure it and find where each instruction goes,
+   and then again into memory from the host */
+typedef struct {
+    u8 *buf; /* NULL while measuring */
+    i64 len;
+    u32 *labels; /* offset of the machine code for each bytecode instruction */
+    u32 *exits; /* offset of the code that hands each instruction to the interpreter */
+    i64 exit; /* offset of the code that hands back to the interpreter */
+} assembler;
+
+static void byte(assembler *a, u8 b) {
+    if (a->buf) a->buf[a->len] = b;
+    a->len += 1;
+}
+static void word32(assembler *a, u32 w) {
+    for (i64 i = 0; i < 4; ++i) byte(a, (u8) (w >> (8 * i)));
+}
+static void word64(assembler *a, u64 w) {
+    for (i64 i = 0; i < 8; ++i) byte(a, (u8) (w >> (8 * i)));
+}
+/* REX.W prefix for a ModRM byte with the given reg and rm fields */
+static void rex(assembler *a, i64 reg, i64 rm) {
+    byte(a, (u8) (0x48 | (reg >> 3) << 2 | (rm >> 3)));
+}
+/* opcode with operands reg and [base + disp] */
+static void op_mem(assembler *a, u8 opcode, i64 reg, i64 base, i64 disp) {
+    rex(a, reg, base);
+    byte(a, opcode);
+    byte(a, (u8) (0x80 | (reg & 7) << 3 | (base & 7)));
+    if ((base & 7) == RSP) byte(a, 0x24); /* r12 as a base needs a SIB byte */
+    word32(a, (u32) disp);
+}
+/* opcode with operands reg and rm, both registers */
+static void op_reg(assembler *a, u8 opcode, i64 reg, i64 rm) {
+    rex(a, reg, rm);
+    byte(a, opcode);
+    byte(a, (u8) (0xc0 | (reg & 7) << 3 | (rm & 7)));
+}
+static void load(assembler *a, i64 dst, i64 base, i64 disp) { op_mem(a, 0x8b, dst, base, disp); }
+static void store(assembler *a, i64 base, i64 disp, i64 src) { op_mem(a, 0x89, src, base, disp); }
+static void mov(assembler *a, i64 dst, i64 src) { op_reg(a, 0x89, src, dst); }
+static void mov_imm(assembler *a, i64 dst, u64 imm) {
+    rex(a, 0, dst);
+    byte(a, (u8) (0xb8 | (dst & 7)));
+    word64(a, imm);
+}
+/* arithmetic group 1 (add /0, or /1, and /4, sub /5, xor /6, cmp /7) with a 32-bit immediate */
+static void group1_imm(assembler *a, i64 ext, i64 dst, i32 imm) {
+    op_reg(a, 0x81, ext, dst);
+    word32(a, (u32) imm);
+}
+/* shifts (shl /4, shr /5, sar /7) by an immediate */
+static void shift_imm(assembler *a, i64 ext, i64 dst, u8 imm) {
+    op_reg(a, 0xc1, ext, dst);
+    byte(a, imm);
+}
+/* shifts by cl */
+static void shift_cl(assembler *a, i64 ext, i64 dst) { op_reg(a, 0xd3, ext, dst); }
+static void imul(assembler *a, i64 dst, i64 src) {
+    rex(a, dst, src);
+    byte(a, 0x0f);
+    byte(a, 0xaf);
+    byte(a, (u8) (0xc0 | (dst & 7) << 3 | (src & 7)));
+}
+/* dst = src * imm */
+static void imul_imm(assembler *a, i64 dst, i64 src, i32 imm) {
+    rex(a, dst, src);
+    byte(a, 0x69);
+    byte(a, (u8) (0xc0 | (dst & 7) << 3 | (src & 7)));
+    word32(a, (u32) imm);
+}
+static void push(assembler *a, i64 r) {
+    if (r >= R8) byte(a, 0x41);
+    byte(a, (u8) (0x50 | (r & 7)));
+}
+static void pop(assembler *a, i64 r) {
+    if (r >= R8) byte(a, 0x41);
+    byte(a, (u8) (0x58 | (r & 7)));
+}
+static void jmp(assembler *a, i64 target) {
+    byte(a, 0xe9);
+    word32(a, (u32) (target - (a->len + 4)));
+}
+static void jcc(assembler *a, u8 cc, i64 target) {
+    byte(a, 0x0f);
+    byte(a, (u8) (0x80 | cc));
+    word32(a, (u32) (target - (a->len + 4)));
+}
+/* jumps to code that hasn't been generated yet within the same instruction: land fills them in once it has */
+static i64 jcc_forward(assembler *a, u8 cc) {
+    jcc(a, cc, a->len + 6);
+    return a->len;
+}
+static void land(assembler *a, i64 at) {
+    u32 rel = (u32) (a->len - at);
+    if (a->buf) for (i64 i = 0; i < 4; ++i) a->buf[at - 4 + i] = (u8) (rel >> (8 * i));
+}
+/* mov r32, [base + disp], which clears the top half of r */
+static void load32(assembler *a, i64 dst, i64 base, i64 disp) {
+    if (dst >= R8 || base >= R8) byte(a, (u8) (0x40 | (dst >> 3) << 2 | (base >> 3)));
+    byte(a, 0x8b);
+    byte(a, (u8) (0x80 | (dst & 7) << 3 | (base & 7)));
+    if ((base & 7) == RSP) byte(a, 0x24);
+    word32(a, (u32) disp);
+}
+/* cmp byte [base + disp], 0 */
+static void test_flag(assembler *a, i64 base, i64 disp) {
+    if (base >= R8) byte(a, 0x41);
+    byte(a, 0x80);
+    byte(a, (u8) (0x80 | 7 << 3 | (base & 7)));
+    if ((base & 7) == RSP) byte(a, 0x24);
+    word32(a, (u32) disp);
+    byte(a, 0);
+}
+/* rax = cc ? PIT_T : PIT_NIL, comparing x with y */
+static void compare(assembler *a, u8 cc, i64 x, i64 y) {
+    byte(a, 0x31); byte(a, 0xc9); /* xor ecx, ecx */
+    op_reg(a, 0x39, y, x);
+    byte(a, 0x0f); byte(a, (u8) (0x90 | cc)); byte(a, 0xc1); /* setcc cl */
+    mov_imm(a, RAX, PIT_NIL);
+    op_reg(a, 0x01, RCX, RAX);
+}
+static void call(assembler *a, void (*f)(void)) {
+    mov_imm(a, RAX, (u64) (uintptr_t) f);
+    byte(a, 0xff); byte(a, 0xd0); /* call rax */
+}
+#define CALL(a, f) call(a, (void (*)(void)) (f))
+static void jmp_rax(assembler *a) { byte(a, 0xff); byte(a, 0xe0); }
+
+static void stack_push(assembler *a, i64 src) {
+    store(a, SP, 0, src);
+    group1_imm(a, 0, SP, 8);
+}
+/* the runtime might look at the evaluation stack, so its top has to be written back before calls */
+static void sync(assembler *a) { store(a, ST, (i64) offsetof(pit_jit_state, sp), SP); }
+/* hand back to the interpreter at instruction pc */
+static void exit_at(assembler *a, i64 pc) {
+    op_mem(a, 0xc7, 0, ST, (i64) offsetof(pit_jit_state, pc));
+    word32(a, (u32) pc);
+    jmp(a, a->exit);
+}
+/* leave through the slow path if the runtime has an error */
+static void check(assembler *a, i64 slow) {
+    mov_imm(a, RDX, PIT_NIL);
+    op_mem(a, 0x3b, RDX, RT, (i64) offsetof(pit_runtime, error));
+    jcc(a, CC_NE, slow);
+}
+/* leave through the slow path unless v is an integer */
+static void guard_integer(assembler *a, i64 v, i64 slow) {
+    mov(a, RAX, v);
+    shift_imm(a, 5, RAX, 49);
+    group1_imm(a, 7, RAX, (i32) (INTEGER_TAG >> 49));
+    jcc(a, CC_NE, slow);
+}
+/* truncate rax to 49 bits and tag it as an integer */
+static void tag_integer(assembler *a) {
+    shift_imm(a, 4, RAX, 15);
+    shift_imm(a, 5, RAX, 15);
+    mov_imm(a, RDX, INTEGER_TAG);
+    op_reg(a, 0x09, RDX, RAX);
+}
+static void sign_extend(assembler *a, i64 r) {
+    shift_imm(a, 4, r, 15);
+    shift_imm(a, 7, r, 15);
+}
+
+/* perform CLOSURE at pc, replacing the captured cells on top of the stack with the new closure */
+static void closure(pit_jit_state *st, i64 pc) {
+    pit_runtime *rt = st->rt;
+    pit_value template = st->consts[PIT_OP_OPERAND(st->code[pc])], env = PIT_NIL, v;
+    i64 n = st->code[pc + 1];
+    rt->result_stack->next = st->sp - st->stack;
+    if (n > 0) env = pit_value_array_from_buf(rt, st->sp - n, n);
+    st->sp -= n;
+    rt->result_stack->next = st->sp - st->stack;
+    v = pit_value_func_instantiate(rt, template, env);
+    if (rt->error == PIT_NIL) *st->sp++ = v;
+}
+
+/* the callee below the k arguments on top of the stack must be the closure that the call site's cache at ic was linked to,
+   and nothing else can need to see the call: otherwise, take the slow path */
+static void guard_link(assembler *a, i64 k, i64 ic, i64 slow) {
+    load(a, RAX, SP, -8 * (k + 1));
+    op_mem(a, 0x3b, RAX, CACHES, ic + CACHE(f));
+    jcc(a, CC_NE, slow);
+    load(a, RDX, CACHES, ic + CACHE(jit_epoch));
+    op_mem(a, 0x3b, RDX, RT, RUNTIME(epoch));
+    jcc(a, CC_NE, slow);
+    test_flag(a, RT, RUNTIME(profiling));
+    jcc(a, CC_NE, slow);
+    test_flag(a, RT, RUNTIME(gc_pending)); /* the safe point is left to the slow path */
+    jcc(a, CC_NE, slow);
+    test_flag(a, ST, STATE(suspendable));
+    jcc(a, CC_NE, slow);
+}
+/* the callee's slots will end at r: take the slow path unless its machine code has room on the stack after that */
+static void guard_stack(assembler *a, i64 r, i64 tmp, i64 native, i64 slow) {
+    load(a, tmp, native, NATIVE(len));
+    shift_imm(a, 4, tmp, 3);
+    op_reg(a, 0x01, r, tmp);
+    op_mem(a, 0x3b, tmp, ST, STATE(stack_end));
+    jcc(a, CC_A, slow);
+}
+/* write the call site's location to the entry of the call stack at r */
+static void call_site(assembler *a, u32 site, i64 r) {
+    mov_imm(a, RDX, site != 0 ? (u64) PIT_SITE_LINE(site) : (u64) -1);
+    store(a, r, VEC(data) + (i64) offsetof(pit_annotation, line), RDX);
+    if (site != 0) store(a, RT, RUNTIME(source_line), RDX);
+    mov_imm(a, RDX, site != 0 ? (u64) PIT_SITE_COLUMN(site) : (u64) -1);
+    store(a, r, VEC(data) + (i64) offsetof(pit_annotation, column), RDX);
+    if (site != 0) store(a, RT, RUNTIME(source_column), RDX);
+}
+/* with the arguments in place from SLOTS up to SP, clear the rest of the callee's slots and jump to its machine code */
+static void enter_linked(assembler *a, i64 ic) {
+    i64 top, done;
+    load(a, R11, CACHES, ic + CACHE(nslots));
+    shift_imm(a, 4, R11, 3);
+    op_reg(a, 0x01, SLOTS, R11);
+    mov_imm(a, RDX, PIT_NIL);
+    top = a->len;
+    op_reg(a, 0x39, R11, SP);
+    done = jcc_forward(a, CC_AE);
+    stack_push(a, RDX);
+    jmp(a, top);
+    land(a, done);
+    load(a, RDX, CACHES, ic + CACHE(env));
+    store(a, ST, STATE(env), RDX);
+    load(a, RDX, CACHES, ic + CACHE(native));
+    store(a, ST, STATE(native), RDX);
+    load(a, RDX, CACHES, ic + CACHE(code));
+    store(a, ST, STATE(code), RDX);
+    load(a, CONSTS, CACHES, ic + CACHE(consts));
+    load(a, RAX, CACHES, ic + CACHE(entry));
+    load(a, CACHES, CACHES, ic + CACHE(caches));
+    store(a, ST, STATE(slots), SLOTS);
+    store(a, ST, STATE(consts), CONSTS);
+    store(a, ST, STATE(caches), CACHES);
+    jmp_rax(a);
+}
+/* CALL at pc to the closure the call site is linked to: push a frame for it and its call site, as enter in vm.c does,
+   leaving this frame's state in rt->jit_frames for RETURN */
+static void call_linked(assembler *a, u32 *code, i64 pc, i64 slow) {
+    i64 k = PIT_OP_OPERAND(code[pc]);
+    i64 ic = (i64) sizeof(pit_inline_cache) * (code[pc + 2] - 1);
+    guard_link(a, k, ic, slow);
+    /* room for the call site */
+    load(a, RCX, RT, RUNTIME(calls));
+    load(a, RSI, RCX, VEC(next));
+    op_mem(a, 0x3b, RSI, RT, RUNTIME(calls_max));
+    jcc(a, CC_GE, slow);
+    imul_imm(a, RDI, RSI, sizeof(pit_annotation));
+    group1_imm(a, 0, RDI, sizeof(pit_annotation));
+    op_mem(a, 0x3b, RDI, RCX, VEC(capacity));
+    jcc(a, CC_G, slow);
+    /* the frame, and the record of this one */
+    load(a, R8, RT, RUNTIME(frames));
+    load(a, R9, R8, VEC(next));
+    imul_imm(a, R10, R9, sizeof(pit_frame));
+    group1_imm(a, 0, R10, sizeof(pit_frame));
+    op_mem(a, 0x3b, R10, R8, VEC(capacity));
+    jcc(a, CC_G, slow);
+    op_mem(a, 0x3b, R9, RT, RUNTIME(jit_frames_len));
+    jcc(a, CC_G, slow);
+    /* and the callee's slots and stack */
+    load(a, RDI, CACHES, ic + CACHE(nslots));
+    shift_imm(a, 4, RDI, 3);
+    op_reg(a, 0x01, SP, RDI);
+    group1_imm(a, 5, RDI, (i32) (8 * k));
+    load(a, R11, CACHES, ic + CACHE(native));
+    guard_stack(a, RDI, R11, R11, slow);
+    /* everything fits */
+    imul_imm(a, R10, R9, sizeof(pit_frame));
+    op_reg(a, 0x01, R8, R10);
+    imul_imm(a, R11, R9, sizeof(pit_jit_frame));
+    op_mem(a, 0x03, R11, RT, RUNTIME(jit_frames));
+    group1_imm(a, 5, R11, sizeof(pit_jit_frame));
+    load(a, RDI, R10, FRAME_BELOW(func));
+    store(a, R11, RECORD(func), RDI);
+    store(a, R11, RECORD(epoch), RDX);
+    store(a, R11, RECORD(consts), CONSTS);
+    store(a, R11, RECORD(caches), CACHES);
+    load(a, RDI, ST, STATE(env));
+    store(a, R11, RECORD(env), RDI);
+    load(a, RDI, ST, STATE(native));
+    store(a, R11, RECORD(native), RDI);
+    load(a, RDI, ST, STATE(code));
+    store(a, R11, RECORD(code), RDI);
+    mov_imm(a, RDI, (u64) (pc + 3));
+    store(a, R10, FRAME_BELOW(pc), RDI);
+    group1_imm(a, 0, R10, sizeof(pit_frame));
+    store(a, R10, FRAME_BELOW(func), RAX);
+    op_reg(a, 0x31, RDI, RDI);
+    store(a, R10, FRAME_BELOW(pc), RDI);
+    mov(a, RDI, SP);
+    op_mem(a, 0x2b, RDI, ST, STATE(stack));
+    shift_imm(a, 7, RDI, 3);
+    group1_imm(a, 5, RDI, (i32) (k + 1));
+    store(a, R10, FRAME_BELOW(base), RDI);
+    store(a, R10, FRAME_BELOW(calls), RSI);
+    group1_imm(a, 0, R9, 1);
+    store(a, R8, VEC(next), R9);
+    imul_imm(a, RDI, RSI, sizeof(pit_annotation));
+    op_reg(a, 0x01, RCX, RDI);
+    call_site(a, code[pc + 1], RDI);
+    group1_imm(a, 0, RSI, 1);
+    store(a, RCX, VEC(next), RSI);
+    mov(a, SLOTS, SP);
+    group1_imm(a, 5, SLOTS, (i32) (8 * k));
+    enter_linked(a, ic);
+}
+/* TAIL_CALL at pc to the closure the call site is linked to: it replaces the innermost frame and its call site */
+static void tail_call_linked(assembler *a, u32 *code, i64 pc, i64 slow) {
+    i64 k = PIT_OP_OPERAND(code[pc]);
+    i64 ic = (i64) sizeof(pit_inline_cache) * (code[pc + 2] - 1);
+    guard_link(a, k, ic, slow);
+    load(a, RCX, RT, RUNTIME(calls));
+    load(a, RSI, RCX, VEC(next));
+    op_mem(a, 0x3b, RSI, RT, RUNTIME(calls_max));
+    jcc(a, CC_GE, slow);
+    load(a, R8, RT, RUNTIME(frames));
+    load(a, R10, R8, VEC(next));
+    imul_imm(a, R10, R10, sizeof(pit_frame));
+    op_reg(a, 0x01, R8, R10);
+    /* the callee's slots start where the frame's do */
+    load(a, RDI, R10, FRAME_BELOW(base));
+    shift_imm(a, 4, RDI, 3);
+    op_mem(a, 0x03, RDI, ST, STATE(stack));
+    group1_imm(a, 0, RDI, 8);
+    load(a, R11, CACHES, ic + CACHE(nslots));
+    shift_imm(a, 4, R11, 3);
+    op_reg(a, 0x01, RDI, R11);
+    load(a, R9, CACHES, ic + CACHE(native));
+    guard_stack(a, R11, RDX, R9, slow);
+    /* slide the callee and its arguments down over the frame */
+    for (i64 i = 0; i <= k; ++i) {
+        load(a, RDX, SP, 8 * (i - k - 1));
+        store(a, RDI, 8 * (i - 1), RDX);
+    }
+    load(a, RSI, R10, FRAME_BELOW(calls));
+    imul_imm(a, R11, RSI, sizeof(pit_annotation));
+    op_reg(a, 0x01, RCX, R11);
+    call_site(a, code[pc + 1], R11);
+    group1_imm(a, 0, RSI, 1);
+    store(a, RCX, VEC(next), RSI);
+    store(a, R10, FRAME_BELOW(func), RAX);
+    op_reg(a, 0x31, RDX, RDX);
+    store(a, R10, FRAME_BELOW(pc), RDX);
+    mov(a, SLOTS, RDI);
+    mov(a, SP, RDI);
+    group1_imm(a, 0, SP, (i32) (8 * k));
+    enter_linked(a, ic);
+}
+/* RETURN to a frame that left its state in rt->jit_frames, and has machine code for where it continues */
+static void return_linked(assembler *a, i64 slow) {
+    load(a, R8, RT, RUNTIME(frames));
+    load(a, R9, R8, VEC(next));
+    mov(a, RAX, R9);
+    group1_imm(a, 5, RAX, 1);
+    op_mem(a, 0x3b, RAX, ST, STATE(frames_reset));
+    jcc(a, CC_LE, slow); /* the interpreter's run ends here */
+    op_mem(a, 0x3b, RAX, RT, RUNTIME(jit_frames_len));
+    jcc(a, CC_G, slow);
+    test_flag(a, RT, RUNTIME(profiling));
+    jcc(a, CC_NE, slow);
+    load(a, RCX, RT, RUNTIME(coroutines)); /* the frame might be the first of a coroutine */
+    load(a, RCX, RCX, VEC(next));
+    op_reg(a, 0x85, RCX, RCX);
+    jcc(a, CC_NE, slow);
+    imul_imm(a, R10, R9, sizeof(pit_frame));
+    op_reg(a, 0x01, R8, R10);
+    imul_imm(a, R11, R9, sizeof(pit_jit_frame));
+    op_mem(a, 0x03, R11, RT, RUNTIME(jit_frames));
+    group1_imm(a, 5, R11, 2 * sizeof(pit_jit_frame));
+    /* the caller's record must be current */
+    load(a, RDX, R10, FRAME_BELOW(func) - (i64) sizeof(pit_frame));
+    op_mem(a, 0x3b, RDX, R11, RECORD(func));
+    jcc(a, CC_NE, slow);
+    load(a, RDX, RT, RUNTIME(epoch));
+    op_mem(a, 0x3b, RDX, R11, RECORD(epoch));
+    jcc(a, CC_NE, slow);
+    load(a, RDI, R11, RECORD(native));
+    load(a, RCX, R10, FRAME_BELOW(pc) - (i64) sizeof(pit_frame));
+    imul_imm(a, RCX, RCX, sizeof(u32));
+    op_reg(a, 0x01, RDI, RCX);
+    load32(a, RDX, RCX, NATIVE(entries));
+    op_reg(a, 0x85, RDX, RDX);
+    jcc(a, CC_E, slow);
+    load(a, RAX, R10, FRAME_BELOW(base));
+    group1_imm(a, 0, RAX, 1);
+    shift_imm(a, 4, RAX, 3);
+    op_mem(a, 0x03, RAX, ST, STATE(stack));
+    guard_stack(a, RAX, RCX, RDI, slow);
+    /* pop the frame, leaving the value where the callee was */
+    load(a, RCX, SP, -8);
+    store(a, RAX, -8, RCX);
+    mov(a, SP, RAX);
+    load(a, RCX, R10, FRAME_BELOW(calls));
+    load(a, RSI, RT, RUNTIME(calls));
+    store(a, RSI, VEC(next), RCX);
+    group1_imm(a, 5, R9, 1);
+    store(a, R8, VEC(next), R9);
+    load(a, CONSTS, R11, RECORD(consts));
+    load(a, CACHES, R11, RECORD(caches));
+    load(a, RCX, R11, RECORD(env));
+    store(a, ST, STATE(env), RCX);
+    store(a, ST, STATE(native), RDI);
+    load(a, RCX, R11, RECORD(code));
+    store(a, ST, STATE(code), RCX);
+    load(a, SLOTS, R10, FRAME_BELOW(base) - (i64) sizeof(pit_frame));
+    group1_imm(a, 0, SLOTS, 1);
+    shift_imm(a, 4, SLOTS, 3);
+    op_mem(a, 0x03, SLOTS, ST, STATE(stack));
+    store(a, ST, STATE(slots), SLOTS);
+    store(a, ST, STATE(consts), CONSTS);
+    store(a, ST, STATE(caches), CACHES);
+    load(a, RAX, RDI, NATIVE(code));
+    op_reg(a, 0x01, RDX, RAX);
+    jmp_rax(a);
+}
+/* hand the instruction at pc to one of the VM's helpers, and continue wherever it says to, or in the interpreter */
+static void call_vm(assembler *a, u8 *(*helper)(pit_jit_state *st, i64 pc), i64 pc) {
+    sync(a);
+    mov(a, RDI, ST);
+    mov_imm(a, RSI, (u64) pc);
+    CALL(a, helper);
+    load(a, SP, ST, STATE(sp));
+    op_reg(a, 0x85, RAX, RAX);
+    jcc(a, CC_E, a->exit);
+    load(a, SLOTS, ST, STATE(slots));
+    load(a, CONSTS, ST, STATE(consts));
+    load(a, CACHES, ST, STATE(caches));
+    jmp_rax(a);
+}
+
+/* number of words taken by the instruction w, including the words after it */
+static i64 instruction_words(u32 w) {
+    switch (PIT_OP_CODE(w)) {
+    case PIT_OP_FUNC: case PIT_OP_CLOSURE: return 2;
+    case PIT_OP_CALL: case PIT_OP_TAIL_CALL: return 3;
+    case PIT_OP_INTRINSIC: return 4;
+    default: return 1;
+    }
+}
+
+/* translate the instruction at pc. returns false if it's left to the interpreter.
+   when a guard fails, the code jumps to exits[pc], which hands the instruction to the interpreter instead,
+   or to the VM's helpers for calls and returns */
+static bool translate(assembler *a, u32 *code, i64 pc) {
+    u32 w = code[pc];
+    i64 k = PIT_OP_OPERAND(w);
+    i64 slow = a->exits[pc];
+    switch (PIT_OP_CODE(w)) {
+    case PIT_OP_CONST:
+        load(a, RAX, CONSTS, 8 * k);
+        stack_push(a, RAX);
+        return true;
+    case PIT_OP_SLOT:
+    case PIT_OP_CELL_LOCAL:
+        load(a, RAX, SLOTS, 8 * k);
+        stack_push(a, RAX);
+        return true;
+    case PIT_OP_CELL_ENV:
+        load(a, RAX, ST, (i64) offsetof(pit_jit_state, env));
+        load(a, RAX, RAX, 8 * k);
+        stack_push(a, RAX);
+        return true;
+    case PIT_OP_SET_SLOT:
+        load(a, RAX, SP, -8);
+        store(a, SLOTS, 8 * k, RAX);
+        return true;
+    case PIT_OP_BIND_SLOT:
+        group1_imm(a, 5, SP, 8);
+        load(a, RAX, SP, 0);
+        store(a, SLOTS, 8 * k, RAX);
+        return true;
+    case PIT_OP_POP:
+        group1_imm(a, 5, SP, 8);
+        return true;
+    case PIT_OP_JUMP:
+        jmp(a, a->labels[k]);
+        return true;
+    case PIT_OP_JUMP_NIL:
+        group1_imm(a, 5, SP, 8);
+        load(a, RAX, SP, 0);
+        mov_imm(a, RDX, PIT_NIL);
+        op_reg(a, 0x39, RDX, RAX);
+        jcc(a, CC_E, a->labels[k]);
+        return true;
+    case PIT_OP_JUMP_NOT_NIL_OR_POP:
+        load(a, RAX, SP, -8);
+        mov_imm(a, RDX, PIT_NIL);
+        op_reg(a, 0x39, RDX, RAX);
+        jcc(a, CC_NE, a->labels[k]);
+        group1_imm(a, 5, SP, 8);
+        return true;
+    default: break;
+    }
+    /* the rest might take the slow path */
+    switch (PIT_OP_CODE(w)) {
+    case PIT_OP_VAR:
+        sync(a);
+        mov(a, RDI, RT);
+        load(a, RSI, CONSTS, 8 * k);
+        CALL(a, pit_symtab_get);
+        check(a, slow);
+        stack_push(a, RAX);
+        break;
+    case PIT_OP_FUNC: {
+        i64 ic = (i64) sizeof(pit_inline_cache) * code[pc + 1];
+        load(a, RAX, CACHES, ic + (i64) offsetof(pit_inline_cache, epoch));
+        op_mem(a, 0x3b, RAX, RT, (i64) offsetof(pit_runtime, epoch));
+        jcc(a, CC_NE, slow); /* the interpreter refreshes the cache */
+        load(a, RAX, CACHES, ic + (i64) offsetof(pit_inline_cache, f));
+        stack_push(a, RAX);
+        break;
+    }
+    case PIT_OP_LOCAL:
+    case PIT_OP_ENV:
+        sync(a);
+        if (PIT_OP_CODE(w) == PIT_OP_LOCAL) {
+            load(a, RSI, SLOTS, 8 * k);
+        } else {
+            load(a, RAX, ST, (i64) offsetof(pit_jit_state, env));
+            load(a, RSI, RAX, 8 * k);
+        }
+        mov(a, RDI, RT);
+        mov_imm(a, RDX, PIT_NIL);
+        CALL(a, pit_value_cell_get);
+        check(a, slow);
+        stack_push(a, RAX);
+        break;
+    case PIT_OP_SET_LOCAL:
+    case PIT_OP_SET_ENV:
+        sync(a);
+        if (PIT_OP_CODE(w) == PIT_OP_SET_LOCAL) {
+            load(a, RSI, SLOTS, 8 * k);
+        } else {
+            load(a, RAX, ST, (i64) offsetof(pit_jit_state, env));
+            load(a, RSI, RAX, 8 * k);
+        }
+        mov(a, RDI, RT);
+        load(a, RDX, SP, -8);
+        mov_imm(a, RCX, PIT_NIL);
+        CALL(a, pit_value_cell_set);
+        check(a, slow);
+        break;
+    case PIT_OP_BIND:
+    case PIT_OP_BOX:
+        if (PIT_OP_CODE(w) == PIT_OP_BIND) {
+            group1_imm(a, 5, SP, 8);
+            load(a, RSI, SP, 0);
+        } else {
+            load(a, RSI, SLOTS, 8 * k);
+        }
+        sync(a);
+        mov(a, RDI, RT);
+        CALL(a, pit_value_cell_new);
+        check(a, slow);
+        store(a, SLOTS, 8 * k, RAX);
+        break;
+    case PIT_OP_CALL:
+        if (code[pc + 2] != 0) call_linked(a, code, pc, slow);
+        else jmp(a, slow); /* which is pit_vm_jit_call */
+        break;
+    case PIT_OP_TAIL_CALL:
+        if (code[pc + 2] != 0) tail_call_linked(a, code, pc, slow);
+        else jmp(a, slow);
+        break;
+    case PIT_OP_RETURN:
+        return_linked(a, slow); /* and this is pit_vm_jit_return */
+        break;
+    case PIT_OP_CLOSURE:
+        sync(a);
+        mov(a, RDI, ST);
+        mov_imm(a, RSI, (u64) pc);
+        CALL(a, closure);
+        load(a, SP, ST, STATE(sp));
+        check(a, slow);
+        break;
+    case PIT_OP_INTRINSIC: {
+        pit_intrinsic op = (pit_intrinsic) k;
+        i64 ic = (i64) sizeof(pit_inline_cache) * code[pc + 2];
+        if (op >= PIT_INTRINSIC__SENTINEL) return false;
+        /* the function must still be the built-in */
+        load(a, RAX, CACHES, ic + (i64) offsetof(pit_inline_cache, epoch));
+        op_mem(a, 0x3b, RAX, RT, (i64) offsetof(pit_runtime, epoch));
+        jcc(a, CC_NE, slow);
+        load(a, RAX, CACHES, ic + (i64) offsetof(pit_inline_cache, h));
+        op_reg(a, 0x85, RAX, RAX);
+        jcc(a, CC_E, slow);
+        load(a, RSI, SP, -16);
+        load(a, RDI, SP, -8);
+        if (op != PIT_INTRINSIC_EQ) {
+            guard_integer(a, RSI, slow);
+            guard_integer(a, RDI, slow);
+        }
+        switch (op) {
+        /* the low 49 bits of these only depend on the low 49 bits of the arguments */
+        case PIT_INTRINSIC_ADD: mov(a, RAX, RSI); op_reg(a, 0x01, RDI, RAX); tag_integer(a); break;
+        case PIT_INTRINSIC_SUB: mov(a, RAX, RSI); op_reg(a, 0x29, RDI, RAX); tag_integer(a); break;
+        case PIT_INTRINSIC_MUL: mov(a, RAX, RSI); imul(a, RAX, RDI); tag_integer(a); break;
+        /* and the tags are preserved by these */
+        case PIT_INTRINSIC_BITWISE_AND: mov(a, RAX, RSI); op_reg(a, 0x21, RDI, RAX); break;
+        case PIT_INTRINSIC_BITWISE_OR: mov(a, RAX, RSI); op_reg(a, 0x09, RDI, RAX); break;
+        case PIT_INTRINSIC_BITWISE_XOR: mov(a, RAX, RSI); op_reg(a, 0x31, RDI, RAX); tag_integer(a); break;
+        case PIT_INTRINSIC_EQ: compare(a, CC_E, RSI, RDI); break;
+        case PIT_INTRINSIC_LT: sign_extend(a, RSI); sign_extend(a, RDI); compare(a, CC_L, RSI, RDI); break;
+        case PIT_INTRINSIC_GT: sign_extend(a, RSI); sign_extend(a, RDI); compare(a, CC_G, RSI, RDI); break;
+        case PIT_INTRINSIC_LE: sign_extend(a, RSI); sign_extend(a, RDI); compare(a, CC_LE, RSI, RDI); break;
+        case PIT_INTRINSIC_GE: sign_extend(a, RSI); sign_extend(a, RDI); compare(a, CC_GE, RSI, RDI); break;
+        case PIT_INTRINSIC_BITWISE_LSHIFT:
+        case PIT_INTRINSIC_BITWISE_RSHIFT:
+            /* out-of-range shifts are left to the built-in */
+            mov(a, RCX, RDI);
+            sign_extend(a, RCX);
+            group1_imm(a, 7, RCX, 63);
+            jcc(a, CC_A, slow);
+            mov(a, RAX, RSI);
+            if (op == PIT_INTRINSIC_BITWISE_LSHIFT) {
+                shift_cl(a, 4, RAX);
+            } else {
+                sign_extend(a, RAX);
+                shift_cl(a, 7, RAX);
+            }
+            tag_integer(a);
+            break;
+        default: return false;
+        }
+        group1_imm(a, 5, SP, 8);
+        store(a, SP, -8, RAX);
+        break;
+    }
+    default:
+        return false;
+    }
+    return true;
+}
+
+/* generate everything, filling in labels and exits. entries are written too if they aren't NULL.
+   jumps to later code use the offsets from the previous pass, which are the same, since every jump takes 32 bits */
+static void assemble(assembler *a, pit_value_heavy *p, u32 *entries) {
+    u32 *code = p->in.proto.code;
+    a->len = 0;
+    /* entry: save registers, load the state, and jump to the target */
+    push(a, RBX); push(a, RBP); push(a, R12); push(a, R13); push(a, R14); push(a, R15);
+    group1_imm(a, 5, RSP, 8); /* keep the stack aligned for calls */
+    mov(a, ST, RDI);
+    load(a, RT, ST, (i64) offsetof(pit_jit_state, rt));
+    load(a, SP, ST, (i64) offsetof(pit_jit_state, sp));
+    load(a, SLOTS, ST, (i64) offsetof(pit_jit_state, slots));
+    load(a, CONSTS, ST, (i64) offsetof(pit_jit_state, consts));
+    load(a, CACHES, ST, (i64) offsetof(pit_jit_state, caches));
+    byte(a, 0xff); byte(a, 0xe6); /* jmp rsi */
+    /* exit: write back the top of the stack and return. the caller sets pc */
+    a->exit = a->len;
+    sync(a);
+    group1_imm(a, 0, RSP, 8);
+    pop(a, R15); pop(a, R14); pop(a, R13); pop(a, R12); pop(a, RBP); pop(a, RBX);
+    byte(a, 0xc3); /* ret */
+    for (i64 pc = 0; pc < p->in.proto.len; pc += instruction_words(code[pc])) {
+        bool translated;
+        a->labels[pc] = (u32) a->len;
+        translated = translate(a, code, pc);
+        if (!translated) {
+            a->len = a->labels[pc];
+            exit_at(a, pc);
+        }
+        if (entries != NULL) entries[pc] = translated ? a->labels[pc] : 0;
+    }
+    /* the slow paths are out of line, so that the fast paths fall through to each other */
+    for (i64 pc = 0; pc < p->in.proto.len; pc += instruction_words(code[pc])) {
+        a->exits[pc] = (u32) a->len;
+        switch (PIT_OP_CODE(code[pc])) {
+        case PIT_OP_CALL: case PIT_OP_TAIL_CALL: call_vm(a, pit_vm_jit_call, pc); break;
+        case PIT_OP_RETURN: call_vm(a, pit_vm_jit_return, pc); break;
+        default: exit_at(a, pc); break;
+        }
+    }
+}
+
+/* a name for f in the perf map: a global function it's bound to, if there is one */
+static void jit_name(pit_runtime *rt, pit_value f, char *buf, i64 len) {
+    static char prefix[] = "pit:", anonymous[] = "lambda";
+    i64 end = (i64) sizeof(prefix) - 1;
+    pit_libc_string_memcpy((u8 *) buf, (u8 *) prefix, (size_t) end);
+    for (i64 i = 0; i < rt->symtab->next; ++i) {
+        pit_symtab_entry *ent = pit_vec_get(pit_symtab_entry)(rt->symtab, i);
+        if (ent && pit_value_is_cell(rt, ent->function) && pit_value_cell_get(rt, ent->function, PIT_NIL) == f) {
+            end += pit_dump(rt, buf + end, len - end - 1, pit_value_new(rt, PIT_VALUE_SORT_SYMBOL, (u64) i), false);
+            buf[end] = 0;
+            return;
+        }
+    }
+    (void) len;
+    pit_libc_string_memcpy((u8 *) buf + end, (u8 *) anonymous, sizeof(anonymous));
+}
+
+bool pit_jit_compile(pit_runtime *rt, pit_value f, pit_value_heavy *p) {
+    i64 labels_reset = rt->code->next;
+    i64 len = p->in.proto.len;
+    i64 code_size, size;
+    assembler a;
+    pit_jit_code *native;
+    union { u8 *code; void (*enter)(pit_jit_state *st, u8 *target); } entry;
+    char name[128];
+    pit_value_heavy *fh = pit_value_ref_deref(rt, pit_value_as_ref(rt, f));
+    pit_jit_entry e;
+    bool ret = false;
+    if (rt->jit_alloc == NULL || rt->jit_publish == NULL || rt->jit_free == NULL || rt->error != PIT_NIL) return false;
+    if (!fh || fh->hsort != PIT_VALUE_HEAVY_SORT_FUNC) return false;
+    /* the code is only kept if it can be freed along with the proto */
+    if ((rt->jit_code->next + 1) * (i64) sizeof(pit_jit_entry) > rt->jit_code->capacity) return false;
+    /* the compiler's scratch space holds the labels, which it might be using further down */
+    for (i64 i = 0; i < 2 * len; ++i) {
+        if (pit_vec_push(u32)(rt->code, 0) < 0) goto end;
+    }
+    a.buf = NULL;
+    a.labels = pit_vec_get(u32)(rt->code, labels_reset);
+    a.exits = a.labels + len;
+    assemble(&a, p, NULL);
+    code_size = (i64) pit_align_up((uintptr_t) a.len, sizeof(void *));
+    size = code_size + (i64) sizeof(pit_jit_code) + len * (i64) sizeof(u32);
+    if ((a.buf = rt->jit_alloc(rt, size)) == NULL) goto end;
+    native = (pit_jit_code *) (void *) (a.buf + code_size);
+    native->len = len;
+    native->size = size;
+    native->code = a.buf;
+    entry.code = a.buf;
+    native->enter = entry.enter;
+    assemble(&a, p, native->entries);
+    jit_name(rt, f, name, sizeof(name));
+    if (!rt->jit_publish(rt, a.buf, size, a.len, name)) { rt->jit_free(rt, a.buf, size); goto end; }
+    e.proto = pit_value_as_ref(rt, fh->in.func.proto);
+    e.native = native;
+    pit_vec_push(pit_jit_entry)(rt->jit_code, e);
+    pit_value_proto_jit(p)->native = native;
+    ret = true;
+end:
+    rt->code->next = labels_reset;
+    return ret;
+}
+
+void pit_jit_run(pit_runtime *rt, pit_jit_code *native, pit_jit_state *st) {
+    (void) rt;
+    native->enter(st, native->code + native->entries[st->pc]);
+}
+
+#else
+
+bool pit_jit_compile(pit_runtime *rt, pit_value f, pit_value_heavy *p) {
+    (void) rt; (void) f; (void) p;
+    return false;
+}
+
+void pit_jit_run(pit_runtime *rt, pit_jit_code *native, pit_jit_state *st) {
+    (void) native; (void) st;
+    pit_error(rt, "machine code is not supported on this architecture");
+}
+
+#endif
+
+void pit_jit_free(pit_runtime *rt, pit_jit_code *native) {
+    if (rt->jit_free != NULL) rt->jit_free(rt, native->code, native->size);
+}
+
+void pit_jit_drop(pit_runtime *rt, pit_ref from) {
+    i64 kept = 0;
+    for (i64 i = 0; i < rt->jit_code->next; ++i) {
+        pit_jit_entry *e = pit_vec_get(pit_jit_entry)(rt->jit_code, i);
+        if (e->proto >= from) pit_jit_free(rt, e->native);
+        else *pit_vec_get(pit_jit_entry)(rt->jit_code, kept++) = *e;
+    }
+    rt->jit_code->next = kept;
+}
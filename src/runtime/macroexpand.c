@@ -1,5 +1,118 @@
 #include <lcq/pit/runtime/macroexpand.h>
 
+/* after expansion, each rebuilt application is simplified where that can't change what it does:
+   calls to frozen pure built-ins on integer literals are folded, ifs on constant tests lose their dead branch,
+   and bodies of progn and lambda have nested progns spliced in and useless constants (like docstrings) removed */
+
+/* does v evaluate to itself, or to a quoted value? */
+static bool is_constant(pit_runtime *rt, pit_value v) {
+    if (pit_value_is_cons(rt, v)) {
+        pit_value f = pit_value_cons_car(rt, v);
+        return pit_value_is_symbol(rt, f) && pit_value_eq(f, rt->symbols[PIT_SYMBOL_QUOTE]);
+    }
+    if (pit_value_is_symbol(rt, v)) {
+        pit_symtab_entry *ent = pit_symtab_lookup(rt, v);
+        return v == PIT_NIL || v == PIT_T || (ent != NULL && ent->is_keyword);
+    }
+    return true;
+}
+static pit_value constant_value(pit_runtime *rt, pit_value v) {
+    if (pit_value_is_cons(rt, v)) return pit_value_cons_car(rt, pit_value_cons_cdr(rt, v));
+    return v;
+}
+
+/* is v an application of the special form sym? */
+static bool is_form(pit_runtime *rt, pit_value v, pit_well_known_symbol sym) {
+    pit_value f = pit_value_cons_car(rt, v);
+    return pit_value_is_cons(rt, v)
+        && pit_value_eq(f, rt->symbols[sym])
+        && pit_symtab_is_symbol_special_form(rt, f);
+}
+
+/* splice the bodies of nested progns into forms, and drop constants whose values are discarded */
+static pit_value simplify_body(pit_runtime *rt, pit_value forms) {
+    pit_value ret = PIT_NIL;
+    while (forms != PIT_NIL) {
+        pit_value form = pit_value_cons_car(rt, forms);
+        forms = pit_value_cons_cdr(rt, forms);
+        if (is_form(rt, form, PIT_SYMBOL_PROGN) && pit_value_cons_cdr(rt, form) != PIT_NIL) {
+            /* nested bodies were already simplified */
+            forms = pit_value_list_append(rt, pit_value_cons_cdr(rt, form), forms);
+        } else if (forms == PIT_NIL || !is_constant(rt, form)) {
+            ret = pit_value_cons(rt, form, ret);
+        }
+    }
+    return pit_value_list_reverse(rt, ret);
+}
+
+/* fold (f x y ...) if f is bound to one of the VM's intrinsics and x y ... are integers.
+   those functions have no side effects, so calling them early gives the same result,
+   as long as f can't be redefined afterward: nothing checks a folded call again, so only frozen symbols are folded.
+   other calls to intrinsics are left to PIT_OP_INTRINSIC, which notices redefinitions */
+static bool fold(pit_runtime *rt, pit_value f, pit_value args, pit_value *ret) {
+    pit_symtab_entry *ent = pit_symtab_lookup(rt, f);
+    i64 stack_reset = rt->result_stack->next;
+    i64 argc = 0;
+    pit_value fv;
+    pit_value_heavy *h;
+    i64 op;
+    if (pit_value_as_symbol(rt, f) >= rt->frozen_symtab) return false;
+    if (ent == NULL || pit_value_sort(ent->function) != PIT_VALUE_SORT_REF) return false;
+    fv = pit_value_cell_get(rt, ent->function, f);
+    for (op = 0; op < PIT_INTRINSIC__SENTINEL; ++op) {
+        if (pit_vm_is_intrinsic(rt, fv, (pit_intrinsic) op)) break;
+    }
+    if (op == PIT_INTRINSIC__SENTINEL) return false;
+    for (pit_value a = args; a != PIT_NIL; a = pit_value_cons_cdr(rt, a), ++argc) {
+        pit_value x = pit_value_cons_car(rt, a);
+        if (pit_value_sort(x) != PIT_VALUE_SORT_INTEGER) return false;
+    }
+    for (pit_value a = args; a != PIT_NIL; a = pit_value_cons_cdr(rt, a)) {
+        if (pit_vec_push(pit_value)(rt->result_stack, pit_value_cons_car(rt, a)) < 0) {
+            rt->result_stack->next = stack_reset;
+            return false;
+        }
+    }
+    h = pit_value_ref_deref(rt, pit_value_as_ref(rt, fv));
+    *ret = h->in.nativefunc.fargv(rt, argc, pit_vec_get(pit_value)(rt->result_stack, stack_reset), h->in.nativefunc.data);
+    rt->result_stack->next = stack_reset;
+    return rt->error == PIT_NIL;
+}
+
+static pit_value simplify(pit_runtime *rt, pit_value app) {
+    pit_value f = pit_value_cons_car(rt, app);
+    pit_value args = pit_value_cons_cdr(rt, app);
+    pit_value ret;
+    if (!pit_value_is_symbol(rt, f)) return app;
+    if (is_form(rt, app, PIT_SYMBOL_IF) && is_constant(rt, pit_value_cons_car(rt, args))) {
+        pit_value branches = pit_value_cons_cdr(rt, args);
+        if (constant_value(rt, pit_value_cons_car(rt, args)) == PIT_NIL) branches = pit_value_cons_cdr(rt, branches);
+        return pit_value_cons_car(rt, branches);
+    } else if (is_form(rt, app, PIT_SYMBOL_PROGN)) {
+        pit_value body = simplify_body(rt, args);
+        if (body != PIT_NIL && pit_value_cons_cdr(rt, body) == PIT_NIL) return pit_value_cons_car(rt, body);
+        return pit_value_cons(rt, f, body);
+    } else if (is_form(rt, app, PIT_SYMBOL_LAMBDA)) {
+        return pit_value_cons(rt, f, pit_value_cons(rt, pit_value_cons_car(rt, args), simplify_body(rt, pit_value_cons_cdr(rt, args))));
+    } else if (fold(rt, f, args, &ret)) {
+        return ret;
+    }
+    return app;
+}
+
+pit_value pit_macroexpand_form(pit_runtime *rt, pit_value form) {
+    pit_ref r = pit_value_as_ref(rt, form);
+    pit_expansion *e = pit_expansion_get(rt, r);
+    pit_value res;
+    if (e != NULL) return e->expansion;
+    /* form has to stay where it is to remember the expansion, as do the forms the compiler is working on */
+    rt->gc_inhibit += 1;
+    res = pit_value_apply(rt, pit_symtab_fget(rt, pit_value_cons_car(rt, form)), pit_value_cons_cdr(rt, form));
+    rt->gc_inhibit -= 1;
+    if (rt->error == PIT_NIL) pit_expansion_set(rt, r, res);
+    return res;
+}
+
 pit_value pit_macroexpand(pit_runtime *rt, pit_value top) {
     i64 expr_stack_reset = rt->expr_stack->next;
     i64 result_stack_reset = rt->result_stack->next;
@@ -16,22 +129,20 @@ pit_value pit_macroexpand(pit_runtime *rt, pit_value top) {
             bool is_symbol = pit_value_is_symbol(rt, fsym);
             pit_annotated_ref *ann = pit_annotation_get(rt, pit_value_as_ref(rt, cur));
             if (is_symbol && pit_symtab_is_symbol_macro(rt, fsym)) {
-                pit_value f = pit_symtab_fget(rt, fsym);
-                pit_value args = pit_value_cons_cdr(rt, cur);
-                pit_value res = pit_value_apply(rt, f, args);
+                pit_value res = pit_macroexpand_form(rt, cur);
                 if (pit_vec_push(pit_value)(rt->expr_stack, res) < 0)
                     pit_error(rt, "macro expansion stack overflow");
-            } else if (is_symbol && pit_symtab_symbol_name_match_cstr(rt, fsym, "defer")) {
+            } else if (is_symbol && pit_value_eq(fsym, rt->symbols[PIT_SYMBOL_DEFER])) {
                 pit_value args = pit_value_cons_cdr(rt, cur);
                 pit_traversal_push_value(rt, rt->traversal, pit_value_cons_car(rt, args));
-            } else if (is_symbol && pit_symtab_symbol_name_match_cstr(rt, fsym, "quote")) {
+            } else if (is_symbol && pit_value_eq(fsym, rt->symbols[PIT_SYMBOL_QUOTE])) {
                 pit_traversal_push_value(rt, rt->traversal, cur);
-            } else if (is_symbol && pit_symtab_symbol_name_match_cstr(rt, fsym, "lambda")) {
+            } else if (is_symbol && pit_value_eq(fsym, rt->symbols[PIT_SYMBOL_LAMBDA])) {
                 pit_value args = pit_value_cons_cdr(rt, cur);
                 pit_value bindings = pit_value_cons_car(rt, args);
                 pit_value body = pit_value_cons_cdr(rt, args);
                 i64 argcount = 0;
-                if (pit_vec_push(pit_value)(rt->expr_stack, pit_value_list(rt, 2, pit_symtab_intern_cstr(rt, "defer"), bindings)) < 0)
+                if (pit_vec_push(pit_value)(rt->expr_stack, pit_value_list(rt, 2, rt->symbols[PIT_SYMBOL_DEFER], bindings)) < 0)
                     pit_error(rt, "macro expansion stack overflow");
                 while (body != PIT_NIL) {
                     pit_value a = pit_value_cons_car(rt, body);
@@ -86,8 +197,11 @@ pit_value pit_macroexpand(pit_runtime *rt, pit_value top) {
                     pit_error(rt, "macro expansion stack underflow");
                 args = pit_value_cons(rt, a, args);
             }
-            app = pit_value_cons(rt, f, args);
-            if (ent->in.application.annotation != NULL) {
+            app = simplify(rt, pit_value_cons(rt, f, args));
+            if (ent->in.application.annotation != NULL
+                && pit_value_is_cons(rt, app)
+                && pit_annotation_get(rt, pit_value_as_ref(rt, app)) == NULL /* a subform keeps its own location */
+            ) {
                 pit_annotation_set(rt, pit_value_as_ref(rt, app), ent->in.application.annotation->annotation);
             }
             if (pit_vec_push(pit_value)(rt->result_stack, app) < 0)
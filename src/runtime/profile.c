@@ -0,0 +1,215 @@
+#include <lcq/pit/runtime/profile.h>
+
+static u64 now(pit_runtime *rt) {
+    return rt->clock != NULL ? rt->clock(rt) : 0;
+}
+/* heavy values allocated so far, including those that have since been collected */
+static i64 allocated(pit_runtime *rt) {
+    return rt->heap->next + rt->gc_reclaimed;
+}
+
+/* closures made from the same lambda share a proto, so they're measured together */
+static pit_value profile_key(pit_runtime *rt, pit_value f) {
+    pit_value_heavy *h = pit_value_sort(f) == PIT_VALUE_SORT_REF ? pit_value_ref_deref(rt, pit_value_as_ref(rt, f)) : NULL;
+    return h != NULL && h->hsort == PIT_VALUE_HEAVY_SORT_FUNC ? h->in.func.proto : f;
+}
+
+static u64 profile_hash(pit_value function, i64 line, i64 column) {
+    u64 h = function * 0x9e3779b97f4a7c15;
+    h ^= ((u64) line << 16 ^ (u64) column) * 0xff51afd7ed558ccd;
+    return h ^ (h >> 29);
+}
+
+/* index of the entry for calls to function from the given call site (or -1, -1 for its totals),
+   creating it if this is the first. -1 if the profile is full */
+static i64 profile_entry(pit_runtime *rt, pit_value function, i64 line, i64 column) {
+    u64 mask = (u64) rt->profile_index_len - 1;
+    for (u64 i = profile_hash(function, line, column) & mask;; i = (i + 1) & mask) {
+        i32 idx = rt->profile_index[i];
+        pit_profile_entry *e;
+        if (idx == 0) {
+            pit_profile_entry fresh;
+            i64 n;
+            if ((rt->profile->next + 1) * (i64) sizeof(pit_profile_entry) > rt->profile->capacity) return -1;
+            fresh.function = function;
+            fresh.line = line;
+            fresh.column = column;
+            fresh.calls = fresh.active = fresh.allocs = 0;
+            fresh.inclusive = fresh.exclusive = 0;
+            n = pit_vec_push(pit_profile_entry)(rt->profile, fresh);
+            rt->profile_index[i] = (i32) (n + 1);
+            return n;
+        }
+        e = pit_vec_get(pit_profile_entry)(rt->profile, idx - 1);
+        if (e->function == function && e->line == line && e->column == column) return idx - 1;
+    }
+}
+
+static void account(pit_profile_entry *e, u64 elapsed, u64 self, i64 allocs) {
+    e->active -= 1;
+    if (e->active == 0) e->inclusive += elapsed; /* the outermost of recursive calls includes the others */
+    e->exclusive += self;
+    e->allocs += allocs;
+}
+/* pop the innermost call and charge it to its entries, and its time to its caller */
+static void profile_finish(pit_runtime *rt) {
+    pit_profile_call c;
+    pit_profile_call *caller;
+    u64 elapsed;
+    i64 allocs;
+    if (pit_vec_pop(pit_profile_call)(rt->profile_calls, &c) < 0) return;
+    elapsed = now(rt) - c.start;
+    allocs = allocated(rt) - c.allocs;
+    account(pit_vec_get(pit_profile_entry)(rt->profile, c.entry), elapsed, elapsed - c.children, allocs - c.children_allocs);
+    if (c.site >= 0) account(pit_vec_get(pit_profile_entry)(rt->profile, c.site), elapsed, elapsed - c.children, allocs - c.children_allocs);
+    if (rt->profile_calls->next > 0 && (caller = pit_vec_get(pit_profile_call)(rt->profile_calls, rt->profile_calls->next - 1)) != NULL) {
+        caller->children += elapsed;
+        caller->children_allocs += allocs;
+    }
+}
+
+void pit_profile_clear(pit_runtime *rt) {
+    pit_vec_reset(pit_profile_entry)(rt->profile);
+    pit_vec_reset(pit_profile_call)(rt->profile_calls);
+    for (i64 i = 0; i < rt->profile_index_len; ++i) rt->profile_index[i] = 0;
+}
+void pit_profile_start(pit_runtime *rt) {
+    pit_profile_clear(rt);
+    rt->profiling = true;
+}
+void pit_profile_stop(pit_runtime *rt) {
+    while (rt->profile_calls->next > 0) profile_finish(rt);
+    rt->profiling = false;
+}
+
+void pit_profile_enter(pit_runtime *rt, pit_value f, bool native) {
+    pit_annotation *site;
+    pit_profile_call c;
+    pit_value key;
+    pit_profile_entry *e;
+    if (!rt->profiling) return;
+    /* the innermost call on the call stack is this one, if its site is known */
+    site = rt->calls->next > 0 ? pit_vec_get(pit_annotation)(rt->calls, rt->calls->next - 1) : NULL;
+    key = profile_key(rt, f);
+    if ((c.entry = profile_entry(rt, key, -1, -1)) < 0) return;
+    c.site = site != NULL && site->line >= 0 ? profile_entry(rt, key, site->line, site->column) : -1;
+    c.frames = rt->frames->next;
+    c.native = native;
+    c.start = now(rt);
+    c.children = 0;
+    c.allocs = allocated(rt);
+    c.children_allocs = 0;
+    if (pit_vec_push(pit_profile_call)(rt->profile_calls, c) < 0) {
+        rt->profile_calls->next -= 1;
+        return;
+    }
+    e = pit_vec_get(pit_profile_entry)(rt->profile, c.entry);
+    e->calls += 1;
+    e->active += 1;
+    if (c.site >= 0) {
+        e = pit_vec_get(pit_profile_entry)(rt->profile, c.site);
+        e->calls += 1;
+        e->active += 1;
+    }
+}
+void pit_profile_exit(pit_runtime *rt, bool native) {
+    pit_profile_call *c;
+    if (!rt->profiling || rt->profile_calls->next == 0) return;
+    c = pit_vec_get(pit_profile_call)(rt->profile_calls, rt->profile_calls->next - 1);
+    /* calls that started before profiling did aren't being measured */
+    if (c->frames != rt->frames->next || c->native != native) return;
+    profile_finish(rt);
+}
+void pit_profile_unwind(pit_runtime *rt, i64 frames) {
+    pit_profile_call *c;
+    if (!rt->profiling) return;
+    while (rt->profile_calls->next > 0
+        && (c = pit_vec_get(pit_profile_call)(rt->profile_calls, rt->profile_calls->next - 1))->frames > frames
+    ) {
+        profile_finish(rt);
+    }
+}
+void pit_profile_moved(pit_runtime *rt) {
+    u64 mask = (u64) rt->profile_index_len - 1;
+    for (i64 i = 0; i < rt->profile_index_len; ++i) rt->profile_index[i] = 0;
+    for (i64 n = 0; n < rt->profile->next; ++n) {
+        pit_profile_entry *e = pit_vec_get(pit_profile_entry)(rt->profile, n);
+        u64 i = profile_hash(e->function, e->line, e->column) & mask;
+        while (rt->profile_index[i] != 0) i = (i + 1) & mask;
+        rt->profile_index[i] = (i32) (n + 1);
+    }
+}
+
+/* the global function bound to the function (or proto) key, or nil */
+static pit_value profile_name(pit_runtime *rt, pit_value key) {
+    for (i64 i = 0; i < rt->symtab->next; ++i) {
+        pit_symtab_entry *ent = pit_vec_get(pit_symtab_entry)(rt->symtab, i);
+        pit_value f;
+        if (ent == NULL || !pit_value_is_cell(rt, ent->function)) continue;
+        f = pit_value_cell_get(rt, ent->function, PIT_NIL);
+        if (f == key || (pit_value_is_func(rt, f) && profile_key(rt, f) == key)) {
+            return pit_value_new(rt, PIT_VALUE_SORT_SYMBOL, (u64) i);
+        }
+    }
+    return PIT_NIL;
+}
+
+typedef enum { SORT_CALLS, SORT_INCLUSIVE, SORT_EXCLUSIVE, SORT_ALLOCS } profile_sort;
+static i64 profile_metric(pit_profile_entry *e, profile_sort sort) {
+    switch (sort) {
+    case SORT_CALLS: return e->calls;
+    case SORT_INCLUSIVE: return (i64) e->inclusive;
+    case SORT_EXCLUSIVE: return (i64) e->exclusive;
+    case SORT_ALLOCS: return e->allocs;
+    }
+    return 0;
+}
+pit_value pit_profile_report(pit_runtime *rt, pit_value sort, bool sites) {
+    i64 order_reset = rt->code->next;
+    i64 n = 0;
+    u32 *order;
+    profile_sort by;
+    pit_value ret = PIT_NIL;
+    if (sort == PIT_NIL || pit_value_eq(sort, pit_symtab_intern_cstr(rt, ":inclusive"))) by = SORT_INCLUSIVE;
+    else if (pit_value_eq(sort, pit_symtab_intern_cstr(rt, ":exclusive"))) by = SORT_EXCLUSIVE;
+    else if (pit_value_eq(sort, pit_symtab_intern_cstr(rt, ":calls"))) by = SORT_CALLS;
+    else if (pit_value_eq(sort, pit_symtab_intern_cstr(rt, ":allocs"))) by = SORT_ALLOCS;
+    else { pit_error(rt, "unknown profile sort key"); return PIT_NIL; }
+    /* sort the indices of the entries in the compiler's scratch space, ascending, to cons up the result backwards */
+    for (i64 i = 0; i < rt->profile->next; ++i) {
+        pit_profile_entry *e = pit_vec_get(pit_profile_entry)(rt->profile, i);
+        if ((e->line >= 0) != sites) continue;
+        if (pit_vec_push(u32)(rt->code, (u32) i) < 0) { pit_error(rt, "profile report too large"); goto end; }
+        n += 1;
+    }
+    order = pit_vec_get(u32)(rt->code, order_reset);
+    for (i64 i = 1; i < n; ++i) {
+        u32 x = order[i];
+        i64 key = profile_metric(pit_vec_get(pit_profile_entry)(rt->profile, x), by);
+        i64 j = i - 1;
+        while (j >= 0 && profile_metric(pit_vec_get(pit_profile_entry)(rt->profile, order[j]), by) > key) {
+            order[j + 1] = order[j];
+            j -= 1;
+        }
+        order[j + 1] = x;
+    }
+    for (i64 i = 0; i < n; ++i) {
+        pit_profile_entry *e = pit_vec_get(pit_profile_entry)(rt->profile, order[i]);
+        pit_value stats = pit_value_list(rt, 8,
+            pit_symtab_intern_cstr(rt, ":calls"), pit_value_integer_new(rt, e->calls),
+            pit_symtab_intern_cstr(rt, ":inclusive"), pit_value_integer_new(rt, (i64) e->inclusive),
+            pit_symtab_intern_cstr(rt, ":exclusive"), pit_value_integer_new(rt, (i64) e->exclusive),
+            pit_symtab_intern_cstr(rt, ":allocs"), pit_value_integer_new(rt, e->allocs));
+        if (sites) {
+            stats = pit_value_cons(rt, pit_symtab_intern_cstr(rt, ":line"),
+                pit_value_cons(rt, pit_value_integer_new(rt, e->line),
+                    pit_value_cons(rt, pit_symtab_intern_cstr(rt, ":column"),
+                        pit_value_cons(rt, pit_value_integer_new(rt, e->column), stats))));
+        }
+        stats = pit_value_cons(rt, pit_symtab_intern_cstr(rt, ":function"), pit_value_cons(rt, profile_name(rt, e->function), stats));
+        ret = pit_value_cons(rt, stats, ret);
+    }
+end:
+    rt->code->next = order_reset;
+    return ret;
+}
@@ -4,12 +4,29 @@ pit_symtab_entry *pit_symtab_lookup(pit_runtime *rt, pit_value sym) {
     pit_symbol s = pit_value_as_symbol(rt, sym);
     return pit_vec_get(pit_symtab_entry)(rt->symtab, s);
 }
+static u32 name_hash(u8 *nm, i64 len) {
+    u32 h = 2166136261u; /* FNV-1a */
+    for (i64 i = 0; i < len; ++i) h = (h ^ nm[i]) * 16777619u;
+    return h;
+}
+/* symbols are found through symtab_index, probing linearly from the slot for the name's hash.
+   slots referring to symbols past the end of the symbol table (discarded by pit_runtime_reset) count as empty.
+   that's safe without removing them because every slot probed before reaching a symbol's own slot
+   holds an older symbol, which is still there whenever the symbol itself is.
+   the index refers to symbols rather than their names, so the garbage collector doesn't need to touch it */
 pit_value pit_symtab_intern(pit_runtime *rt, u8 *nm, i64 len) {
+    u32 hash = name_hash(nm, len);
+    u64 mask = (u64) rt->symtab_index_len - 1;
+    pit_symtab_slot *slot = NULL;
     if (rt->error != PIT_NIL) return PIT_NIL;
-    for (i64 sidx = 0; sidx < rt->symtab->next; ++sidx) {
-        pit_symtab_entry *sent = pit_vec_get(pit_symtab_entry)(rt->symtab, sidx);
-        if (sent == NULL) { pit_error(rt, "corrupted symbol table"); return PIT_NIL; }
-        if (pit_value_bytes_match(rt, sent->name, nm, len)) return pit_value_symbol_new(rt, sidx);
+    for (u64 i = hash & mask;; i = (i + 1) & mask) {
+        slot = &rt->symtab_index[i];
+        if (slot->symbol == 0 || slot->symbol > rt->symtab->next) break;
+        if (slot->hash == hash) {
+            pit_symtab_entry *sent = pit_vec_get(pit_symtab_entry)(rt->symtab, slot->symbol - 1);
+            if (sent == NULL) { pit_error(rt, "corrupted symbol table"); return PIT_NIL; }
+            if (pit_value_bytes_match(rt, sent->name, nm, len)) return pit_value_symbol_new(rt, slot->symbol - 1);
+        }
     }
     pit_symtab_entry ent;
     ent.name = pit_value_bytes_new(rt, nm, len);
@@ -20,6 +37,8 @@ pit_value pit_symtab_intern(pit_runtime *rt, u8 *nm, i64 len) {
     ent.is_keyword = len >= 1 && nm[0] == ':';
     i64 idx = pit_vec_push(pit_symtab_entry)(rt->symtab, ent);
     if (idx < 0) { pit_error(rt, "failed to allocate symtab entry"); return PIT_NIL; }
+    slot->hash = hash;
+    slot->symbol = (i32) (idx + 1);
     return pit_value_symbol_new(rt, idx);
 }
 pit_value pit_symtab_intern_cstr(pit_runtime *rt, char *nm) {
@@ -73,6 +92,8 @@ void pit_symtab_fset(pit_runtime *rt, pit_value sym, pit_value v) {
         ent->function = pit_value_cell_new(rt, PIT_NIL);
     }
     pit_value_cell_set(rt, ent->function, v, sym);
+    rt->epoch += 1;
+    if (ent->is_macro) rt->macro_epoch += 1;
 }
 bool pit_symtab_is_symbol_macro(pit_runtime *rt, pit_value sym) {
     pit_symtab_entry *ent = pit_symtab_lookup(rt, sym);
@@ -83,6 +104,8 @@ void pit_symtab_symbol_mark_macro(pit_runtime *rt, pit_value sym) {
     pit_symtab_entry *ent = pit_symtab_lookup(rt, sym);
     if (!ent) { pit_error(rt, "bad symbol"); return; }
     ent->is_macro = true;
+    rt->epoch += 1;
+    rt->macro_epoch += 1;
 }
 void pit_symtab_mset(pit_runtime *rt, pit_value sym, pit_value v) {
     pit_symtab_fset(rt, sym, v);
@@ -97,6 +120,7 @@ void pit_symtab_symbol_mark_special_form(pit_runtime *rt, pit_value sym) {
     pit_symtab_entry *ent = pit_symtab_lookup(rt, sym);
     if (!ent) { pit_error(rt, "bad symbol"); return; }
     ent->is_special_form = true;
+    rt->epoch += 1;
 }
 void pit_symtab_sfset(pit_runtime *rt, pit_value sym, pit_value v) {
     pit_symtab_fset(rt, sym, v);
@@ -106,13 +130,32 @@ void pit_symtab_bind(pit_runtime *rt, pit_value sym, pit_value cell) {
     /* although we cannot set frozen symbols, we can still bind them temporarily - no need to check */
     pit_symtab_entry *ent = pit_symtab_lookup(rt, sym);
     if (!ent) { pit_error(rt, "bad symbol"); return; }
-    if (pit_vec_push(pit_value)(rt->saved_bindings, ent->value) < 0) pit_error(rt, "binding stack overflow");
+    /* we save the symbol alongside the old value, so that bindings can be unwound without knowing the symbols */
+    if (pit_vec_push(pit_value)(rt->saved_bindings, sym) < 0
+        || pit_vec_push(pit_value)(rt->saved_bindings, ent->value) < 0
+    ) { pit_error(rt, "binding stack overflow"); return; }
     ent->value = cell;
 }
 pit_value pit_symtab_unbind(pit_runtime *rt, pit_value sym) {
     pit_symtab_entry *ent = pit_symtab_lookup(rt, sym);
+    pit_value saved_sym = PIT_NIL;
     if (!ent) { pit_error(rt, "bad symbol"); return PIT_NIL; }
     pit_value old = ent->value;
-    if (pit_vec_pop(pit_value)(rt->saved_bindings, &ent->value) < 0) pit_error(rt, "binding stack underflow");
+    if (pit_vec_pop(pit_value)(rt->saved_bindings, &ent->value) < 0
+        || pit_vec_pop(pit_value)(rt->saved_bindings, &saved_sym) < 0
+    ) { pit_error(rt, "binding stack underflow"); return old; }
+    if (saved_sym != sym) pit_error(rt, "unbound symbol does not match binding");
     return old;
 }
+void pit_symtab_unbind_to(pit_runtime *rt, i64 mark) {
+    while (rt->saved_bindings->next > mark) {
+        pit_value sym = PIT_NIL, old = PIT_NIL;
+        pit_symtab_entry *ent;
+        if (pit_vec_pop(pit_value)(rt->saved_bindings, &old) < 0
+            || pit_vec_pop(pit_value)(rt->saved_bindings, &sym) < 0
+        ) { pit_error(rt, "binding stack underflow"); return; }
+        ent = pit_symtab_lookup(rt, sym);
+        if (!ent) { pit_error(rt, "bad symbol"); return; }
+        ent->value = old;
+    }
+}
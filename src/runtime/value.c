@@ -59,14 +59,24 @@ bool pit_value_equal(pit_runtime *rt, pit_value a, pit_value b) {
             return
                 pit_value_equal(rt, ha->in.func.env, hb->in.func.env)
                 && pit_value_equal(rt, ha->in.func.args, hb->in.func.args)
-                && pit_value_equal(rt, ha->in.func.body, hb->in.func.body);
+                && pit_value_equal(rt, ha->in.func.proto, hb->in.func.proto);
+        case PIT_VALUE_HEAVY_SORT_PROTO: {
+            if (ha->in.proto.len != hb->in.proto.len || ha->in.proto.nslots != hb->in.proto.nslots) return false;
+            for (i64 i = 0; i < ha->in.proto.len; ++i) {
+                if (ha->in.proto.code[i] != hb->in.proto.code[i]) return false;
+            }
+            return pit_value_equal(rt, ha->in.proto.consts, hb->in.proto.consts);
+        }
         case PIT_VALUE_HEAVY_SORT_NATIVEFUNC:
             return ha->in.nativefunc.f == hb->in.nativefunc.f
+                && ha->in.nativefunc.fargv == hb->in.nativefunc.fargv
                 && ha->in.nativefunc.data == hb->in.nativefunc.data;
         case PIT_VALUE_HEAVY_SORT_NATIVEDATA:
             return
                 pit_value_eq(ha->in.nativedata.tag, hb->in.nativedata.tag)
                 && ha->in.nativedata.data == hb->in.nativedata.data;
+        case PIT_VALUE_HEAVY_SORT_COROUTINE: /* coroutines have state, so they're only equal to themselves */
+            return pit_value_eq(a, b);
         case PIT_VALUE_HEAVY_SORT_FORWARDING_POINTER:
             return ha->in.forwarding_pointer == hb->in.forwarding_pointer;
         }
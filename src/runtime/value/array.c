@@ -7,7 +7,7 @@ bool pit_value_is_array(pit_runtime *rt, pit_value a) {
 pit_value pit_value_array_new(pit_runtime *rt, i64 len) {
     if (len < 0) { pit_error(rt, "failed to create array of negative size"); return PIT_NIL; }
     i64 byte_len = 0; pit_mul(&byte_len, sizeof(pit_value), len);
-    pit_value *dest = pit_arena_alloc_array(rt->heap, byte_len);
+    pit_value *dest = pit_arena_alloc_back(rt->heap, byte_len);
     if (!dest) { pit_error(rt, "failed to allocate array"); return PIT_NIL; }
     for (i64 i = 0; i < len; ++i) dest[i] = PIT_NIL;
     pit_value ret = pit_value_ref_heavy_new(rt);
@@ -45,13 +45,15 @@ pit_value pit_value_array_get(pit_runtime *rt, pit_value arr, i64 idx) {
 }
 pit_value pit_value_array_set(pit_runtime *rt, pit_value arr, i64 idx, pit_value v) {
     if (pit_value_sort(arr) != PIT_VALUE_SORT_REF) { pit_error(rt, "not a ref"); return PIT_NIL; }
-    pit_value_heavy *h = pit_value_ref_deref(rt, pit_value_as_ref(rt, arr));
+    pit_ref r = pit_value_as_ref(rt, arr);
+    pit_value_heavy *h = pit_value_ref_deref(rt, r);
     if (!h) { pit_error(rt, "bad ref"); return PIT_NIL; }
     if (h->hsort != PIT_VALUE_HEAVY_SORT_ARRAY) { pit_error(rt, "not an array"); return PIT_NIL; }
     if (idx < 0 || idx >= h->in.array.len) {
         pit_error(rt, "array index out of bounds: %d", idx);
         return PIT_NIL;
     }
+    pit_gc_write_barrier(rt, r, v);
     h->in.array.data[idx] = v;
     return v;
 }
@@ -43,5 +43,6 @@ void pit_value_cell_set(pit_runtime *rt, pit_value cell, pit_value v, pit_value
         pit_error(rt, "cell value ref does not point to cell");
         return;
     }
+    pit_gc_write_barrier(rt, idx, v);
     h->in.cell = v;
 }
@@ -33,6 +33,7 @@ void pit_value_cons_setcar(pit_runtime *rt, pit_value v, pit_value x) {
     pit_value_heavy *h = pit_value_ref_deref(rt, idx);
     if (!h) { pit_error(rt, "bad ref"); return; }
     if (h->hsort != PIT_VALUE_HEAVY_SORT_CONS) { pit_error(rt, "not a cons"); return; }
+    pit_gc_write_barrier(rt, idx, x);
     h->in.cons.car = x;
 }
 void pit_value_cons_setcdr(pit_runtime *rt, pit_value v, pit_value x) {
@@ -42,6 +43,7 @@ void pit_value_cons_setcdr(pit_runtime *rt, pit_value v, pit_value x) {
     pit_value_heavy *h = pit_value_ref_deref(rt, idx);
     if (!h) { pit_error(rt, "bad ref"); return; }
     if (h->hsort != PIT_VALUE_HEAVY_SORT_CONS) { pit_error(rt, "not a cons"); return; }
+    pit_gc_write_barrier(rt, idx, x);
     h->in.cons.cdr = x;
 }
 
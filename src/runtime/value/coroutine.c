@@ -0,0 +1,25 @@
+#include <lcq/pit/runtime/value/coroutine.h>
+
+bool pit_value_is_coroutine(pit_runtime *rt, pit_value a) {
+    return pit_value_is_ref_heavy_sort(rt, a, PIT_VALUE_HEAVY_SORT_COROUTINE);
+}
+pit_value pit_value_coroutine_new(pit_runtime *rt, pit_value f) {
+    if (!pit_value_is_func(rt, f)) { pit_error(rt, "coroutine function was not a Lisp function"); return PIT_NIL; }
+    pit_value ret = pit_value_ref_heavy_new(rt);
+    pit_value_heavy *h = pit_value_ref_deref(rt, pit_value_as_ref(rt, ret));
+    if (!h) { pit_error(rt, "failed to create new heavy value for coroutine"); return PIT_NIL; }
+    h->hsort = PIT_VALUE_HEAVY_SORT_COROUTINE;
+    h->in.coroutine.func = f;
+    h->in.coroutine.saved = PIT_NIL;
+    h->in.coroutine.state = PIT_COROUTINE_FRESH;
+    h->in.coroutine.nvalues = h->in.coroutine.nframes = h->in.coroutine.ncalls = 0;
+    return ret;
+}
+pit_coroutine_state pit_value_coroutine_state(pit_runtime *rt, pit_value co) {
+    pit_value_heavy *h = NULL;
+    if (pit_value_sort(co) != PIT_VALUE_SORT_REF) { pit_error(rt, "value was not a coroutine"); return PIT_COROUTINE_DEAD; }
+    h = pit_value_ref_deref(rt, pit_value_as_ref(rt, co));
+    if (!h) { pit_error(rt, "bad ref"); return PIT_COROUTINE_DEAD; }
+    if (h->hsort != PIT_VALUE_HEAVY_SORT_COROUTINE) { pit_error(rt, "value was not a coroutine"); return PIT_COROUTINE_DEAD; }
+    return (pit_coroutine_state) h->in.coroutine.state;
+}
@@ -1,6 +1,6 @@
 #include <lcq/pit/runtime/value/func.h>
 
-static pit_value free_vars(pit_runtime *rt, pit_value initial_bound, pit_value body) {
+pit_value pit_value_func_free_vars(pit_runtime *rt, pit_value initial_bound, pit_value body, pit_value enclosing) {
     i64 expr_stack_reset = rt->expr_stack->next;
     pit_value ret = PIT_NIL;
     if (pit_vec_push(pit_value)(rt->expr_stack, pit_value_cons(rt, initial_bound, body)) < 0) {
@@ -19,7 +19,7 @@ static pit_value free_vars(pit_runtime *rt, pit_value initial_bound, pit_value b
             pit_value fsym = pit_value_cons_car(rt, cur);
             bool is_symbol = pit_value_is_symbol(rt, fsym);
             pit_value fargs = pit_value_cons_cdr(rt, cur);
-            if (is_symbol && pit_symtab_symbol_name_match_cstr(rt, fsym, "lambda")) {
+            if (is_symbol && pit_value_eq(fsym, rt->symbols[PIT_SYMBOL_LAMBDA])) {
                 pit_value new_bound = pit_value_list_append(rt, pit_value_cons_car(rt, fargs), bound);
                 fargs = pit_value_cons_cdr(rt, fargs);
                 while (fargs != PIT_NIL) {
@@ -29,10 +29,21 @@ static pit_value free_vars(pit_runtime *rt, pit_value initial_bound, pit_value b
                     }
                     fargs = pit_value_cons_cdr(rt, fargs);
                 }
-            } else if (is_symbol && pit_symtab_symbol_name_match_cstr(rt, fsym, "quote")) {
+            } else if (is_symbol && pit_value_eq(fsym, rt->symbols[PIT_SYMBOL_QUOTE])) {
                 /* don't look inside quote!
                    if we add other special forms, make sure to consider them here if necessary! */
             } else {
+                pit_value target = pit_value_cons_car(rt, fargs);
+                if (is_symbol && pit_value_eq(fsym, rt->symbols[PIT_SYMBOL_SET])
+                    && pit_value_is_cons(rt, target)
+                    && pit_value_is_symbol(rt, pit_value_cons_car(rt, target))
+                    && pit_value_eq(pit_value_cons_car(rt, target), rt->symbols[PIT_SYMBOL_QUOTE])
+                ) { /* (set! 'x v) assigns to x, so x must be captured too */
+                    if (pit_vec_push(pit_value)(rt->expr_stack, pit_value_cons(rt, bound, pit_value_cons_car(rt, pit_value_cons_cdr(rt, target)))) < 0) {
+                        pit_error(rt, "free variable search stack overflow");
+                        return PIT_NIL;
+                    }
+                }
                 while (fargs != PIT_NIL) {
                     if (pit_vec_push(pit_value)(rt->expr_stack, pit_value_cons(rt, bound, pit_value_cons_car(rt, fargs))) < 0) {
                         pit_error(rt, "free variable search stack overflow");
@@ -48,7 +59,14 @@ static pit_value free_vars(pit_runtime *rt, pit_value initial_bound, pit_value b
                 }
             }
         } else if (pit_value_is_symbol(rt, cur)) {
-            if (pit_value_list_contains_eq(rt, cur, bound) == PIT_NIL) {
+            pit_symtab_entry *ent = pit_symtab_lookup(rt, cur);
+            if (ent == NULL) { pit_error(rt, "bad symbol"); return PIT_NIL; }
+            /* nil, t, and keywords evaluate to themselves, and globals are looked up directly, so there is nothing to capture */
+            if (cur != PIT_NIL && cur != PIT_T && !ent->is_keyword
+                && pit_value_list_contains_eq(rt, cur, enclosing) != PIT_NIL
+                && pit_value_list_contains_eq(rt, cur, bound) == PIT_NIL
+                && pit_value_list_contains_eq(rt, cur, ret) == PIT_NIL
+            ) {
                 ret = pit_value_cons(rt, cur, ret);
             }
         }
@@ -63,56 +81,79 @@ bool pit_value_is_func(pit_runtime *rt, pit_value a) {
 bool pit_value_is_nativefunc(pit_runtime *rt, pit_value a) {
     return pit_value_is_ref_heavy_sort(rt, a, PIT_VALUE_HEAVY_SORT_NATIVEFUNC);
 }
-pit_value pit_value_func_lambda(pit_runtime *rt, pit_value args, pit_value body) {
-    pit_value ret = pit_value_ref_heavy_new(rt);
-    pit_value_heavy *h = pit_value_ref_deref(rt, pit_value_as_ref(rt, ret));
-    if (!h) { pit_error(rt, "failed to create new heavy value for lambda"); return PIT_NIL; }
-    pit_value expanded = pit_macroexpand(rt, pit_value_cons(rt, pit_symtab_intern_cstr(rt, "progn"), body));
-    pit_value freevars = free_vars(rt, args, expanded);
-    pit_value env = PIT_NIL;
-    while (freevars != PIT_NIL) {
-        pit_value sym = pit_value_cons_car(rt, freevars);
-        pit_value cell = pit_symtab_get_value_cell(rt, sym);
-        env = pit_value_cons(rt, pit_value_cons(rt, sym, cell), env);
-        freevars = pit_value_cons_cdr(rt, freevars);
-    }
-    h->hsort = PIT_VALUE_HEAVY_SORT_FUNC;
-    pit_value arg_cells = PIT_NIL;
+pit_value pit_value_func_new(pit_runtime *rt, pit_value args, pit_value captured, pit_value env, pit_value body) {
+    pit_value arg_names = PIT_NIL;
     pit_value arg_rest_nm = PIT_NIL;
-    pit_value separator = pit_symtab_intern_cstr(rt, "&");
+    pit_value separator = rt->symbols[PIT_SYMBOL_REST];
     while (args != PIT_NIL) {
         pit_value nm = pit_value_cons_car(rt, args);
         if (pit_value_eq(nm, separator)) {
             pit_value next_nm = pit_value_cons_car(rt, pit_value_cons_cdr(rt, args));
             if (next_nm == PIT_NIL) { pit_error(rt, "invalid & in lambda list"); return PIT_NIL; }
             arg_rest_nm = next_nm;
-            arg_cells = pit_value_cons(rt, next_nm, arg_cells);
+            arg_names = pit_value_cons(rt, next_nm, arg_names);
             break;
         } else {
-            arg_cells = pit_value_cons(rt, nm, arg_cells);
+            arg_names = pit_value_cons(rt, nm, arg_names);
             args = pit_value_cons_cdr(rt, args);
         }
     }
-    arg_cells = pit_value_list_reverse(rt, arg_cells);
-    h->in.func.args = arg_cells;
+    arg_names = pit_value_list_reverse(rt, arg_names);
+    pit_value proto = pit_compile(rt, arg_names, captured, body);
+    if (rt->error != PIT_NIL) return PIT_NIL;
+    pit_value ret = pit_value_ref_heavy_new(rt);
+    pit_value_heavy *h = pit_value_ref_deref(rt, pit_value_as_ref(rt, ret));
+    if (!h) { pit_error(rt, "failed to create new heavy value for lambda"); return PIT_NIL; }
+    h->hsort = PIT_VALUE_HEAVY_SORT_FUNC;
+    h->in.func.args = arg_names;
     h->in.func.arg_rest_nm = arg_rest_nm;
     h->in.func.env = env;
-    h->in.func.body = expanded;
+    h->in.func.proto = proto;
+    return ret;
+}
+pit_value pit_value_func_instantiate(pit_runtime *rt, pit_value template, pit_value env) {
+    pit_value ret = pit_value_ref_heavy_new(rt);
+    pit_value_heavy *h = pit_value_ref_deref(rt, pit_value_as_ref(rt, ret));
+    pit_value_heavy *t = pit_value_ref_deref(rt, pit_value_as_ref(rt, template));
+    if (!h) { pit_error(rt, "failed to create new heavy value for lambda"); return PIT_NIL; }
+    if (!t || t->hsort != PIT_VALUE_HEAVY_SORT_FUNC) { pit_error(rt, "closure template is not a function"); return PIT_NIL; }
+    *h = *t;
+    h->in.func.env = env;
     return ret;
 }
+pit_value pit_value_func_lambda(pit_runtime *rt, pit_value args, pit_value body) {
+    /* lambdas created outside of any function can only refer to global variables, so they capture nothing */
+    pit_value expanded = pit_macroexpand(rt, pit_value_cons(rt, rt->symbols[PIT_SYMBOL_PROGN], body));
+    return pit_value_func_new(rt, args, PIT_NIL, PIT_NIL, expanded);
+}
 pit_value pit_value_nativefunc_new_with_data(pit_runtime *rt, pit_nativefunc f, void *data) {
     pit_value ret = pit_value_ref_heavy_new(rt);
     pit_value_heavy *h = pit_value_ref_deref(rt, pit_value_as_ref(rt, ret));
     if (!h) { pit_error(rt, "failed to create new heavy value for nativefunc"); return PIT_NIL; }
     h->hsort = PIT_VALUE_HEAVY_SORT_NATIVEFUNC;
     h->in.nativefunc.f = f;
+    h->in.nativefunc.fargv = NULL;
     h->in.nativefunc.data = data;
     return ret;
 }
 pit_value pit_value_nativefunc_new(pit_runtime *rt, pit_nativefunc f) {
     return pit_value_nativefunc_new_with_data(rt, f, NULL);
 }
-pit_value pit_value_apply(pit_runtime *rt, pit_value f, pit_value args) {
+pit_value pit_value_nativefunc_argv_new_with_data(pit_runtime *rt, pit_nativefunc_argv f, void *data) {
+    pit_value ret = pit_value_ref_heavy_new(rt);
+    pit_value_heavy *h = pit_value_ref_deref(rt, pit_value_as_ref(rt, ret));
+    if (!h) { pit_error(rt, "failed to create new heavy value for nativefunc"); return PIT_NIL; }
+    h->hsort = PIT_VALUE_HEAVY_SORT_NATIVEFUNC;
+    h->in.nativefunc.f = NULL;
+    h->in.nativefunc.fargv = f;
+    h->in.nativefunc.data = data;
+    return ret;
+}
+pit_value pit_value_nativefunc_argv_new(pit_runtime *rt, pit_nativefunc_argv f) {
+    return pit_value_nativefunc_argv_new_with_data(rt, f, NULL);
+}
+/* find the heavy value to call for f, or report an error */
+static pit_value_heavy *callee(pit_runtime *rt, pit_value f) {
     char buf[256] = {0};
     if (pit_value_is_symbol(rt, f)) {
         f = pit_symtab_fget(rt, f);
@@ -120,58 +161,68 @@ pit_value pit_value_apply(pit_runtime *rt, pit_value f, pit_value args) {
     /* if f is not a symbol, assume it is a func or nativefunc
        most commonly, this happens when you funcall a variable
        with a function in the value cell, e.g. passing a lambda to a function */
-    switch (pit_value_sort(f)) {
-    case PIT_VALUE_SORT_REF: {
+    if (pit_value_sort(f) == PIT_VALUE_SORT_REF) {
         pit_value_heavy *h = pit_value_ref_deref(rt, pit_value_as_ref(rt, f));
-        if (!h) { pit_error(rt, "bad ref"); return PIT_NIL; }
-        if (h->hsort == PIT_VALUE_HEAVY_SORT_FUNC) {
-            /* calling a Lisp function is simple! */
-            pit_value bound = PIT_NIL;
-            pit_value env = h->in.func.env;
-            while (env != PIT_NIL) { /* first, bind all entries in the closure */
-                pit_value b = pit_value_cons_car(rt, env);
-                pit_value nm = pit_value_cons_car(rt, b);
-                pit_symtab_bind(rt, nm, pit_value_cons_cdr(rt, b));
-                bound = pit_value_cons(rt, nm, bound);
-                env = pit_value_cons_cdr(rt, env);
-            }
-            pit_value anames = h->in.func.args;
-            while (anames != PIT_NIL) { /* bind all argument names to their values */
-                pit_value nm = pit_value_cons_car(rt, anames);
-                pit_value cell = pit_value_cell_new(rt, PIT_NIL);
-                if (h->in.func.arg_rest_nm != PIT_NIL && pit_value_eq(nm, h->in.func.arg_rest_nm)) {
-                    pit_value_cell_set(rt, cell, args, nm);
-                    pit_symtab_bind(rt, nm, cell);
-                    break;
-                } else {
-                    pit_value_cell_set(rt, cell, pit_value_cons_car(rt, args), nm);
-                    pit_symtab_bind(rt, nm, cell);
-                }
-                bound = pit_value_cons(rt, nm, bound);
-                args = pit_value_cons_cdr(rt, args);
-                anames = pit_value_cons_cdr(rt, anames);
-            }
-            pit_value ret = pit_eval(rt, h->in.func.body); /* evaluate the body */
-            while (bound != PIT_NIL) { /* unbind everything we bound earlier, in reverse */
-                pit_symtab_unbind(rt, pit_value_cons_car(rt, bound));
-                bound = pit_value_cons_cdr(rt, bound);
-            }
-            return ret;
-        } else if (h->hsort == PIT_VALUE_HEAVY_SORT_NATIVEFUNC) {
-            /* calling native functions is even simpler */
-            return h->in.nativefunc.f(rt, args, h->in.nativefunc.data);
-        } else {
-            i64 end = pit_dump(rt, buf, sizeof(buf) - 1, f, true);
-            buf[end] = 0;
-            pit_error(rt, "attempted to apply non-function ref: %s", buf);
-            return PIT_NIL;
-        }
-    }
-    default: {
+        if (!h) { pit_error(rt, "bad ref"); return NULL; }
+        if (h->hsort == PIT_VALUE_HEAVY_SORT_FUNC || h->hsort == PIT_VALUE_HEAVY_SORT_NATIVEFUNC) return h;
         i64 end = pit_dump(rt, buf, sizeof(buf) - 1, f, true);
         buf[end] = 0;
-        pit_error(rt, "attempted to apply non-function value: %s", buf);
-        return PIT_NIL;
+        pit_error(rt, "attempted to apply non-function ref: %s", buf);
+        return NULL;
+    }
+    i64 end = pit_dump(rt, buf, sizeof(buf) - 1, f, true);
+    buf[end] = 0;
+    pit_error(rt, "attempted to apply non-function value: %s", buf);
+    return NULL;
+}
+pit_value pit_value_apply(pit_runtime *rt, pit_value f, pit_value args) {
+    pit_value_heavy *h = callee(rt, f);
+    if (!h) return PIT_NIL;
+    if (h->hsort == PIT_VALUE_HEAVY_SORT_FUNC) {
+        /* Lisp functions are compiled to bytecode, so we hand them to the VM */
+        return pit_vm_apply(rt, pit_value_is_symbol(rt, f) ? pit_symtab_fget(rt, f) : f, args);
+    } else if (h->in.nativefunc.fargv != NULL) {
+        /* lay the arguments out on the stack */
+        i64 stack_reset = rt->result_stack->next;
+        i64 argc = 0;
+        pit_value ret;
+        while (args != PIT_NIL) {
+            if (pit_vec_push(pit_value)(rt->result_stack, pit_value_cons_car(rt, args)) < 0) {
+                pit_error(rt, "evaluation stack overflow");
+                rt->result_stack->next = stack_reset;
+                return PIT_NIL;
+            }
+            args = pit_value_cons_cdr(rt, args);
+            argc += 1;
+        }
+        if (rt->profiling) pit_profile_enter(rt, f, true);
+        ret = h->in.nativefunc.fargv(rt, argc, pit_vec_get(pit_value)(rt->result_stack, stack_reset), h->in.nativefunc.data);
+        if (rt->profiling) pit_profile_exit(rt, true);
+        rt->result_stack->next = stack_reset;
+        return ret;
+    } else {
+        /* calling native functions is even simpler */
+        pit_value ret;
+        if (rt->profiling) pit_profile_enter(rt, f, true);
+        ret = h->in.nativefunc.f(rt, args, h->in.nativefunc.data);
+        if (rt->profiling) pit_profile_exit(rt, true);
+        return ret;
     }
+}
+pit_value pit_value_apply_argv(pit_runtime *rt, pit_value f, i64 argc, pit_value *argv) {
+    pit_value_heavy *h = callee(rt, f);
+    if (!h) return PIT_NIL;
+    if (h->hsort == PIT_VALUE_HEAVY_SORT_FUNC) {
+        return pit_vm_apply_argv(rt, pit_value_is_symbol(rt, f) ? pit_symtab_fget(rt, f) : f, argc, argv);
+    } else {
+        pit_value args = PIT_NIL, ret;
+        if (h->in.nativefunc.fargv == NULL) {
+            for (i64 i = argc - 1; i >= 0; --i) args = pit_value_cons(rt, argv[i], args);
+        }
+        if (rt->profiling) pit_profile_enter(rt, f, true);
+        if (h->in.nativefunc.fargv != NULL) ret = h->in.nativefunc.fargv(rt, argc, argv, h->in.nativefunc.data);
+        else ret = h->in.nativefunc.f(rt, args, h->in.nativefunc.data);
+        if (rt->profiling) pit_profile_exit(rt, true);
+        return ret;
     }
 }
@@ -0,0 +1,33 @@
+#include <lcq/pit/runtime/value/proto.h>
+
+bool pit_value_is_proto(pit_runtime *rt, pit_value a) {
+    return pit_value_is_ref_heavy_sort(rt, a, PIT_VALUE_HEAVY_SORT_PROTO);
+}
+pit_value pit_value_proto_new(pit_runtime *rt, i64 nslots, u32 *code, i64 len, pit_value *consts, i64 consts_len, i64 ncaches) {
+    i64 byte_len = 0; pit_mul(&byte_len, sizeof(u32), len);
+    i64 caches_len = 0; pit_mul(&caches_len, sizeof(pit_inline_cache), ncaches);
+    pit_proto_jit *jit = pit_arena_alloc_back(rt->heap, (i64) sizeof(pit_proto_jit) + caches_len + byte_len);
+    if (!jit) { pit_error(rt, "failed to allocate bytecode"); return PIT_NIL; }
+    pit_inline_cache *caches = (pit_inline_cache *) (void *) (jit + 1);
+    u32 *dest = (u32 *) (void *) (caches + ncaches);
+    jit->calls = 0;
+    jit->native = NULL;
+    for (i64 i = 0; i < ncaches; ++i) {
+        caches[i].epoch = 0; /* the runtime's epoch starts at 1, so this is never valid */
+        caches[i].f = PIT_NIL;
+        caches[i].h = NULL;
+        caches[i].jit_epoch = 0;
+    }
+    pit_libc_string_memcpy((u8 *) dest, (u8 *) code, (size_t) byte_len);
+    pit_value cs = pit_value_array_from_buf(rt, consts, consts_len);
+    pit_value ret = pit_value_ref_heavy_new(rt);
+    pit_value_heavy *h = pit_value_ref_deref(rt, pit_value_as_ref(rt, ret));
+    if (!h) { pit_error(rt, "failed to create new heavy value for proto"); return PIT_NIL; }
+    h->hsort = PIT_VALUE_HEAVY_SORT_PROTO;
+    h->in.proto.code = dest;
+    h->in.proto.len = (i32) len;
+    h->in.proto.consts = cs;
+    h->in.proto.nslots = (i32) nslots;
+    h->in.proto.ncaches = ncaches;
+    return ret;
+}
@@ -73,14 +73,26 @@ pit_value pit_value_ref_new(pit_runtime *rt, pit_ref r) {
 }
 pit_value pit_value_ref_heavy_new(pit_runtime *rt) {
     pit_arena_index idx = pit_arena_alloc_index(rt->heap);
+    pit_value_heavy *h;
     if (idx < 0) {
         pit_error(rt, "failed to allocate space for heavy value");
         return PIT_NIL;
     }
+    /* values allocated during an incremental collection are old once it's over, without being copied */
+    h = pit_arena_get(rt->heap, idx);
+    h->remembered = false;
+    h->gray = false;
+    if (idx < rt->annotation_index_len) {
+        rt->annotation_index[idx] = 0;
+        rt->expansion_index[idx] = 0;
+    }
+    if (!rt->gc_pending && pit_gc_due(rt)) rt->gc_pending = true; /* collect at the next safe point */
     return pit_value_ref_new(rt, idx);
 }
 pit_value_heavy *pit_value_ref_deref(pit_runtime *rt, pit_ref p) {
-    return pit_arena_get(rt->heap, p);
+    pit_value_heavy *h = pit_arena_get(rt->heap, p);
+    if (h != NULL && h->gray) pit_gc_read_barrier(rt, p); /* an incremental collection hasn't scanned it yet */
+    return h;
 }
 bool pit_value_is_ref_heavy_sort(pit_runtime *rt, pit_value a, enum pit_value_heavy_sort e) {
     switch (pit_value_sort(a)) {
@@ -0,0 +1,854 @@
+#include <lcq/pit/runtime/vm.h>
+#include <lcq/pit/runtime/jit.h>
+
+/* the VM executes protos produced by pit_compile.
+   calling a closure from bytecode pushes a pit_frame rather than recursing in C;
+   we only recurse when calling into native code, which might call back into Lisp */
+
+/* turn the closure f and its argc arguments on top of the stack into a frame, and push it:
+   each argument stays in its parameter's slot as a plain value, and the rest of the slots are cleared.
+   parameters that closures capture are moved into cells by the BOX instructions the function starts with.
+   h is f's heavy value, which the caller has usually looked up already.
+   returning from the frame truncates the call stack to depth calls */
+static bool enter(pit_runtime *rt, pit_value f, pit_value_heavy *h, i64 argc, i64 calls) {
+    pit_value_heavy *p;
+    pit_value *stack = (pit_value *) rt->result_stack->data;
+    i64 stack_capacity = rt->result_stack->capacity / (i64) sizeof(pit_value);
+    pit_value anames;
+    pit_value *slots;
+    i64 i = 0;
+    pit_frame fr;
+    if (!h || h->hsort != PIT_VALUE_HEAVY_SORT_FUNC) { pit_error(rt, "attempted to enter non-function"); return false; }
+    p = pit_value_ref_deref(rt, pit_value_as_ref(rt, h->in.func.proto));
+    if (!p || p->hsort != PIT_VALUE_HEAVY_SORT_PROTO) { pit_error(rt, "function has no bytecode"); return false; }
+    if (rt->jit_alloc != NULL) {
+        pit_proto_jit *jit = pit_value_proto_jit(p);
+        if (jit->native == NULL && ++jit->calls == rt->jit_threshold) pit_jit_compile(rt, f, p);
+    }
+    fr.func = f;
+    fr.pc = 0;
+    fr.base = rt->result_stack->next - argc - 1;
+    fr.calls = calls;
+    if (fr.base + 1 + p->in.proto.nslots > stack_capacity) { pit_error(rt, "evaluation stack overflow"); return false; }
+    slots = &stack[fr.base + 1];
+    anames = h->in.func.args;
+    while (anames != PIT_NIL) {
+        pit_value nm = pit_value_cons_car(rt, anames);
+        if (h->in.func.arg_rest_nm != PIT_NIL && pit_value_eq(nm, h->in.func.arg_rest_nm)) {
+            pit_value rest = PIT_NIL;
+            for (i64 j = argc - 1; j >= i; --j) rest = pit_value_cons(rt, slots[j], rest);
+            slots[i++] = rest;
+            break;
+        }
+        if (i >= argc) slots[i] = PIT_NIL;
+        i += 1;
+        anames = pit_value_cons_cdr(rt, anames);
+    }
+    for (; i < p->in.proto.nslots; ++i) slots[i] = PIT_NIL;
+    rt->result_stack->next = fr.base + 1 + p->in.proto.nslots;
+    if (pit_vec_push(pit_frame)(rt->frames, fr) < 0) pit_error(rt, "call stack overflow");
+    else if (rt->profiling) pit_profile_enter(rt, f, false);
+    return rt->error == PIT_NIL;
+}
+
+/* look up the code, constants, inline caches and machine code (if any) for the innermost frame */
+static pit_frame *current_frame(pit_runtime *rt, u32 **code, pit_value **consts, pit_inline_cache **caches, pit_value **env, pit_jit_code **native) {
+    pit_frame *fr = pit_vec_get(pit_frame)(rt->frames, rt->frames->next - 1);
+    pit_value_heavy *f, *p, *c, *e;
+    if (fr == NULL) { pit_error(rt, "call stack underflow"); return NULL; }
+    f = pit_value_ref_deref(rt, pit_value_as_ref(rt, fr->func));
+    if (!f || f->hsort != PIT_VALUE_HEAVY_SORT_FUNC) { pit_error(rt, "frame is not a function"); return NULL; }
+    p = pit_value_ref_deref(rt, pit_value_as_ref(rt, f->in.func.proto));
+    if (!p || p->hsort != PIT_VALUE_HEAVY_SORT_PROTO) { pit_error(rt, "function has no bytecode"); return NULL; }
+    c = pit_value_ref_deref(rt, pit_value_as_ref(rt, p->in.proto.consts));
+    if (!c || c->hsort != PIT_VALUE_HEAVY_SORT_ARRAY) { pit_error(rt, "function has bad constants"); return NULL; }
+    *env = NULL;
+    if (f->in.func.env != PIT_NIL) {
+        e = pit_value_ref_deref(rt, pit_value_as_ref(rt, f->in.func.env));
+        if (!e || e->hsort != PIT_VALUE_HEAVY_SORT_ARRAY) { pit_error(rt, "function has bad environment"); return NULL; }
+        *env = e->in.array.data;
+    }
+    *code = p->in.proto.code;
+    *caches = pit_value_proto_caches(p);
+    *native = pit_value_proto_jit(p)->native;
+    *consts = c->in.array.data;
+    return fr;
+}
+
+bool pit_vm_is_intrinsic(pit_runtime *rt, pit_value f, pit_intrinsic op) {
+    pit_value_heavy *h;
+    if (rt->intrinsics[op] == NULL || pit_value_sort(f) != PIT_VALUE_SORT_REF) return false;
+    h = pit_value_ref_deref(rt, pit_value_as_ref(rt, f));
+    return h && h->hsort == PIT_VALUE_HEAVY_SORT_NATIVEFUNC && h->in.nativefunc.fargv == rt->intrinsics[op];
+}
+
+/* which pit_control the function h is, or -1 */
+static i64 control_of(pit_runtime *rt, pit_value_heavy *h) {
+    if (!h || h->hsort != PIT_VALUE_HEAVY_SORT_NATIVEFUNC || h->in.nativefunc.fargv == NULL) return -1;
+    for (i64 c = 0; c < PIT_CONTROL__SENTINEL; ++c) {
+        if (h->in.nativefunc.fargv == rt->controls[c]) return c;
+    }
+    return -1;
+}
+
+/* the heavy value of the coroutine co, or NULL (with an error) if it isn't one */
+static pit_value_heavy *coroutine_heavy(pit_runtime *rt, pit_value co) {
+    pit_value_heavy *h = pit_value_sort(co) == PIT_VALUE_SORT_REF ? pit_value_ref_deref(rt, pit_value_as_ref(rt, co)) : NULL;
+    if (!h || h->hsort != PIT_VALUE_HEAVY_SORT_COROUTINE) { pit_error(rt, "attempted to resume non-coroutine"); return NULL; }
+    return h;
+}
+
+/* switch to a coroutine, replacing the call (coroutine/resume! co [v]) on top of the stack, whose entry on the call stack is at calls.
+   a fresh coroutine's function is entered with v as its argument. a suspended coroutine's stacks are moved back,
+   with v on top as the value of the yield! it's suspended in. either way, the innermost frame is then the coroutine's */
+static bool coroutine_resume(pit_runtime *rt, i64 argc, i64 calls) {
+    pit_value *stack = (pit_value *) rt->result_stack->data;
+    i64 stack_capacity = rt->result_stack->capacity / (i64) sizeof(pit_value);
+    i64 base = rt->result_stack->next - argc - 1;
+    pit_value co = stack[base + 1];
+    pit_value v = argc > 1 ? stack[base + 2] : PIT_NIL;
+    pit_value_heavy *h = coroutine_heavy(rt, co);
+    pit_value *saved;
+    pit_coroutine_activation act;
+    if (!h) return false;
+    if (h->in.coroutine.state == PIT_COROUTINE_RUNNING) { pit_error(rt, "attempted to resume running coroutine"); return false; }
+    if (h->in.coroutine.state == PIT_COROUTINE_DEAD) { pit_error(rt, "attempted to resume finished coroutine"); return false; }
+    act.coroutine = co;
+    act.frames = rt->frames->next;
+    if (pit_vec_push(pit_coroutine_activation)(rt->coroutines, act) < 0) { pit_error(rt, "too many nested coroutines"); return false; }
+    if (h->in.coroutine.state == PIT_COROUTINE_FRESH) {
+        pit_value f = h->in.coroutine.func;
+        h->in.coroutine.state = PIT_COROUTINE_RUNNING;
+        stack[base] = f;
+        stack[base + 1] = v;
+        rt->result_stack->next = base + argc;
+        return enter(rt, f, pit_value_ref_deref(rt, pit_value_as_ref(rt, f)), argc - 1, calls);
+    }
+    saved = pit_value_ref_deref(rt, pit_value_as_ref(rt, h->in.coroutine.saved))->in.array.data;
+    if (base + h->in.coroutine.nvalues + 1 > stack_capacity) { pit_error(rt, "evaluation stack overflow"); return false; }
+    for (i64 i = 0; i < h->in.coroutine.nvalues; ++i) stack[base + i] = saved[i];
+    saved += h->in.coroutine.nvalues;
+    for (i64 i = 0; i < h->in.coroutine.nframes; ++i, saved += 4) {
+        pit_frame fr;
+        fr.func = saved[0];
+        fr.pc = pit_value_as_integer(rt, saved[1]);
+        fr.base = base + pit_value_as_integer(rt, saved[2]);
+        fr.calls = calls + pit_value_as_integer(rt, saved[3]);
+        if (pit_vec_push(pit_frame)(rt->frames, fr) < 0) { pit_error(rt, "call stack overflow"); return false; }
+    }
+    for (i64 i = 0; i < h->in.coroutine.ncalls; ++i, saved += 2) {
+        if (!pit_calls_push(rt, pit_value_as_integer(rt, saved[0]), pit_value_as_integer(rt, saved[1]))) return false;
+    }
+    stack[base + h->in.coroutine.nvalues] = v;
+    rt->result_stack->next = base + h->in.coroutine.nvalues + 1;
+    h->in.coroutine.state = PIT_COROUTINE_RUNNING;
+    return true;
+}
+
+/* suspend the running coroutine, which has called (yield! [v]) on top of the stack with its entry on the call stack at calls,
+   moving its part of the stacks into its saved array. the innermost frame is then the one that resumed it.
+   this can't suspend native code, so the coroutine must have been resumed within the run that stops at frames_reset */
+static bool coroutine_yield(pit_runtime *rt, i64 argc, i64 calls, i64 frames_reset, pit_value *v) {
+    pit_value *stack = (pit_value *) rt->result_stack->data;
+    i64 sp = rt->result_stack->next - argc - 1;
+    pit_coroutine_activation *act;
+    pit_frame *first;
+    pit_value_heavy *h;
+    pit_value *saved;
+    pit_ref saved_ref;
+    i64 base, nvalues, nframes, ncalls, first_calls, need;
+    *v = argc > 0 ? stack[sp + 1] : PIT_NIL;
+    if (rt->coroutines->next == 0) { pit_error(rt, "yield! outside of a coroutine"); return false; }
+    act = pit_vec_get(pit_coroutine_activation)(rt->coroutines, rt->coroutines->next - 1);
+    if (act->frames < frames_reset) { pit_error(rt, "yield! across a call from native code"); return false; }
+    first = pit_vec_get(pit_frame)(rt->frames, act->frames);
+    h = pit_value_ref_deref(rt, pit_value_as_ref(rt, act->coroutine));
+    base = first->base;
+    first_calls = first->calls;
+    nvalues = sp - base;
+    nframes = rt->frames->next - act->frames;
+    ncalls = calls - first_calls - 1; /* not including the call that resumed it */
+    need = nvalues + 4 * nframes + 2 * ncalls;
+    if (h->in.coroutine.saved == PIT_NIL || pit_value_array_len(rt, h->in.coroutine.saved) < need) {
+        pit_value arr = pit_value_array_new(rt, need);
+        if (rt->error != PIT_NIL) return false;
+        pit_gc_write_barrier(rt, pit_value_as_ref(rt, act->coroutine), arr);
+        h->in.coroutine.saved = arr;
+    }
+    saved_ref = pit_value_as_ref(rt, h->in.coroutine.saved);
+    saved = pit_value_ref_deref(rt, saved_ref)->in.array.data;
+    for (i64 i = 0; i < nvalues; ++i) {
+        pit_gc_write_barrier(rt, saved_ref, stack[base + i]);
+        *saved++ = stack[base + i];
+    }
+    for (i64 i = act->frames; i < rt->frames->next; ++i) {
+        pit_frame *fr = pit_vec_get(pit_frame)(rt->frames, i);
+        pit_gc_write_barrier(rt, saved_ref, fr->func);
+        *saved++ = fr->func;
+        *saved++ = pit_value_integer_new(rt, fr->pc);
+        *saved++ = pit_value_integer_new(rt, fr->base - base);
+        *saved++ = pit_value_integer_new(rt, fr->calls - first_calls);
+    }
+    for (i64 i = first_calls + 1; i < calls; ++i) {
+        pit_annotation *ann = pit_vec_get(pit_annotation)(rt->calls, i);
+        *saved++ = pit_value_integer_new(rt, ann->line);
+        *saved++ = pit_value_integer_new(rt, ann->column);
+    }
+    h->in.coroutine.state = PIT_COROUTINE_SUSPENDED;
+    h->in.coroutine.nvalues = (i32) nvalues;
+    h->in.coroutine.nframes = (i32) nframes;
+    h->in.coroutine.ncalls = (i32) ncalls;
+    if (rt->profiling) pit_profile_unwind(rt, act->frames);
+    rt->frames->next = act->frames;
+    rt->result_stack->next = base;
+    rt->calls->next = first_calls;
+    rt->coroutines->next -= 1;
+    return true;
+}
+
+/* called when a frame returns: if it was the first frame of the running coroutine, the coroutine has finished */
+static void coroutine_returned(pit_runtime *rt) {
+    pit_coroutine_activation *act = pit_vec_get(pit_coroutine_activation)(rt->coroutines, rt->coroutines->next - 1);
+    if (act->frames != rt->frames->next) return;
+    pit_value_ref_deref(rt, pit_value_as_ref(rt, act->coroutine))->in.coroutine.state = PIT_COROUTINE_DEAD;
+    rt->coroutines->next -= 1;
+}
+
+void pit_vm_coroutines_unwind(pit_runtime *rt, i64 frames) {
+    pit_coroutine_activation *act;
+    while (rt->coroutines->next > 0
+        && (act = pit_vec_get(pit_coroutine_activation)(rt->coroutines, rt->coroutines->next - 1))->frames >= frames
+    ) {
+        pit_value_heavy *h = pit_value_ref_deref(rt, pit_value_as_ref(rt, act->coroutine));
+        if (h) h->in.coroutine.state = PIT_COROUTINE_DEAD;
+        rt->coroutines->next -= 1;
+    }
+}
+
+/* record a call from the call site site (see PIT_SITE_LINE) on the call stack */
+static bool push_site(pit_runtime *rt, u32 site) {
+    if (site == 0) return pit_calls_push(rt, -1, -1);
+    rt->source_line = PIT_SITE_LINE(site);
+    rt->source_column = PIT_SITE_COLUMN(site);
+    return pit_calls_push(rt, rt->source_line, rt->source_column);
+}
+
+/* a tail call from the innermost frame fr to the callee and its argc arguments just below sp: slide them down over fr,
+   and pop fr, so that the callee's frame replaces it. the callee replaces it on the call stack too.
+   returns the new top of the stack */
+static i64 replace_frame(pit_runtime *rt, pit_frame *fr, i64 sp, i64 argc) {
+    pit_value *stack = (pit_value *) rt->result_stack->data;
+    i64 from = sp - argc - 1;
+    for (i64 i = 0; i <= argc; ++i) stack[fr->base + i] = stack[from + i];
+    rt->result_stack->next = fr->base + argc + 1;
+    *pit_vec_get(pit_annotation)(rt->calls, fr->calls) = *pit_vec_get(pit_annotation)(rt->calls, rt->calls->next - 1);
+    rt->calls->next = fr->calls + 1;
+    if (rt->profiling) pit_profile_exit(rt, false);
+    rt->frames->next -= 1;
+    return rt->result_stack->next;
+}
+
+/* pop the innermost frame fr, which is returning */
+static void leave(pit_runtime *rt, pit_frame *fr) {
+    rt->calls->next = fr->calls;
+    if (rt->profiling) pit_profile_exit(rt, false);
+    rt->frames->next -= 1;
+    if (rt->coroutines->next > 0) coroutine_returned(rt);
+}
+
+/* the machine code for the instruction at pc in the innermost frame, which st describes, or NULL to leave it to the interpreter */
+static u8 *jit_target(pit_jit_state *st, i64 pc) {
+    pit_jit_code *native = st->native;
+    st->pc = pc;
+    if (native == NULL || native->entries[pc] == 0 || st->sp + native->len > st->stack_end) return NULL;
+    return native->code + native->entries[pc];
+}
+/* point st at the innermost frame, after a call or return has switched to it or a collection has moved it */
+static pit_frame *jit_switch(pit_runtime *rt, pit_jit_state *st) {
+    pit_frame *fr = current_frame(rt, &st->code, &st->consts, &st->caches, &st->env, &st->native);
+    if (fr == NULL) return NULL;
+    st->slots = st->stack + fr->base + 1;
+    st->sp = st->stack + rt->result_stack->next;
+    return fr;
+}
+/* the frame at index i is calling a closure from machine code: leave its state for the callee to return to */
+static void jit_remember(pit_runtime *rt, pit_jit_state *st, pit_frame *fr, i64 i) {
+    pit_jit_frame *rec;
+    if (i >= rt->jit_frames_len) return;
+    rec = &rt->jit_frames[i];
+    rec->func = fr->func;
+    rec->epoch = rt->epoch;
+    rec->consts = st->consts;
+    rec->caches = st->caches;
+    rec->env = st->env;
+    rec->native = st->native;
+    rec->code = st->code;
+}
+
+u8 *pit_vm_jit_call(pit_jit_state *st, i64 pc) {
+    pit_runtime *rt = st->rt;
+    bool tail = PIT_OP_CODE(st->code[pc]) == PIT_OP_TAIL_CALL;
+    i64 argc = PIT_OP_OPERAND(st->code[pc]);
+    u32 site = st->code[pc + 1], cache = st->code[pc + 2];
+    pit_inline_cache *ic = cache != 0 ? &st->caches[cache - 1] : NULL;
+    pit_value f = st->sp[-argc - 1];
+    pit_value_heavy *h;
+    pit_frame *fr = pit_vec_get(pit_frame)(rt->frames, rt->frames->next - 1);
+    i64 calls_reset = rt->calls->next;
+    i64 params = 0;
+    u64 gc_count = rt->gc_count;
+    st->pc = pc;
+    if (ic != NULL && ic->epoch == rt->epoch && ic->f == f) h = ic->h;
+    else if (pit_value_sort(f) == PIT_VALUE_SORT_REF) h = pit_value_ref_deref(rt, pit_value_as_ref(rt, f));
+    else return NULL; /* symbols are looked up by the interpreter */
+    if (!h || control_of(rt, h) >= 0) return NULL; /* and it performs funcall, apply and switching coroutines */
+    if (h->hsort == PIT_VALUE_HEAVY_SORT_FUNC) {
+        /* the frame being replaced is all that keeps this machine code alive, so a collection has to wait for the interpreter */
+        if (tail && rt->gc_pending) return NULL;
+        if (h->in.func.arg_rest_nm == PIT_NIL) {
+            for (pit_value as = h->in.func.args; as != PIT_NIL; as = pit_value_cons_cdr(rt, as)) params += 1;
+        } else {
+            params = -1;
+        }
+    } else if (h->hsort != PIT_VALUE_HEAVY_SORT_NATIVEFUNC || h->in.nativefunc.fargv == NULL) {
+        return NULL;
+    }
+    rt->result_stack->next = st->sp - st->stack;
+    if (!push_site(rt, site)) return NULL;
+    if (h->hsort == PIT_VALUE_HEAVY_SORT_NATIVEFUNC) {
+        pit_value res;
+        if (rt->profiling) pit_profile_enter(rt, f, true);
+        res = h->in.nativefunc.fargv(rt, argc, st->sp - argc, h->in.nativefunc.data);
+        if (rt->profiling) pit_profile_exit(rt, true);
+        if (rt->error != PIT_NIL) return NULL; /* on error, the call stays on the call stack for the backtrace */
+        rt->calls->next = calls_reset;
+        st->sp -= argc;
+        st->sp[-1] = res;
+        rt->result_stack->next = st->sp - st->stack;
+        if (gc_count != rt->gc_count && jit_switch(rt, st) == NULL) return NULL;
+        return jit_target(st, pc + 3);
+    }
+    if (tail) {
+        replace_frame(rt, fr, st->sp - st->stack, argc);
+        calls_reset = fr->calls;
+    } else {
+        fr->pc = pc + 3;
+        jit_remember(rt, st, fr, rt->frames->next - 1);
+    }
+    if (!enter(rt, f, h, argc, calls_reset)) return NULL;
+    if (!tail && rt->gc_pending) pit_gc_safepoint(rt);
+    if (jit_switch(rt, st) == NULL) return NULL;
+    if (st->suspendable && --rt->fuel < 0) {
+        st->suspended = true;
+        st->pc = 0;
+        return NULL;
+    }
+    /* link the call site to the callee, if calls from machine code can enter it straight away */
+    if (ic != NULL && gc_count == rt->gc_count && ic->epoch == rt->epoch && ic->f == f
+        && params == argc && st->native != NULL && st->native->entries[0] != 0
+    ) {
+        ic->jit_epoch = rt->epoch;
+        ic->native = st->native;
+        ic->entry = st->native->code + st->native->entries[0];
+        ic->code = st->code;
+        ic->consts = st->consts;
+        ic->caches = st->caches;
+        ic->env = st->env;
+        ic->nslots = st->sp - st->slots;
+    }
+    return jit_target(st, 0);
+}
+
+u8 *pit_vm_jit_return(pit_jit_state *st, i64 pc) {
+    pit_runtime *rt = st->rt;
+    pit_frame *fr = pit_vec_get(pit_frame)(rt->frames, rt->frames->next - 1);
+    pit_value ret = st->sp[-1];
+    st->pc = pc;
+    if (rt->frames->next - 1 <= st->frames_reset) return NULL; /* the interpreter's run ends here */
+    rt->result_stack->next = fr->base;
+    leave(rt, fr);
+    st->stack[rt->result_stack->next++] = ret;
+    if ((fr = jit_switch(rt, st)) == NULL) return NULL;
+    return jit_target(st, fr->pc);
+}
+
+/* integers are boxed with the top 15 bits 0x7ff9 (see pit_value_new), and hold 49 bits sign-extended */
+#define IS_INTEGER(v) (((v) & 0xfffe000000000000) == 0xfff2000000000000)
+#define AS_INTEGER(v) (((i64) ((v) << 15)) >> 15)
+#define INTEGER(i) (0xfff2000000000000 | (0x1ffffffffffff & (u64) (i)))
+
+/* run until the frame at index frames_reset returns.
+   if suspended isn't NULL, each call to a closure takes a step of rt->fuel, and once it runs out,
+   this sets *suspended and returns with the frames left in place, to be run again later */
+static pit_value run(pit_runtime *rt, i64 frames_reset, i64 stack_reset, bool *suspended) {
+    pit_value *stack = (pit_value *) rt->result_stack->data;
+    i64 stack_capacity = rt->result_stack->capacity / (i64) sizeof(pit_value);
+    i64 sp = rt->result_stack->next; /* kept locally, and written back before anything else can see the stack */
+    pit_frame *fr = NULL;
+    u32 *code = NULL;
+    pit_value *consts = NULL;
+    pit_inline_cache *caches = NULL;
+    pit_value *env = NULL; /* the current closure's captured cells */
+    pit_value *slots = NULL;
+    pit_jit_code *native = NULL;
+    pit_jit_state st;
+    i64 pc = 0;
+    u64 gc_count = rt->gc_count;
+#define PUSH(v) do { \
+        if (sp >= stack_capacity) { pit_error(rt, "evaluation stack overflow"); goto fail; } \
+        stack[sp++] = (v); \
+    } while (0)
+#define SYNC() (rt->result_stack->next = sp)
+#define CHECK() do { if (rt->error != PIT_NIL) goto fail; } while (0)
+#define LOAD() do { \
+        if ((fr = current_frame(rt, &code, &consts, &caches, &env, &native)) == NULL) goto fail; \
+        pc = fr->pc; \
+        slots = &stack[fr->base + 1]; \
+    } while (0)
+/* anything that runs Lisp code might have collected, moving the constants and environment */
+#define RELOAD() do { \
+        if (gc_count != rt->gc_count) { \
+            gc_count = rt->gc_count; \
+            fr->pc = pc; \
+            LOAD(); \
+        } \
+    } while (0)
+    LOAD();
+    st.rt = rt;
+    st.stack = stack;
+    st.stack_end = stack + stack_capacity;
+    st.frames_reset = frames_reset;
+    st.suspendable = suspended != NULL;
+    st.suspended = false;
+    for (;;) {
+        u32 w;
+        /* machine code never uses more of the stack than there are instructions */
+        if (native != NULL && native->entries[pc] != 0 && sp + native->len <= stack_capacity) {
+            SYNC();
+            st.sp = &stack[sp];
+            st.slots = slots;
+            st.consts = consts;
+            st.caches = caches;
+            st.env = env;
+            st.native = native;
+            st.code = code;
+            st.pc = pc;
+            pit_jit_run(rt, native, &st);
+            sp = st.sp - stack;
+            CHECK();
+            /* calls and returns might have left a different frame innermost */
+            LOAD();
+            pc = st.pc;
+            gc_count = rt->gc_count;
+            if (st.suspended) goto suspend;
+        }
+        w = code[pc++];
+        switch (PIT_OP_CODE(w)) {
+        case PIT_OP_CONST:
+            PUSH(consts[PIT_OP_OPERAND(w)]);
+            break;
+        case PIT_OP_VAR: {
+            pit_value v;
+            SYNC();
+            v = pit_symtab_get(rt, consts[PIT_OP_OPERAND(w)]);
+            CHECK();
+            PUSH(v);
+            break;
+        }
+        case PIT_OP_FUNC: {
+            pit_inline_cache *ic = &caches[code[pc++]];
+            if (ic->epoch != rt->epoch) {
+                SYNC();
+                ic->f = pit_symtab_fget(rt, consts[PIT_OP_OPERAND(w)]);
+                CHECK();
+                ic->h = pit_value_sort(ic->f) == PIT_VALUE_SORT_REF ? pit_value_ref_deref(rt, pit_value_as_ref(rt, ic->f)) : NULL;
+                ic->epoch = rt->epoch;
+            }
+            PUSH(ic->f);
+            break;
+        }
+        case PIT_OP_SLOT:
+            PUSH(slots[PIT_OP_OPERAND(w)]);
+            break;
+        case PIT_OP_LOCAL: {
+            pit_value v;
+            SYNC();
+            v = pit_value_cell_get(rt, slots[PIT_OP_OPERAND(w)], PIT_NIL);
+            CHECK();
+            PUSH(v);
+            break;
+        }
+        case PIT_OP_ENV: {
+            pit_value v;
+            SYNC();
+            v = pit_value_cell_get(rt, env[PIT_OP_OPERAND(w)], PIT_NIL);
+            CHECK();
+            PUSH(v);
+            break;
+        }
+        case PIT_OP_SET_SLOT:
+            slots[PIT_OP_OPERAND(w)] = stack[sp - 1];
+            break;
+        case PIT_OP_SET_LOCAL:
+            SYNC();
+            pit_value_cell_set(rt, slots[PIT_OP_OPERAND(w)], stack[sp - 1], PIT_NIL);
+            CHECK();
+            break;
+        case PIT_OP_SET_ENV:
+            SYNC();
+            pit_value_cell_set(rt, env[PIT_OP_OPERAND(w)], stack[sp - 1], PIT_NIL);
+            CHECK();
+            break;
+        case PIT_OP_BIND_SLOT:
+            sp -= 1;
+            slots[PIT_OP_OPERAND(w)] = stack[sp];
+            break;
+        case PIT_OP_BIND: {
+            pit_value cell;
+            sp -= 1;
+            SYNC();
+            cell = pit_value_cell_new(rt, stack[sp]);
+            CHECK();
+            slots[PIT_OP_OPERAND(w)] = cell;
+            break;
+        }
+        case PIT_OP_BOX: {
+            pit_value cell;
+            SYNC();
+            cell = pit_value_cell_new(rt, slots[PIT_OP_OPERAND(w)]);
+            CHECK();
+            slots[PIT_OP_OPERAND(w)] = cell;
+            break;
+        }
+        case PIT_OP_CELL_LOCAL:
+            PUSH(slots[PIT_OP_OPERAND(w)]);
+            break;
+        case PIT_OP_CELL_ENV:
+            PUSH(env[PIT_OP_OPERAND(w)]);
+            break;
+        case PIT_OP_POP:
+            sp -= 1;
+            break;
+        case PIT_OP_JUMP:
+            pc = PIT_OP_OPERAND(w);
+            break;
+        case PIT_OP_JUMP_NIL:
+            if (stack[--sp] == PIT_NIL) pc = PIT_OP_OPERAND(w);
+            break;
+        case PIT_OP_JUMP_NOT_NIL_OR_POP:
+            if (stack[sp - 1] != PIT_NIL) pc = PIT_OP_OPERAND(w);
+            else sp -= 1;
+            break;
+        case PIT_OP_CALL:
+        case PIT_OP_TAIL_CALL: {
+            i64 argc = PIT_OP_OPERAND(w);
+            u32 site = code[pc++];
+            u32 cache = code[pc++];
+            pit_value f = stack[sp - argc - 1];
+            pit_value_heavy *h;
+            i64 control;
+            i64 calls_reset = rt->calls->next;
+            SYNC();
+            push_site(rt, site);
+            CHECK();
+            if (cache != 0 && caches[cache - 1].epoch == rt->epoch && caches[cache - 1].f == f) {
+                /* the function hasn't changed since FUNC looked it up */
+                h = caches[cache - 1].h;
+            } else {
+                if (pit_value_is_symbol(rt, f)) {
+                    f = pit_symtab_fget(rt, f);
+                    CHECK();
+                }
+                h = pit_value_sort(f) == PIT_VALUE_SORT_REF ? pit_value_ref_deref(rt, pit_value_as_ref(rt, f)) : NULL;
+            }
+            /* funcall and apply are performed here, by replacing them with the function they're given */
+            while (((control = control_of(rt, h)) == PIT_CONTROL_FUNCALL && argc >= 1)
+                || (control == PIT_CONTROL_APPLY && argc == 2)
+            ) {
+                if (control == PIT_CONTROL_APPLY) { /* spread the list of arguments onto the stack */
+                    pit_value xs = stack[--sp];
+                    argc = 1;
+                    while (xs != PIT_NIL) {
+                        PUSH(pit_value_cons_car(rt, xs));
+                        xs = pit_value_cons_cdr(rt, xs);
+                        argc += 1;
+                        CHECK();
+                    }
+                }
+                for (i64 i = sp - argc; i < sp; ++i) stack[i - 1] = stack[i];
+                sp -= 1;
+                argc -= 1;
+                SYNC();
+                f = stack[sp - argc - 1];
+                if (pit_value_is_symbol(rt, f)) {
+                    f = pit_symtab_fget(rt, f);
+                    CHECK();
+                }
+                h = pit_value_sort(f) == PIT_VALUE_SORT_REF ? pit_value_ref_deref(rt, pit_value_as_ref(rt, f)) : NULL;
+            }
+            /* and so is switching to and from coroutines, which moves their frames onto and off the stacks */
+            if (control == PIT_CONTROL_RESUME && argc >= 1 && argc <= 2) {
+                fr->pc = pc;
+                if (!coroutine_resume(rt, argc, calls_reset)) goto fail;
+                sp = rt->result_stack->next;
+                LOAD();
+                if (suspended != NULL && --rt->fuel < 0) goto suspend;
+                break;
+            }
+            if (control == PIT_CONTROL_YIELD && argc <= 1) {
+                pit_value v = PIT_NIL;
+                fr->pc = pc;
+                if (!coroutine_yield(rt, argc, calls_reset, frames_reset, &v)) goto fail;
+                if (rt->frames->next <= frames_reset) { /* the coroutine was resumed by pit_vm_coroutine_resume */
+                    rt->result_stack->next = stack_reset;
+                    return v;
+                }
+                sp = rt->result_stack->next;
+                LOAD();
+                PUSH(v);
+                break;
+            }
+            if (h && h->hsort == PIT_VALUE_HEAVY_SORT_FUNC) {
+                if (PIT_OP_CODE(w) == PIT_OP_TAIL_CALL) {
+                    sp = replace_frame(rt, fr, sp, argc);
+                    calls_reset = fr->calls;
+                } else {
+                    fr->pc = pc;
+                }
+                if (!enter(rt, f, h, argc, calls_reset)) goto fail;
+                sp = rt->result_stack->next;
+                LOAD();
+                if (suspended != NULL && --rt->fuel < 0) goto suspend;
+                if (rt->gc_pending) { /* a safe point: everything the callee needs is on the stacks */
+                    pit_gc_safepoint(rt);
+                    RELOAD();
+                }
+            } else if (h && h->hsort == PIT_VALUE_HEAVY_SORT_NATIVEFUNC && h->in.nativefunc.fargv != NULL) {
+                /* the arguments are already laid out on the stack, so the native can read them in place */
+                pit_value res;
+                if (rt->profiling) pit_profile_enter(rt, f, true);
+                res = h->in.nativefunc.fargv(rt, argc, &stack[sp - argc], h->in.nativefunc.data);
+                if (rt->profiling) pit_profile_exit(rt, true);
+                CHECK(); /* on error, the call stays on the call stack for the backtrace */
+                RELOAD();
+                rt->calls->next = calls_reset;
+                sp -= argc + 1;
+                PUSH(res);
+            } else {
+                pit_value args = PIT_NIL, res;
+                for (i64 i = 0; i < argc; ++i) args = pit_value_cons(rt, stack[--sp], args);
+                sp -= 1;
+                SYNC();
+                res = pit_value_apply(rt, f, args);
+                CHECK();
+                RELOAD();
+                rt->calls->next = calls_reset;
+                PUSH(res);
+            }
+            break;
+        }
+        case PIT_OP_RETURN: {
+            pit_value ret = stack[sp - 1];
+            sp = fr->base;
+            leave(rt, fr);
+            if (rt->frames->next <= frames_reset) {
+                rt->result_stack->next = stack_reset;
+                return rt->error == PIT_NIL ? ret : PIT_NIL;
+            }
+            LOAD();
+            PUSH(ret);
+            break;
+        }
+        case PIT_OP_CLOSURE: {
+            pit_value template = consts[PIT_OP_OPERAND(w)], v;
+            pit_value env_new = PIT_NIL;
+            i64 n = code[pc++];
+            SYNC();
+            if (n > 0) env_new = pit_value_array_from_buf(rt, &stack[sp - n], n);
+            sp -= n;
+            SYNC();
+            v = pit_value_func_instantiate(rt, template, env_new);
+            CHECK();
+            PUSH(v);
+            break;
+        }
+        case PIT_OP_EVAL: {
+            pit_value v;
+            SYNC();
+            v = pit_interpret(rt, consts[PIT_OP_OPERAND(w)]);
+            CHECK();
+            PUSH(v);
+            break;
+        }
+        case PIT_OP_INTRINSIC: {
+            pit_intrinsic op = (pit_intrinsic) PIT_OP_OPERAND(w);
+            pit_value sym = consts[code[pc++]];
+            pit_inline_cache *ic = &caches[code[pc++]];
+            u32 site = code[pc++];
+            pit_value x = stack[sp - 2], y = stack[sp - 1], res;
+            i64 calls_reset = rt->calls->next;
+            if (ic->epoch != rt->epoch) {
+                SYNC();
+                ic->f = pit_symtab_fget(rt, sym);
+                CHECK();
+                /* h marks whether the built-in is still in place; we don't need the heavy itself */
+                ic->h = pit_vm_is_intrinsic(rt, ic->f, op) ? pit_value_ref_deref(rt, pit_value_as_ref(rt, ic->f)) : NULL;
+                ic->epoch = rt->epoch;
+            }
+            if (ic->h != NULL && op == PIT_INTRINSIC_EQ) {
+                sp -= 1;
+                stack[sp - 1] = x == y ? PIT_T : PIT_NIL;
+                break;
+            }
+            if (ic->h != NULL && IS_INTEGER(x) && IS_INTEGER(y)) {
+                i64 a = AS_INTEGER(x), b = AS_INTEGER(y);
+                bool done = true;
+                switch (op) {
+                case PIT_INTRINSIC_ADD: res = INTEGER(a + b); break;
+                case PIT_INTRINSIC_SUB: res = INTEGER(a - b); break;
+                case PIT_INTRINSIC_MUL: res = INTEGER((u64) a * (u64) b); break;
+                case PIT_INTRINSIC_LT: res = a < b ? PIT_T : PIT_NIL; break;
+                case PIT_INTRINSIC_GT: res = a > b ? PIT_T : PIT_NIL; break;
+                case PIT_INTRINSIC_LE: res = a <= b ? PIT_T : PIT_NIL; break;
+                case PIT_INTRINSIC_GE: res = a >= b ? PIT_T : PIT_NIL; break;
+                case PIT_INTRINSIC_BITWISE_AND: res = INTEGER(a & b); break;
+                case PIT_INTRINSIC_BITWISE_OR: res = INTEGER(a | b); break;
+                case PIT_INTRINSIC_BITWISE_XOR: res = INTEGER(a ^ b); break;
+                /* out-of-range shifts are left to the built-in */
+                case PIT_INTRINSIC_BITWISE_LSHIFT: done = b >= 0 && b < 64; res = done ? INTEGER((u64) a << b) : PIT_NIL; break;
+                case PIT_INTRINSIC_BITWISE_RSHIFT: done = b >= 0 && b < 64; res = done ? INTEGER(a >> b) : PIT_NIL; break;
+                default: done = false; res = PIT_NIL; break;
+                }
+                if (done) {
+                    sp -= 1;
+                    stack[sp - 1] = res;
+                    break;
+                }
+            }
+            /* otherwise, this is an ordinary call */
+            SYNC();
+            push_site(rt, site);
+            CHECK();
+            res = pit_value_apply_argv(rt, ic->f, 2, &stack[sp - 2]);
+            CHECK();
+            RELOAD();
+            rt->calls->next = calls_reset;
+            sp -= 2;
+            PUSH(res);
+            break;
+        }
+        default:
+            pit_error(rt, "unknown bytecode instruction: %d", PIT_OP_CODE(w));
+            goto fail;
+        }
+    }
+suspend:
+    /* the callee hasn't started yet, so it can simply be entered again */
+    rt->fuel = 0;
+    fr->pc = pc;
+    SYNC();
+    *suspended = true;
+    return PIT_NIL;
+#undef PUSH
+#undef SYNC
+#undef CHECK
+#undef LOAD
+#undef RELOAD
+fail:
+    if (rt->profiling) pit_profile_unwind(rt, frames_reset);
+    pit_vm_coroutines_unwind(rt, frames_reset);
+    rt->frames->next = frames_reset;
+    rt->result_stack->next = stack_reset;
+    return PIT_NIL;
+}
+
+pit_value pit_vm_apply_argv(pit_runtime *rt, pit_value f, i64 argc, pit_value *argv) {
+    i64 frames_reset = rt->frames->next;
+    i64 stack_reset = rt->result_stack->next;
+    if (rt->error != PIT_NIL) return PIT_NIL;
+    if (pit_vec_push(pit_value)(rt->result_stack, f) < 0) goto overflow;
+    for (i64 i = 0; i < argc; ++i) {
+        if (pit_vec_push(pit_value)(rt->result_stack, argv[i]) < 0) goto overflow;
+    }
+    if (!enter(rt, f, pit_value_ref_deref(rt, pit_value_as_ref(rt, f)), argc, rt->calls->next)) {
+        rt->result_stack->next = stack_reset;
+        return PIT_NIL;
+    }
+    return run(rt, frames_reset, stack_reset, NULL);
+overflow:
+    pit_error(rt, "evaluation stack overflow");
+    rt->result_stack->next = stack_reset;
+    return PIT_NIL;
+}
+
+pit_value pit_vm_apply(pit_runtime *rt, pit_value f, pit_value args) {
+    i64 frames_reset = rt->frames->next;
+    i64 stack_reset = rt->result_stack->next;
+    i64 argc = 0;
+    if (rt->error != PIT_NIL) return PIT_NIL;
+    if (pit_vec_push(pit_value)(rt->result_stack, f) < 0) goto overflow;
+    while (args != PIT_NIL) {
+        if (pit_vec_push(pit_value)(rt->result_stack, pit_value_cons_car(rt, args)) < 0) goto overflow;
+        args = pit_value_cons_cdr(rt, args);
+        argc += 1;
+    }
+    if (rt->error != PIT_NIL || !enter(rt, f, pit_value_ref_deref(rt, pit_value_as_ref(rt, f)), argc, rt->calls->next)) {
+        rt->result_stack->next = stack_reset;
+        return PIT_NIL;
+    }
+    return run(rt, frames_reset, stack_reset, NULL);
+overflow:
+    pit_error(rt, "evaluation stack overflow");
+    rt->result_stack->next = stack_reset;
+    return PIT_NIL;
+}
+
+pit_value pit_vm_start(pit_runtime *rt, pit_value f, bool *suspended) {
+    i64 frames_reset = rt->frames->next;
+    i64 stack_reset = rt->result_stack->next;
+    *suspended = false;
+    if (rt->error != PIT_NIL) return PIT_NIL;
+    if (pit_vec_push(pit_value)(rt->result_stack, f) < 0) {
+        pit_error(rt, "evaluation stack overflow");
+        return PIT_NIL;
+    }
+    if (!enter(rt, f, pit_value_ref_deref(rt, pit_value_as_ref(rt, f)), 0, rt->calls->next)) {
+        rt->result_stack->next = stack_reset;
+        return PIT_NIL;
+    }
+    return run(rt, frames_reset, stack_reset, suspended);
+}
+
+pit_value pit_vm_resume(pit_runtime *rt, i64 frames_reset, i64 stack_reset, bool *suspended) {
+    *suspended = false;
+    if (rt->error != PIT_NIL) return PIT_NIL;
+    if (rt->frames->next <= frames_reset) {
+        pit_error(rt, "no suspended call to resume");
+        return PIT_NIL;
+    }
+    return run(rt, frames_reset, stack_reset, suspended);
+}
+
+pit_value pit_vm_coroutine_resume(pit_runtime *rt, i64 argc, pit_value *argv) {
+    i64 frames_reset = rt->frames->next;
+    i64 stack_reset = rt->result_stack->next;
+    i64 calls = rt->calls->next;
+    if (rt->error != PIT_NIL) return PIT_NIL;
+    if (argc < 1 || argc > 2) { pit_error(rt, "coroutine/resume! takes a coroutine and an optional value"); return PIT_NIL; }
+    /* lay out the call as the VM would have, so that coroutine_resume can replace it */
+    if (pit_vec_push(pit_value)(rt->result_stack, PIT_NIL) < 0) goto overflow;
+    for (i64 i = 0; i < argc; ++i) {
+        if (pit_vec_push(pit_value)(rt->result_stack, argv[i]) < 0) goto overflow;
+    }
+    if (!pit_calls_push(rt, rt->source_line, rt->source_column) || !coroutine_resume(rt, argc, calls)) {
+        pit_vm_coroutines_unwind(rt, frames_reset);
+        rt->frames->next = frames_reset;
+        rt->result_stack->next = stack_reset;
+        return PIT_NIL;
+    }
+    return run(rt, frames_reset, stack_reset, NULL);
+overflow:
+    pit_error(rt, "evaluation stack overflow");
+    rt->result_stack->next = stack_reset;
+    return PIT_NIL;
+}
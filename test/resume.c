@@ -0,0 +1,87 @@
+/* drives resumable evaluation (pit_eval_start, pit_eval_resume and pit_eval_abandon) the way a host would:
+   a little at a time, collecting and evaluating other things in between. run with make check */
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <lcq/pit/utils.h>
+#include <lcq/pit/lexer.h>
+#include <lcq/pit/parser.h>
+#include <lcq/pit/runtime.h>
+#include <lcq/pit/library.h>
+#include <lcq/pit/runtime/value.h>
+#include <lcq/pit/runtime/eval.h>
+#include <lcq/pit/runtime/gc.h>
+#include <lcq/pit/runtime/jit.h>
+
+static int failures = 0;
+
+#define EXPECT(c) do { if (!(c)) { fprintf(stderr, "%s:%d: expected %s\n", __FILE__, __LINE__, #c); ++failures; } } while (0)
+
+static pit_value read_form(pit_runtime *rt, char *src) {
+    pit_lexer lex;
+    pit_parser parse;
+    bool eof = false;
+    pit_lex_cstr(&lex, src);
+    pit_parser_from_lexer(&parse, &lex);
+    return pit_parse(rt, &parse, &eof);
+}
+
+/* resume the evaluation in progress budget steps at a time until it finishes, returning how many resumes it took */
+static i64 run(pit_runtime *rt, i64 budget, pit_value *result) {
+    i64 resumes = 1;
+    while (!pit_eval_resume(rt, budget, result)) {
+        /* the suspended evaluation has to survive collections between resumes */
+        if (++resumes % 5 == 0) pit_gc(rt); else pit_gc_minor(rt);
+    }
+    return resumes;
+}
+
+int main(void) {
+    i64 sz = 64 * 1024 * 1024;
+    u8 *buf = malloc((size_t) sz);
+    pit_runtime *rt = pit_runtime_new(buf, sz);
+    pit_value result = PIT_NIL;
+    i64 frames, resumes;
+    pit_install_library_essential(rt);
+    pit_jit_install_native(rt);
+    pit_eval(rt, read_form(rt, "(defun! count-up (n acc) (if (< n 1) acc (count-up (- n 1) (+ acc n))))"));
+    pit_eval(rt, read_form(rt, "(defun! sum (n) (if (< n 1) 0 (+ n (sum (- n 1)))))"));
+    frames = rt->frames->next;
+
+    /* a loop of tail calls and a deep recursion, each spread over many resumes */
+    pit_eval_start(rt, read_form(rt, "(count-up 1000 0)"));
+    resumes = run(rt, 10, &result);
+    EXPECT(resumes > 10);
+    EXPECT(pit_value_is_integer(rt, result) && pit_value_as_integer(rt, result) == 500500);
+    pit_eval_start(rt, read_form(rt, "(progn (setq! a (sum 300)) (setq! b (sum 200)) (- a b))"));
+    resumes = run(rt, 7, &result);
+    EXPECT(resumes > 10);
+    EXPECT(pit_value_is_integer(rt, result) && pit_value_as_integer(rt, result) == 45150 - 20100);
+    EXPECT(rt->frames->next == frames);
+
+    /* pit_eval still works while an evaluation is suspended, and doesn't disturb it */
+    pit_eval_start(rt, read_form(rt, "(count-up 500 0)"));
+    EXPECT(!pit_eval_resume(rt, 20, &result));
+    result = pit_eval(rt, read_form(rt, "(sum 100)"));
+    EXPECT(pit_value_is_integer(rt, result) && pit_value_as_integer(rt, result) == 5050);
+    run(rt, 20, &result);
+    EXPECT(pit_value_is_integer(rt, result) && pit_value_as_integer(rt, result) == 125250);
+
+    /* abandoning partway leaves the runtime as it was, ready for the next evaluation */
+    pit_eval_start(rt, read_form(rt, "(progn (setq! c 1) (sum 400) (setq! c 2))"));
+    EXPECT(!pit_eval_resume(rt, 50, &result));
+    EXPECT(rt->frames->next > frames);
+    pit_eval_abandon(rt);
+    EXPECT(rt->frames->next == frames);
+    EXPECT(rt->eval_forms < 0);
+    result = pit_eval(rt, read_form(rt, "c"));
+    EXPECT(pit_value_is_integer(rt, result) && pit_value_as_integer(rt, result) == 1);
+    pit_eval_start(rt, read_form(rt, "(count-up 100 0)"));
+    run(rt, 5, &result);
+    EXPECT(pit_value_is_integer(rt, result) && pit_value_as_integer(rt, result) == 5050);
+
+    EXPECT(rt->error == PIT_NIL);
+    if (rt->error != PIT_NIL) pit_runtime_print_error(rt);
+    printf("%s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}